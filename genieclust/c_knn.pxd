@@ -0,0 +1,64 @@
+# distutils: language=c++
+# cython: boundscheck=False
+# cython: cdivision=True
+# cython: nonecheck=False
+# cython: wraparound=False
+# cython: language_level=3
+
+
+
+"""
+Provides access to nearest neighbour search routines.
+
+Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+"""
+
+
+from .c_mst cimport CDistance
+
+
+cdef extern from "../src/c_knn.h":
+
+    cdef cppclass CKDTree[T]:
+        CKDTree() except +
+        CKDTree(T* X, ssize_t n, ssize_t d, T* d_core, ssize_t max_leaf_size) except +
+        ssize_t get_n()
+        ssize_t get_d()
+        void kneighbours(T* Y, ssize_t m, ssize_t k,
+            T* nn_dist, ssize_t* nn_ind, bint skip_self) except +
+        void mst(T* mst_dist, ssize_t* mst_ind) except +
+
+    void Cnn_from_distance[T](CDistance[T]* dist, ssize_t n, ssize_t m,
+        T* d_core, T* nn_dist, ssize_t* nn_ind) except +
+
+    void Cknn_from_distance[T](CDistance[T]* dist, ssize_t n, ssize_t k,
+        T* nn_dist, ssize_t* nn_ind) except + nogil
+
+    void Cmst_from_haversine[T](const T* X, ssize_t n, const T* d_core,
+        T* mst_dist, ssize_t* mst_ind) except +
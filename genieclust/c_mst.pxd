@@ -40,10 +40,24 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 """
 
 
+from libc.stdint cimport uint32_t, uint64_t
+
+
+cdef extern from "../src/c_half.h":
+    cdef cppclass CFloat16:
+        pass
+
+    cdef cppclass CBFloat16:
+        pass
+
+
 cdef extern from "../src/c_mst.h":
 
     cdef cppclass CDistance[T]:
-        pass
+        void set_queries(const T* Y, ssize_t m) except +
+        void set_queries_csr(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t m) except +
+        void set_queries_bits(const uint64_t* Y, ssize_t m) except +
 
     cdef cppclass CDistanceMutualReachability[T]: # inherits from CDistance
         CDistanceMutualReachability()
@@ -51,23 +65,118 @@ cdef extern from "../src/c_mst.h":
 
     cdef cppclass CDistanceEuclidean[T]: # inherits from CDistance
         CDistanceEuclidean()
-        CDistanceEuclidean(T* X, ssize_t n, ssize_t d, bint squared)
+        CDistanceEuclidean(const T* X, ssize_t n, ssize_t d, bint squared)
+        void quantize()
+        void early_abandon()
+        void set_mapped()
 
     cdef cppclass CDistanceManhattan[T]: # inherits from CDistance
         CDistanceManhattan()
-        CDistanceManhattan(T* X, ssize_t n, ssize_t d)
+        CDistanceManhattan(const T* X, ssize_t n, ssize_t d)
+        void early_abandon()
+        void set_mapped()
 
     cdef cppclass CDistanceCosine[T]: # inherits from CDistance
         CDistanceCosine()
-        CDistanceCosine(T* X, ssize_t n, ssize_t d)
+        CDistanceCosine(const T* X, ssize_t n, ssize_t d)
+        void set_mapped()
+
+    cdef cppclass CDistanceChebyshev[T]: # inherits from CDistance
+        CDistanceChebyshev()
+        CDistanceChebyshev(const T* X, ssize_t n, ssize_t d)
+        void set_mapped()
+
+    cdef cppclass CDistanceMinkowski[T]: # inherits from CDistance
+        CDistanceMinkowski()
+        CDistanceMinkowski(const T* X, ssize_t n, ssize_t d, T p) except +
+        void set_mapped()
+
+    cdef cppclass CDistanceHaversine[T]: # inherits from CDistance
+        CDistanceHaversine()
+        CDistanceHaversine(const T* X, ssize_t n)
+
+    cdef cppclass CDistanceMahalanobis[T]: # inherits from CDistanceEuclidean
+        CDistanceMahalanobis(const T* X, ssize_t n, ssize_t d, const T* VI, bint squared) except +
+        void quantize()
+        void early_abandon()
+
+    cdef cppclass CDistanceSEuclidean[T]: # inherits from CDistanceEuclidean
+        CDistanceSEuclidean(const T* X, ssize_t n, ssize_t d, const T* V, bint squared) except +
+        void quantize()
+        void early_abandon()
+
+    # half-precision storage, float32 computations:
+    cdef cppclass CDistanceEuclidean_f16 "CDistanceEuclidean<float, CFloat16>":
+        CDistanceEuclidean_f16(CFloat16* X, ssize_t n, ssize_t d, bint squared)
+
+    cdef cppclass CDistanceEuclidean_bf16 "CDistanceEuclidean<float, CBFloat16>":
+        CDistanceEuclidean_bf16(CBFloat16* X, ssize_t n, ssize_t d, bint squared)
+
+    cdef cppclass CDistanceManhattan_f16 "CDistanceManhattan<float, CFloat16>":
+        CDistanceManhattan_f16(CFloat16* X, ssize_t n, ssize_t d)
+
+    cdef cppclass CDistanceManhattan_bf16 "CDistanceManhattan<float, CBFloat16>":
+        CDistanceManhattan_bf16(CBFloat16* X, ssize_t n, ssize_t d)
+
+    cdef cppclass CDistanceCosine_f16 "CDistanceCosine<float, CFloat16>":
+        CDistanceCosine_f16(CFloat16* X, ssize_t n, ssize_t d)
+
+    cdef cppclass CDistanceCosine_bf16 "CDistanceCosine<float, CBFloat16>":
+        CDistanceCosine_bf16(CBFloat16* X, ssize_t n, ssize_t d)
+
+    # rows of CSR matrices:
+    cdef cppclass CDistanceSparseEuclidean[T]: # inherits from CDistance
+        CDistanceSparseEuclidean(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d, bint squared)
+
+    cdef cppclass CDistanceSparseManhattan[T]: # inherits from CDistance
+        CDistanceSparseManhattan(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d)
+
+    cdef cppclass CDistanceSparseCosine[T]: # inherits from CDistance
+        CDistanceSparseCosine(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d)
+
+    # bit-packed binary data:
+    cdef cppclass CDistanceHamming[T]: # inherits from CDistance
+        CDistanceHamming(const uint64_t* X, ssize_t n, ssize_t w, ssize_t d) except +
+
+    cdef cppclass CDistanceJaccardBits[T]: # inherits from CDistance
+        CDistanceJaccardBits(const uint64_t* X, ssize_t n, ssize_t w, ssize_t d)
+
+    # MinHash signatures of sets:
+    cdef cppclass CDistanceMinHash[T]: # inherits from CDistance
+        CDistanceMinHash(const uint32_t* S, ssize_t n, ssize_t h) except +
+
+    # user-supplied native function:
+    cdef cppclass CDistanceCallback[T]: # inherits from CDistance
+        CDistanceCallback(const void* fn, ssize_t n, ssize_t chunk_size) except +
 
     cdef cppclass CDistanceCompletePrecomputed[T]: # inherits from CDistance
         CDistanceCompletePrecomputed()
-        CDistanceCompletePrecomputed(T* d, ssize_t n)
+        CDistanceCompletePrecomputed(const T* d, ssize_t n)
+        void set_mapped()
+
+    cdef cppclass CDistanceCondensedPrecomputed[T]: # inherits from CDistance
+        CDistanceCondensedPrecomputed()
+        CDistanceCondensedPrecomputed(const T* d, ssize_t n)
+        void set_mapped()
+        void row(ssize_t i, T* out)
 
 
     ssize_t Cmst_from_nn[T](T* dist, ssize_t* ind, ssize_t n, ssize_t k,
              T* mst_dist, ssize_t* mst_ind, bint* maybe_inexact)
 
+    ssize_t Cmst_from_edges[T](const T* dist, const ssize_t* ind, ssize_t m,
+             ssize_t n, T* mst_dist, ssize_t* mst_ind, ssize_t* comp) except + nogil
+
+    ssize_t Cmst_from_graph[T](const T* data, const ssize_t* indices,
+             const ssize_t* indptr, ssize_t n,
+             T* mst_dist, ssize_t* mst_ind, ssize_t* comp) except + nogil
+
+    void Cmst_from_complete[T](CDistance[T]* dist, ssize_t n,
+             T* mst_dist, ssize_t* mst_ind) except + nogil
+
     void Cmst_from_complete[T](CDistance[T]* dist, ssize_t n,
-             T* mst_dist, ssize_t* mst_ind)
+             T* mst_dist, ssize_t* mst_ind,
+             ssize_t n_pivots, ssize_t* n_computed) except + nogil
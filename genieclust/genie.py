@@ -32,8 +32,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 import numpy as np
 from . import internal
 import scipy.spatial.distance
+import scipy.sparse
 from sklearn.base import BaseEstimator, ClusterMixin
 import sklearn.neighbors
+import sklearn.random_projection
 import warnings
 import math
 
@@ -54,13 +56,15 @@ class GenieBase(BaseEstimator, ClusterMixin):
             M,
             affinity,
             exact,
-            cast_float32
+            cast_float32,
+            projection=None
         ):
         super().__init__()
         self.M = M
         self.affinity = affinity
         self.cast_float32 = cast_float32
         self.exact = exact
+        self.projection = projection
 
         self.n_samples_   = None
         self.n_features_  = None
@@ -69,7 +73,14 @@ class GenieBase(BaseEstimator, ClusterMixin):
         self._nn_dist_    = None
         self._nn_ind_     = None
         self._d_core_     = None
+        self._metric_params_ = None
         self._last_state_ = None
+        self._predict_X_      = None
+        self._predict_index_  = None
+        self._predict_ind_    = None
+        self._predict_labels_ = None
+        self._predict_d_core_ = None
+        self._dynamic_mst_    = None
 
 
     def _postprocess(self, M, postprocess):
@@ -108,20 +119,120 @@ class GenieBase(BaseEstimator, ClusterMixin):
 
 
 
+    def _set_predict_data(self, X):
+        """(internal)
+        determines the non-noise points (based on self.labels_) amongst
+        which the nearest neighbours are sought in predict(); the search
+        index itself is only built on the first call to predict(),
+        see _get_predict_index()
+
+        X is not copied; it is None if the data are stored
+        in self._dynamic_mst_
+        """
+        self._predict_X_      = None
+        self._predict_index_  = None
+        self._predict_ind_    = None
+        self._predict_labels_ = None
+        self._predict_d_core_ = None
+
+        if self.labels_ is None:
+            return
+
+        if self.labels_.ndim == 1:
+            labels = self.labels_
+        else:
+            labels = self.labels_[-1,:] # the n_clusters-partition
+
+        ind = np.flatnonzero(labels >= 0) # non-noise points only
+        self._predict_ind_    = ind
+        self._predict_labels_ = labels[ind]
+        if self._d_core_ is not None:
+            self._predict_d_core_ = self._d_core_[ind]
+
+        if self._last_state_["affinity"] != "precomputed":
+            self._predict_X_ = X
+
+
+
+    def _get_predict_index(self):
+        """(internal)
+        returns the nearest neighbour search index over the non-noise
+        points, building it if necessary, see predict()
+        """
+        if self._predict_index_ is not None:
+            return self._predict_index_
+
+        cur_state = self._last_state_
+        X = self._predict_X_
+        if X is None:
+            X = self._dynamic_mst_.get_data()  # (a copy)
+        ind = self._predict_ind_
+
+        if scipy.sparse.issparse(X):
+            X = X.tocsr()
+        elif cur_state["affinity"] not in ("hamming", "jaccard") and \
+                (isinstance(X, np.memmap) or X.dtype == np.float16):
+            # might not fit in RAM / kept in half precision;
+            # neither copied nor cast, see NNIndex
+            self._predict_index_ = internal.NNIndex(X,
+                metric=cur_state["affinity"],
+                metric_params=self._metric_params_,
+                d_core=self._predict_d_core_,
+                quantize=(X.shape[1] >= 128),
+                ind=ind)
+            return self._predict_index_
+
+        X = X[ind,:]  # a copy
+        if cur_state["affinity"] in ("hamming", "jaccard"):
+            pass # packed by NNIndex
+        elif cur_state["cast_float32"]:
+            X = X.astype(np.float32, copy=False)
+        self._predict_index_ = internal.NNIndex(X,
+            metric=cur_state["affinity"],
+            metric_params=self._metric_params_,
+            d_core=self._predict_d_core_,
+            quantize=(X.shape[1] >= 128),
+            copy=False)
+        return self._predict_index_
+
+
+
     def fit(self, X, y=None):
         cur_state = dict()
         cur_state["X"] = id(X)
 
+        self._dynamic_mst_ = None
+
         _affinity_options = ("euclidean", "l2", "manhattan", "l1",
-                             "cityblock", "cosine", "precomputed")
+                             "cityblock", "cosine", "chebyshev",
+                             "mahalanobis", "seuclidean", "haversine",
+                             "hamming", "jaccard", "precomputed")
         cur_state["affinity"] = str(self.affinity).lower()
         if cur_state["affinity"] not in _affinity_options:
             raise ValueError("affinity should be one of %r"%_affinity_options)
 
         n_samples  = X.shape[0]
+        condensed  = False
+        sparse     = scipy.sparse.issparse(X)
+        binary     = cur_state["affinity"] in ("hamming", "jaccard")
+        # these are only supported by the native brute-force methods:
+        native     = cur_state["affinity"] in ("chebyshev", "mahalanobis",
+                                               "seuclidean")
+        if sparse and (binary or native or cur_state["affinity"] == "precomputed"):
+            raise ValueError('sparse X with affinity=%r is not supported' %
+                cur_state["affinity"])
+        elif sparse:
+            X = X.tocsr()
         if cur_state["affinity"] == "precomputed":
             n_features = self.n_features_ # the user must set it manually
-            if X.shape[0] != X.shape[1]:
+            if X.ndim == 1:
+                # a condensed distance vector, e.g., scipy's pdist()
+                condensed = True
+                n_samples = int(round((1.0+math.sqrt(1.0+8.0*X.shape[0]))/2.0))
+                if n_samples*(n_samples-1)//2 != X.shape[0] or n_samples < 2:
+                    raise ValueError("the length of a condensed distance vector must be n_samples*(n_samples-1)/2")
+                X = np.ascontiguousarray(X)
+            elif X.ndim != 2 or X.shape[0] != X.shape[1]:
                 raise ValueError("X must be a square matrix that gives all the pairwise distances")
         else:
             n_features = X.shape[1]
@@ -133,6 +244,20 @@ class GenieBase(BaseEstimator, ClusterMixin):
         cur_state["exact"] = bool(self.exact)
         cur_state["cast_float32"] = bool(self.cast_float32)
 
+        cur_state["projection"] = self.projection
+        if cur_state["projection"] is not None:
+            if sparse or cur_state["affinity"] not in ("euclidean", "l2"):
+                raise ValueError("projection is only supported for "
+                    "dense X and affinity=\"euclidean\"")
+            if isinstance(cur_state["projection"], (int, np.integer)):
+                cur_state["projection"] = int(cur_state["projection"])
+                if cur_state["projection"] < 1:
+                    raise ValueError("projection must be positive")
+            else:
+                cur_state["projection"] = float(cur_state["projection"])
+                if not 0.0 < cur_state["projection"] < 1.0:
+                    raise ValueError("projection must be an int or a float in (0,1)")
+
 
 
         mst_dist = None
@@ -141,17 +266,55 @@ class GenieBase(BaseEstimator, ClusterMixin):
         nn_ind   = None
         d_core   = None
 
-        if cur_state["cast_float32"]:
+        # the metrics supported by internal.mst_from_distance_half();
+        # float16 data are cast to float32 otherwise
+        half = (not sparse and X.dtype == np.float16 and
+            cur_state["exact"] and cur_state["affinity"] in ("euclidean",
+                "l2", "manhattan", "cityblock", "l1", "cosine"))
+
+        if binary:
+            # 64 bits per word; popcount-based distances
+            X = internal.pack_bits(X)
+        elif sparse:
+            # the zeros are never materialised
+            if cur_state["cast_float32"]:
+                X = X.astype(np.float32, copy=False)
+        elif half:
+            # half-precision storage; distances are computed in float32
+            X = np.ascontiguousarray(X)
+        elif isinstance(X, np.memmap) and cur_state["exact"] and \
+                X.dtype != np.float16:
+            # might not fit in RAM; read directly from the file
+            pass
+        elif cur_state["cast_float32"] or X.dtype == np.float16:
             # faiss supports float32 only
-            # warning if sparse!!
             X = X.astype(np.float32, order="C", copy=False)
 
+        X_orig = None  # the original X if projected
+        if cur_state["projection"] is not None:
+            if isinstance(cur_state["projection"], int):
+                n_components = cur_state["projection"]
+            else:
+                n_components = int(sklearn.random_projection.johnson_lindenstrauss_min_dim(
+                    n_samples, eps=cur_state["projection"]))
+            if n_components < n_features:
+                X_orig = np.ascontiguousarray(X,
+                    dtype=np.float64 if X.dtype == np.float64 else np.float32)
+                X = internal.random_projection(X_orig, n_components)
+
+        metric_params = None
+        if native:
+            # estimated once; used by predict() too
+            metric_params = internal._get_metric_params(X,
+                cur_state["affinity"])
+
 
         if  self._last_state_ is not None and \
                 cur_state["X"]            == self._last_state_["X"] and \
                 cur_state["affinity"]     == self._last_state_["affinity"] and \
                 cur_state["exact"]        == self._last_state_["exact"] and \
-                cur_state["cast_float32"] == self._last_state_["cast_float32"]:
+                cur_state["cast_float32"] == self._last_state_["cast_float32"] and \
+                cur_state["projection"]   == self._last_state_["projection"]:
 
             if cur_state["M"] == self._last_state_["M"]:
                 mst_dist = self._mst_dist_
@@ -166,78 +329,139 @@ class GenieBase(BaseEstimator, ClusterMixin):
                 pass
 
         if not cur_state["exact"]:
-            if cur_state["affinity"] == "precomputed":
-                raise ValueError('exact=True with affinity="precomputed"')
-
-            #raise NotImplementedError("approximate method not implemented yet")
+            if sparse:
+                # sklearn's brute-force search supports sparse matrices
+                _approx_affinities = ("euclidean", "l2", "manhattan",
+                                      "cityblock", "l1", "cosine")
+            else:
+                # faiss.IndexFlatL2
+                _approx_affinities = ("euclidean", "l2")
+            if cur_state["affinity"] not in _approx_affinities:
+                raise ValueError("exact=False is only supported for "
+                    "affinity in %r (for %s X)" % (_approx_affinities,
+                    "sparse" if sparse else "dense"))
 
-            assert cur_state["affinity"] in ("euclidean", "l2")
+            if cur_state["M"] > 1:
+                raise NotImplementedError("approximate method not implemented yet")
 
             actual_n_neighbors = min(32, int(math.ceil(math.sqrt(n_samples))))
             actual_n_neighbors = max(actual_n_neighbors, cur_state["M"]-1)
             actual_n_neighbors = min(n_samples-1, actual_n_neighbors)
 
-            # t0 = time.time()
-            #nn = sklearn.neighbors.NearestNeighbors(n_neighbors=actual_n_neighbors, **cur_state["nn_params"])
-            #nn_dist, nn_ind = nn.fit(X).kneighbors()
-            # print("T=%.3f" % (time.time()-t0), end="\t")
-
-            # FAISS - `euclidean` and `cosine` only!
-
-
-
-            # TODO:  cur_state["metric"], cur_state["metric_params"]
-            #t0 = time.time()
             # the slow part:
-            nn = faiss.IndexFlatL2(n_features)
-            nn.add(X)
-            nn_dist, nn_ind = nn.search(X, actual_n_neighbors+1)
-            #print("T=%.3f" % (time.time()-t0), end="\t")
-
-
-
-            # @TODO:::::
-            #nn_bad_where = np.where((nn_ind[:,0]!=np.arange(n_samples)))[0]
-            #print(nn_bad_where)
-            #print(nn_ind[nn_bad_where,:5])
-            #print(X[nn_bad_where,:])
-            #assert nn_bad_where.shape[0] == 0
+            if sparse:
+                # faiss does not support sparse matrices
+                nn = sklearn.neighbors.NearestNeighbors(
+                    n_neighbors=actual_n_neighbors,
+                    algorithm="brute",
+                    metric=cur_state["affinity"]
+                )
+                nn_dist, nn_ind = nn.fit(X).kneighbors()  # self excluded
+            else:
+                nn = faiss.IndexFlatL2(X.shape[1])
+                nn.add(X)
+                nn_dist, nn_ind = nn.search(X, actual_n_neighbors+1)
+                # the first column gives the points themselves;
+                # IndexFlatL2 yields the squared distances
+                nn_dist = np.sqrt(nn_dist[:,1:])
+                nn_ind  = nn_ind[:,1:]
 
-            # TODO: check cache if rebuild needed
-            nn_dist = nn_dist[:,1:].astype(X.dtype, order="C")
-            nn_ind  = nn_ind[:,1:].astype(np.intp, order="C")
+            nn_dist = nn_dist.astype(X.dtype, order="C")
+            nn_ind  = nn_ind.astype(np.intp, order="C")
 
-            if cur_state["M"] > 1:
-                # d_core = nn_dist[:,cur_state["M"]-2].astype(X.dtype, order="C")
-                raise NotImplementedError("approximate method not implemented yet")
-
-            #t0 = time.time()
             # the fast part:
             mst_dist, mst_ind = internal.mst_from_nn(nn_dist, nn_ind,
-                stop_disconnected=False, # TODO: test this!!!!
+                stop_disconnected=False,
                 stop_inexact=False)
-            #print("T=%.3f" % (time.time()-t0), end="\t")
 
         else: # cur_state["exact"]
             if cur_state["M"] > 1:
                 # Genie+HDBSCAN
                 # Use sklearn (TODO: rly???) to determine the d_core distance
-                if nn_dist is None or nn_ind is None:
+                if (nn_dist is None or nn_ind is None) and condensed:
+                    nn_dist, nn_ind = internal.knn_from_condensed(X,
+                        cur_state["M"]-1)
+                elif (nn_dist is None or nn_ind is None) and binary:
+                    nn_dist, nn_ind = internal.knn_from_distance_binary(X,
+                        cur_state["M"]-1, metric=cur_state["affinity"],
+                        n_bits=n_features)
+                elif (nn_dist is None or nn_ind is None) and native:
+                    nn_dist, nn_ind = internal.knn_from_distance(X,
+                        cur_state["M"]-1, metric=cur_state["affinity"],
+                        metric_params=metric_params)
+                elif nn_dist is None or nn_ind is None:
                     nn = sklearn.neighbors.NearestNeighbors(
                         n_neighbors=cur_state["M"]-1,
                         metric=cur_state["affinity"] # supports "precomputed"
                     )
                     nn_dist, nn_ind = nn.fit(X).kneighbors()
                 if d_core is None:
-                    d_core = nn_dist[:,cur_state["M"]-2].astype(X.dtype, order="C")
+                    d_core = nn_dist[:,cur_state["M"]-2].astype(
+                        nn_dist.dtype if binary else
+                        np.float32 if X.dtype == np.float16 else X.dtype,
+                        order="C")
 
             # Use Prim's algorithm to determine the MST
-            # w.r.t. the distances computed on the fly
-            if mst_dist is None or mst_ind is None:
-                mst_dist, mst_ind = internal.mst_from_distance(X,
+            # w.r.t. the distances computed on the fly;
+            # if X does not fit in the CPU cache, reorder the points
+            # along a space-filling curve to improve data locality;
+            # in high-dimensional spaces, the Euclidean distances are
+            # only computed if their lower bounds (based on an 8-bit copy
+            # of X) do not exclude the corresponding edges
+            if mst_dist is not None and mst_ind is not None:
+                pass
+            elif binary:
+                mst_dist, mst_ind = internal.mst_from_distance_binary(X,
+                    metric=cur_state["affinity"],
+                    d_core=d_core,
+                    n_bits=n_features
+                )
+            elif sparse:
+                mst_dist, mst_ind = internal.mst_from_distance_sparse(X,
                     metric=cur_state["affinity"],
                     d_core=d_core
                 )
+            elif half:
+                mst_dist, mst_ind = internal.mst_from_distance_half(X,
+                    metric=cur_state["affinity"],
+                    d_core=d_core
+                )
+            elif condensed:
+                # a single row; (1,1) would be taken as a 1x1 matrix
+                mst_dist, mst_ind = internal.mst_from_distance(
+                    X.reshape(1, -1) if n_samples > 2
+                    else scipy.spatial.distance.squareform(X),
+                    metric="precomputed",
+                    d_core=d_core
+                )
+            else:
+                mst_dist, mst_ind = internal.mst_from_distance(X,
+                    metric=cur_state["affinity"],
+                    d_core=d_core,
+                    reorder=(X.nbytes > 8*1024*1024),
+                    quantize=(X.shape[1] >= 128),
+                    metric_params=metric_params
+                )
+
+        if X_orig is not None and mst_dist is not self._mst_dist_:
+            # re-weight the edges determined in the reduced space
+            if nn_ind is not None:
+                nn_dist = internal.euclidean_distances_at(X_orig,
+                    np.c_[np.repeat(np.arange(n_samples), nn_ind.shape[1]),
+                          nn_ind.ravel()].astype(np.intp, order="C")
+                    ).reshape(nn_ind.shape)
+                o = np.argsort(nn_dist, axis=1, kind="stable")
+                nn_dist = np.ascontiguousarray(np.take_along_axis(nn_dist, o, axis=1))
+                nn_ind  = np.ascontiguousarray(np.take_along_axis(nn_ind, o, axis=1))
+            if d_core is not None:
+                d_core = nn_dist[:,cur_state["M"]-2].astype(X.dtype, order="C")
+            mst_dist = internal.euclidean_distances_at(X_orig, mst_ind)
+            if d_core is not None:
+                mst_dist = np.maximum(mst_dist,
+                    np.maximum(d_core[mst_ind[:,0]], d_core[mst_ind[:,1]]))
+            o = np.lexsort((mst_ind[:,1], mst_ind[:,0], mst_dist))
+            mst_dist = np.ascontiguousarray(mst_dist[o])
+            mst_ind  = np.ascontiguousarray(mst_ind[o,:])
 
         self.n_samples_  = n_samples
         self.n_features_ = n_features
@@ -246,11 +470,105 @@ class GenieBase(BaseEstimator, ClusterMixin):
         self._nn_dist_   = nn_dist
         self._nn_ind_    = nn_ind
         self._d_core_    = d_core
+        self._metric_params_ = metric_params
         self._last_state_= cur_state
 
         return self
 
 
+    def partial_fit(self, X, y=None, remove=None):
+        """Update the clustering with a new batch of points
+        (streaming data), possibly forgetting some of the previous ones.
+
+        The first call is equivalent to fit(X). Each subsequent call
+        inserts the new points into the stored minimum spanning tree:
+        for each new point, its nearest neighbours amongst the existing
+        points and the points in the same batch are the candidate edges;
+        each candidate edge replaces the heaviest edge on the cycle it
+        creates in the current tree (if the latter is heavier),
+        see genieclust.internal.DynamicMST. This way, the MST
+        (the slow part) is not recomputed from scratch. Note that the
+        updated tree is an approximate one (the edges to farther
+        points are never considered).
+
+        Then, the clustering (the fast part) is recomputed from scratch
+        based on the updated MST (whose n-1 edges are sorted first).
+        It is not resumed from the first affected merge step (e.g., from
+        a checkpointed state of the disjoint sets), because no such
+        checkpoint stays valid: each inserted or removed point changes
+        the cluster size distribution, and hence the Gini index,
+        of every intermediate partition, starting from the first step.
+        Moreover, whenever the Gini index exceeds the threshold,
+        Genie merges a smallest cluster via its lightest edge, which can be
+        anywhere in the sorted edge list. Hence, a single point can
+        change any (also the earliest) merge decision.
+
+        The points given by `remove` (e.g., the expired ones in
+        a sliding window) are removed from the tree first;
+        its pieces are reconnected by means of the candidate edges
+        gathered so far (nearest neighbours).
+
+        The labels_ (and other attributes) refer to all the current points,
+        in the order of their insertion.
+
+        The cost of an update depends on the batch size and the part
+        of the tree affected (the points are stored in the DynamicMST
+        object, and the index used by predict() is only rebuilt
+        on demand), plus the time needed to recompute the clustering
+        of all the n points, which dominates for small batches.
+
+        Only the Euclidean distance, M=1, and projection=None
+        are supported. Note that `exact` only affects the first call
+        (the initial MST); the updated tree is always an approximate one.
+
+
+        Parameters
+        ----------
+
+        X : ndarray, shape (m_samples, n_features) or None
+            A batch of new points.
+        y : None
+            Ignored.
+        remove : ndarray of ints or None
+            Indices of the current points (w.r.t. labels_)
+            to remove before inserting the new ones; only the tree
+            edges incident to them are cut and reconnected
+            (the clustering itself is still recomputed from scratch,
+            see above).
+
+
+        Returns
+        -------
+
+        self
+        """
+        if str(self.affinity).lower() not in ("euclidean", "l2") or \
+                int(self.M) != 1 or self.projection is not None:
+            raise NotImplementedError(
+                "partial_fit() supports affinity=\"euclidean\", M=1, "
+                "and projection=None only")
+
+        if self._dynamic_mst_ is None:
+            if remove is not None:
+                raise ValueError("there is nothing to remove yet")
+            self.fit(X, y)
+            self._dynamic_mst_ = internal.DynamicMST(X, self._mst_ind_)
+            # X will not be the whole dataset soon
+            self._last_state_["X"] = None
+            return self
+
+        if remove is not None:
+            self._dynamic_mst_.remove(remove)
+        if X is not None:
+            self._dynamic_mst_.insert(X)
+
+        # the data stay in self._dynamic_mst_, see _get_predict_index()
+        self.n_samples_ = len(self._dynamic_mst_)
+        self._mst_dist_, self._mst_ind_ = self._dynamic_mst_.get_mst()
+
+        return self._fit_from_mst(None)
+
+
     def fit_predict(self, X, y=None):
         """Compute a k-partition and return the predicted labels,
         see fit().
@@ -280,6 +598,77 @@ class GenieBase(BaseEstimator, ClusterMixin):
 
 
 
+    def predict(self, X):
+        """Assign new points to the clusters determined by fit().
+
+        Each point is given the label of its nearest non-noise point
+        in the fitted dataset. For M>1, the mutual reachability distance
+        is used instead of the original metric.
+
+        If M>1 and postprocess is not "all", a new point y is marked
+        as noise unless it is amongst the M-1 nearest neighbours of its
+        nearest point x, i.e., d(x, y) <= d_core(x) (compare the notion
+        of boundary points in the "boundary" postprocessing scheme).
+
+        A nearest neighbour search index (a K-d tree for the Euclidean
+        distance in low-dimensional spaces) is built on the first call
+        and stored in the fitted model, hence there is no need
+        to recompute the clustering. It refers to the data passed
+        to fit(), which should not be modified in the meantime.
+        Memory-mapped and float16 data are not copied, but searched
+        block by block.
+
+
+        Parameters
+        ----------
+
+        X : ndarray, shape (m_samples, n_features) or (m_samples, n_samples)
+            m_samples new points in the same feature space as the
+            fitted dataset. If affinity="precomputed", X[i,j] should
+            give the distance between the i-th new point and the j-th
+            point in the fitted dataset.
+
+
+        Returns
+        -------
+
+        labels : ndarray, shape (m_samples,)
+            labels[i] gives the cluster id of the i-th new point
+            (w.r.t. the n_clusters-partition if compute_all_cuts==True).
+            Negative labels correspond to noise points.
+        """
+        cur_state = self._last_state_
+
+        if self._predict_labels_ is None:
+            raise ValueError("fit() with n_clusters > 0 must be called first")
+
+        if cur_state["affinity"] == "precomputed":
+            X = np.array(X, ndmin=2, copy=False)
+            if X.shape[1] != self.n_samples_:
+                raise ValueError("X must give the distances to all the fitted points")
+            D = X[:,self._predict_ind_]
+            if self._predict_d_core_ is not None:
+                D = np.maximum(D, self._predict_d_core_.reshape(1, -1))
+            nn_ind  = np.argmin(D, axis=1)
+            nn_dist = D[np.arange(D.shape[0]), nn_ind]
+        else:
+            if cur_state["affinity"] in ("hamming", "jaccard"):
+                pass # packed by NNIndex
+            elif cur_state["cast_float32"] and scipy.sparse.issparse(X):
+                X = X.astype(np.float32, copy=False)
+            elif cur_state["cast_float32"]:
+                X = X.astype(np.float32, order="C", copy=False)
+            nn_dist, nn_ind = self._get_predict_index().query(X)
+
+        labels = self._predict_labels_[nn_ind]
+
+        if cur_state["M"] > 1 and cur_state["postprocess"] != "all":
+            labels[nn_dist > self._predict_d_core_[nn_ind]] = -1
+
+        return labels
+
+
+
 
     # not needed - inherited from BaseEstimator
     # def __repr__(self):
@@ -412,9 +801,24 @@ class Genie(GenieBase):
         Smoothing factor. M=1 gives the original Genie algorithm.
     affinity : str, default="euclidean"
         Metric used to compute the linkage. One of: "euclidean" (synonym: "l2"),
-        "manhattan" (a.k.a. "l1" and "cityblock"), "cosine" or "precomputed".
+        "manhattan" (a.k.a. "l1" and "cityblock"), "cosine", "chebyshev",
+        "mahalanobis", "seuclidean" (standardised Euclidean), "haversine",
+        "hamming", "jaccard", or "precomputed".
+        The inverse covariance matrix ("mahalanobis") and the variances
+        ("seuclidean") are estimated based on X, see
+        genieclust.internal.mst_from_distance().
+        For "haversine" (great-circle distances on the unit sphere),
+        X must give the latitudes and longitudes of the points (in radians);
+        the MST is then determined in O(n_samples*log^2(n_samples)) time
+        by means of a K-d tree over the corresponding 3D unit vectors.
+        For "hamming" and "jaccard", the nonzero elements of X are treated
+        as 1s; the data are bit-packed (64 features per word) and
+        the distances are computed by means of popcounts,
+        see genieclust.internal.mst_from_distance_binary().
         If "precomputed", a complete pairwise distance matrix
-        is needed as input (argument X) for the fit() method.
+        or a condensed distance vector (like the one returned by
+        scipy.spatial.distance.pdist) is needed as input (argument X)
+        for the fit() method.
     compute_full_tree : bool, default=True
         If True, only a partial hierarchy is determined so that
         at most n_clusters are generated. Saves some time if you think you know
@@ -429,21 +833,48 @@ class Genie(GenieBase):
         n_clusters-partition of a data set (with no notion of noise),
         choose "all".
     exact : bool, default=True
-        TODO: NOT IMPLEMENTED YET
-        ........................................................................
         If False, the minimum spanning tree is approximated
-        based on the nearest neighbours graph. Finding nearest neighbours
+        based on the nearest neighbours graph (M=1 only).
+        This is supported for affinity="euclidean" (dense X; faiss is used)
+        and, for sparse X, also for "manhattan" and "cosine"
+        (or their synonyms; sklearn's brute-force search is used);
+        other combinations raise a ValueError.
+        Finding nearest neighbours
         in low dimensional spaces is usually fast. Otherwise,
         the algorithm will need to inspect all pairwise distances,
         which gives the time complexity of O(n_samples*n_samples*n_features).
+        Note that the trees updated by partial_fit() are always
+        approximate ones, whatever the value of this parameter.
     cast_float32 : bool, default=True
         Allow casting input data to a float32 dense matrix
         (for efficiency reasons; decreases the run-time ~2x times
         at a cost of greater memory usage).
+        float16 data are never cast if exact is True and affinity is
+        "euclidean", "manhattan", or "cosine" (or their synonyms); they are
+        stored in half precision and the distances are computed
+        in float32, see genieclust.internal.mst_from_distance_half().
+        For other metrics, float16 data are always cast to float32.
+        Memory-mapped data (numpy.memmap) are never cast if exact is True
+        either, see genieclust.internal.mst_from_distance().
+        Sparse matrices (scipy.sparse) remain sparse; the distances
+        are computed based on their nonzero elements only,
+        see genieclust.internal.mst_from_distance_sparse().
         TODO: Note that some nearest neighbour search
         methods require float32 data anyway.
-        TODO: Might be a problem if the input matrix is sparse, but
-        with don't support this yet.
+    projection : None, int, or float, default=None
+        If not None (Euclidean distance and dense X only), the points
+        are first projected onto a random subspace of dimensionality
+        `projection` (if it is an int) or, if it is a float eps in (0,1),
+        the smallest one that preserves all the pairwise distances up to
+        a factor of 1+-eps with high probability (by the Johnson–Lindenstrauss
+        lemma, see sklearn.random_projection.johnson_lindenstrauss_min_dim),
+        see genieclust.internal.random_projection(). The nearest neighbours
+        and the MST are determined in the reduced space (much faster
+        if n_features is in the thousands), and then their edges are
+        re-weighted based on the exact distances in the original space.
+        The resulting tree is an approximate one. No projection is
+        performed if the target dimensionality is not smaller
+        than n_features.
 
 
 
@@ -511,9 +942,10 @@ class Genie(GenieBase):
             compute_all_cuts=False,
             postprocess="boundary",
             exact=True,
-            cast_float32=True
+            cast_float32=True,
+            projection=None
         ):
-        super().__init__(M, affinity, exact, cast_float32)
+        super().__init__(M, affinity, exact, cast_float32, projection)
 
         self.n_clusters = n_clusters
         self.gini_threshold = gini_threshold
@@ -540,7 +972,8 @@ class Genie(GenieBase):
         Parameters
         ----------
 
-        X : ndarray, shape (n_samples, n_features) or (n_samples, n_samples)
+        X : ndarray, shape (n_samples, n_features), (n_samples, n_samples),
+            or (n_samples*(n_samples-1)/2,), or a scipy.sparse matrix
             A matrix defining n_samples in a vector space with n_features.
             Hint: it might be a good idea to normalise the coordinates of the
             input data points by calling
@@ -548,7 +981,9 @@ class Genie(GenieBase):
             has total variance of 1. This way the method becomes
             translation and scale invariant.
             However, if affinity="precomputed", then X is assumed to define
-            all pairwise distances between n_samples.
+            all pairwise distances between n_samples: it should be
+            a square matrix or a condensed distance vector
+            of length n_samples*(n_samples-1)/2.
         y : None
             Ignored.
 
@@ -559,6 +994,16 @@ class Genie(GenieBase):
         self
         """
         super().fit(X, y)
+        return self._fit_from_mst(X)
+
+
+
+    def _fit_from_mst(self, X):
+        """(internal)
+        computes the clustering based on the MST determined
+        by GenieBase.fit() or GenieBase.partial_fit()
+        (X is None in the latter case)
+        """
         cur_state = self._last_state_
 
         cur_state["n_clusters"] = int(self.n_clusters)
@@ -594,6 +1039,8 @@ class Genie(GenieBase):
         if self.labels_ is not None:
             self._postprocess(cur_state["M"], cur_state["postprocess"])
 
+        self._set_predict_data(X)
+
         if cur_state["compute_full_tree"]:
             Z = internal.get_linkage_matrix(self._links_,
                 self._mst_dist_, self._mst_ind_)
@@ -671,6 +1118,8 @@ class GIc(GenieBase):
         see `Genie`
     cast_float32 : bool, default=True
         see `Genie`
+    projection : None, int, or float, default=None
+        see `Genie`
 
 
     Attributes
@@ -688,9 +1137,10 @@ class GIc(GenieBase):
             compute_all_cuts=False,
             postprocess="boundary",
             exact=True,
-            cast_float32=True
+            cast_float32=True,
+            projection=None
         ):
-        super().__init__(M, affinity, exact, cast_float32)
+        super().__init__(M, affinity, exact, cast_float32, projection)
 
         self.n_clusters = n_clusters
         self.add_clusters = add_clusters
@@ -718,7 +1168,8 @@ class GIc(GenieBase):
         Parameters
         ----------
 
-        X : ndarray, shape (n_samples, n_features) or (n_samples, n_samples)
+        X : ndarray, shape (n_samples, n_features), (n_samples, n_samples),
+            or (n_samples*(n_samples-1)/2,)
             see `Genie.fit()`
         y : None
             Ignored.
@@ -730,6 +1181,16 @@ class GIc(GenieBase):
         self
         """
         super().fit(X, y)
+        return self._fit_from_mst(X)
+
+
+
+    def _fit_from_mst(self, X):
+        """(internal)
+        computes the clustering based on the MST determined
+        by GenieBase.fit() or GenieBase.partial_fit()
+        (X is None in the latter case)
+        """
         cur_state = self._last_state_
 
         cur_state["n_clusters"] = int(self.n_clusters)
@@ -771,6 +1232,8 @@ class GIc(GenieBase):
         if self.labels_ is not None:
             self._postprocess(cur_state["M"], cur_state["postprocess"])
 
+        self._set_predict_data(X)
+
 
         if cur_state["compute_full_tree"]:
             Z = internal.get_linkage_matrix(self._links_,
@@ -47,9 +47,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 cimport cython
 cimport numpy as np
 import numpy as np
+import scipy.sparse
+import mmap
+import ctypes
+import os
+import concurrent.futures
+import multiprocessing.shared_memory
 
 
 cimport libc.math
+from libc.stdint cimport uint32_t, uint64_t
 from libcpp cimport bool
 from libcpp.vector cimport vector
 
@@ -70,7 +77,15 @@ ctypedef fused floatT:
 
 
 
+from . cimport c_argfuns
 from . cimport c_mst
+from . cimport c_knn
+from . cimport c_minhash
+from . cimport c_delaunay
+from . cimport c_manhattan_mst
+from . cimport c_projection
+from . cimport c_dynamic_mst
+from . cimport c_reorder
 from . cimport c_preprocess
 from . cimport c_postprocess
 from . cimport c_disjoint_sets
@@ -91,7 +106,7 @@ from . cimport c_genie
 
 
 
-cpdef tuple mst_from_complete(floatT[:,::1] dist): # [:,::1]==c_contiguous
+cpdef tuple mst_from_complete(const floatT[:,::1] dist): # [:,::1]==c_contiguous
     """A Jarník (Prim/Dijkstra)-like algorithm for determining
     a(*) minimum spanning tree (MST) of a complete undirected graph
     with weights given by a symmetric n*n matrix.
@@ -146,6 +161,8 @@ cpdef tuple mst_from_complete(floatT[:,::1] dist): # [:,::1]==c_contiguous
 
     cdef c_mst.CDistanceCompletePrecomputed[floatT] dist_complete = \
         c_mst.CDistanceCompletePrecomputed[floatT](&dist[0,0], n)
+    if _is_memory_mapped(dist.base):
+        dist_complete.set_mapped()
 
     c_mst.Cmst_from_complete(<c_mst.CDistance[floatT]*>(&dist_complete),
         n, &mst_dist[0], &mst_ind[0,0])
@@ -155,98 +172,1961 @@ cpdef tuple mst_from_complete(floatT[:,::1] dist): # [:,::1]==c_contiguous
 
 
 
-cpdef tuple mst_from_distance(floatT[:,::1] X,
-       str metric="euclidean", floatT[::1] d_core=None):
+cdef ssize_t _get_condensed_n(ssize_t size) except -1:
+    """(internal) Returns n such that size == n*(n-1)/2,
+    i.e., the number of points whose pairwise distances are given
+    by a condensed distance vector of length size.
+    """
+    cdef ssize_t n = <ssize_t>((1.0+libc.math.sqrt(1.0+8.0*size))/2.0+0.5)
+    if size <= 0 or n*(n-1)//2 != size:
+        raise ValueError("the length of a condensed distance vector "
+                         "must be equal to n*(n-1)/2 for some n>=2")
+    return n
+
+
+
+
+cdef bint _is_memory_mapped(object X):
+    """(internal) Checks if X is, or is a view of, a memory-mapped file,
+    e.g., a numpy.memmap or an array returned by numpy.load(..., mmap_mode="r")
+    """
+    while X is not None:
+        if isinstance(X, (np.memmap, mmap.mmap)):
+            return True
+        X = getattr(X, "base", None)
+    return False
+
+
+
+
+def _get_metric_params(X, str metric, metric_params=None):
+    """(internal) Returns a dict with the parameters of a given metric,
+    where the missing ones are set to their defaults (some of which
+    depend on X, like in scipy.spatial.distance.pdist):
+
+    - `"minkowski"`: `p` -- the order of the norm, defaults to 2;
+    - `"mahalanobis"`: `VI` -- the inverse of the covariance matrix,
+      defaults to the inverse of the sample covariance matrix of X;
+    - `"seuclidean"`: `V` -- the variances of the features,
+      defaults to the sample variances of the columns of X.
+    """
+    params = dict() if metric_params is None else dict(metric_params)
+    X = np.asarray(X)
+    dtype = np.float32 if X.dtype == np.float32 else np.float64
+
+    if metric == "minkowski":
+        params["p"] = float(params.get("p", 2.0))
+        if not params["p"] >= 1.0:
+            raise ValueError("p must be >= 1")
+    elif metric == "mahalanobis":
+        VI = params.get("VI")
+        if VI is None:
+            VI = np.linalg.inv(np.atleast_2d(np.cov(X, rowvar=False)))
+        VI = np.ascontiguousarray(VI, dtype=dtype)
+        if VI.shape != (X.shape[1], X.shape[1]):
+            raise ValueError("VI must be of shape (X.shape[1], X.shape[1])")
+        params["VI"] = VI
+    elif metric == "seuclidean":
+        V = params.get("V")
+        if V is None:
+            V = np.var(X, axis=0, ddof=1)
+        V = np.ascontiguousarray(V, dtype=dtype)
+        if V.shape != (X.shape[1], ):
+            raise ValueError("V must be of length X.shape[1]")
+        params["V"] = V
+
+    return params
+
+
+
+def _latlon_to_unit(X):
+    """(internal) Converts the latitudes and longitudes (in radians)
+    to 3D unit vectors, see c_distance.CDistanceHaversine
+    """
+    X = np.asarray(X)
+    cos_lat = np.cos(X[:,0])
+    return np.ascontiguousarray(np.c_[
+        cos_lat*np.cos(X[:,1]), cos_lat*np.sin(X[:,1]), np.sin(X[:,0])
+    ], dtype=X.dtype)
+
+
+def _arc_to_chord(a):
+    """(internal) Converts the arc lengths to the chord lengths
+    (unit sphere)"""
+    a = np.asarray(a)
+    return (2.0*np.sin(0.5*np.minimum(a, np.pi))).astype(a.dtype)
+
+
+def _chord_to_arc(c):
+    """(internal) Converts the chord lengths to the arc lengths
+    (unit sphere)"""
+    c = np.asarray(c)
+    return (2.0*np.arcsin(np.minimum(0.5*c, 1.0))).astype(c.dtype)
+
+
+
+cdef c_mst.CDistance[floatT]* _new_distance(const floatT[:,::1] X,
+        str metric, bint squared=False, bint quantize=False,
+        bint mapped=False, dict metric_params=None,
+        bint early_abandon=False) except NULL:
+    """(internal) Creates a new CDistance object for a given metric;
+    the caller is responsible for deleting it.
+
+    Note that X is not copied; it must outlive the returned object.
+
+    If squared is True and metric is "euclidean", the squared
+    Euclidean distance is used.
+
+    If quantize is True and metric is "euclidean", an 8-bit
+    scalar-quantised copy of X is created, which is used to
+    compute lower bounds for the distances,
+    see c_distance.CDistanceEuclidean::quantize().
+
+    If early_abandon is True and metric is "euclidean" or "manhattan"
+    (and X is not memory-mapped), a copy of X with the features ordered
+    w.r.t. decreasing variances is created,
+    see c_distance.CDistanceEuclidean::early_abandon().
+
+    If metric is "precomputed", X is either a square distance matrix
+    or a single row with a condensed distance vector.
+
+    If mapped is True, X is assumed to be backed by a memory-mapped file,
+    see set_mapped() in c_distance.h.
+
+    metric_params should be the result of _get_metric_params().
+    The "mahalanobis" and "seuclidean" metrics are the Euclidean
+    distances between the transformed copies of the points
+    (hence, squared, quantize, and early_abandon apply to them too).
+    """
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t d = X.shape[1]
+    cdef c_mst.CDistanceEuclidean[floatT]* d_euclid
+    cdef c_mst.CDistanceManhattan[floatT]* d_manhattan
+    cdef c_mst.CDistanceCosine[floatT]* d_cosine
+    cdef c_mst.CDistanceChebyshev[floatT]* d_chebyshev
+    cdef c_mst.CDistanceMinkowski[floatT]* d_minkowski
+    cdef c_mst.CDistanceMahalanobis[floatT]* d_mahalanobis
+    cdef c_mst.CDistanceSEuclidean[floatT]* d_seuclidean
+    cdef const floatT[:,::1] VI
+    cdef const floatT[::1] V
+    cdef c_mst.CDistanceCompletePrecomputed[floatT]* d_complete
+    cdef c_mst.CDistanceCondensedPrecomputed[floatT]* d_condensed
+
+    if metric == "euclidean" or metric == "l2":
+        d_euclid = new c_mst.CDistanceEuclidean[floatT](&X[0,0], n, d, squared)
+        if mapped:
+            d_euclid.set_mapped()
+        if quantize:
+            d_euclid.quantize()
+        if early_abandon and not mapped:
+            d_euclid.early_abandon()
+        return <c_mst.CDistance[floatT]*>d_euclid
+    elif metric == "manhattan" or metric == "cityblock" or metric == "l1":
+        d_manhattan = new c_mst.CDistanceManhattan[floatT](&X[0,0], n, d)
+        if mapped:
+            d_manhattan.set_mapped()
+        elif early_abandon:
+            d_manhattan.early_abandon()
+        return <c_mst.CDistance[floatT]*>d_manhattan
+    elif metric == "cosine":
+        d_cosine = new c_mst.CDistanceCosine[floatT](&X[0,0], n, d)
+        if mapped:
+            d_cosine.set_mapped()
+        return <c_mst.CDistance[floatT]*>d_cosine
+    elif metric == "haversine":
+        if d != 2:
+            raise ValueError("X must have 2 columns (latitudes, longitudes)")
+        return <c_mst.CDistance[floatT]*>new c_mst.CDistanceHaversine[floatT](
+            &X[0,0], n)
+    elif metric == "chebyshev" or (metric == "minkowski" and
+            metric_params["p"] == np.inf):
+        d_chebyshev = new c_mst.CDistanceChebyshev[floatT](&X[0,0], n, d)
+        if mapped:
+            d_chebyshev.set_mapped()
+        return <c_mst.CDistance[floatT]*>d_chebyshev
+    elif metric == "minkowski":
+        d_minkowski = new c_mst.CDistanceMinkowski[floatT](&X[0,0], n, d,
+            metric_params["p"])
+        if mapped:
+            d_minkowski.set_mapped()
+        return <c_mst.CDistance[floatT]*>d_minkowski
+    elif metric == "mahalanobis":
+        VI = metric_params["VI"]
+        d_mahalanobis = new c_mst.CDistanceMahalanobis[floatT](&X[0,0], n, d,
+            &VI[0,0], squared)
+        if quantize:
+            d_mahalanobis.quantize()
+        if early_abandon:
+            d_mahalanobis.early_abandon()
+        return <c_mst.CDistance[floatT]*>d_mahalanobis
+    elif metric == "seuclidean":
+        V = metric_params["V"]
+        d_seuclidean = new c_mst.CDistanceSEuclidean[floatT](&X[0,0], n, d,
+            &V[0], squared)
+        if quantize:
+            d_seuclidean.quantize()
+        if early_abandon:
+            d_seuclidean.early_abandon()
+        return <c_mst.CDistance[floatT]*>d_seuclidean
+    elif metric == "precomputed":
+        if n == d:
+            d_complete = new c_mst.CDistanceCompletePrecomputed[floatT](&X[0,0], n)
+            if mapped:
+                d_complete.set_mapped()
+            return <c_mst.CDistance[floatT]*>d_complete
+        elif n == 1:
+            n = _get_condensed_n(d)
+            d_condensed = new c_mst.CDistanceCondensedPrecomputed[floatT](&X[0,0], n)
+            if mapped:
+                d_condensed.set_mapped()
+            return <c_mst.CDistance[floatT]*>d_condensed
+        else:
+            raise ValueError("X must be a square matrix or a condensed distance vector")
+    else:
+        raise NotImplementedError("given `metric` is not supported (yet)")
+
+
+
+
+cpdef np.ndarray morton_order(const floatT[:,::1] X):
+    """Determines the ordering of the points along the Z-order
+    (Morton) space-filling curve, see c_reorder.Cmorton_order()
+
+    Points close to each other in the ordering tend to be close
+    in space, too.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d)
+        n data points in a feature space of dimensionality d.
+
+
+    Returns
+    -------
+
+    perm : ndarray, shape (n,)
+        a permutation of the set {0,1,...,n-1}, such that
+        X[perm,:] is the ordered sequence of points
+    """
+    cdef ssize_t n = X.shape[0]
+    cdef np.ndarray[ssize_t] perm = np.empty(n, dtype=np.intp)
+    if n > 0:
+        c_reorder.Cmorton_order(&X[0,0], n, X.shape[1], &perm[0])
+    return perm
+
+
+
+
+cpdef np.ndarray random_projection(const floatT[:,::1] X,
+        ssize_t n_components, uint64_t seed=0):
+    """Projects the points onto a random lower-dimensional subspace
+    by means of a very sparse random projection,
+    see c_projection.Crandom_projection().
+
+    By the Johnson–Lindenstrauss lemma, all the pairwise Euclidean
+    distances are preserved up to a factor of 1+-eps with high probability
+    if n_components >= 4*log(n)/(eps**2/2-eps**3/3), see
+    sklearn.random_projection.johnson_lindenstrauss_min_dim().
+    Hence, in high-dimensional spaces, the (approximate) MSTs
+    and nearest neighbours can be determined in the reduced space
+    much faster; see also euclidean_distances_at().
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d)
+        n data points in a feature space of dimensionality d
+    n_components : int
+        target dimensionality k
+    seed : int
+        random seed
+
+
+    Returns
+    -------
+
+    Y : ndarray, shape (n,k)
+        the projected points
+    """
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t d = X.shape[1]
+    if n_components <= 0:
+        raise ValueError("n_components must be positive")
+    cdef np.ndarray[floatT,ndim=2] Y = np.empty((n, n_components),
+        dtype=np.float32 if floatT is float else np.float64)
+    if n == 0:
+        return Y
+    if d == 0:
+        Y[:,:] = 0.0
+        return Y
+
+    with nogil:
+        c_projection.Crandom_projection(&X[0,0], n, d, n_components, seed, &Y[0,0])
+    return Y
+
+
+
+cpdef np.ndarray euclidean_distances_at(const floatT[:,::1] X,
+        const ssize_t[:,::1] ind):
+    """Computes the Euclidean distances between the given pairs of points,
+    e.g., in order to re-weight the edges of a spanning tree
+    determined in a reduced space (see random_projection()),
+    see c_projection.Ceuclidean_at().
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d)
+        n data points in a feature space of dimensionality d
+    ind : c_contiguous ndarray, shape (m,2)
+        {ind[j,0], ind[j,1]} is the j-th pair of points
+
+
+    Returns
+    -------
+
+    dist : ndarray, shape (m,)
+        dist[j] is the distance between X[ind[j,0],:] and X[ind[j,1],:]
+    """
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t m = ind.shape[0]
+    if ind.shape[1] != 2:
+        raise ValueError("ind must have 2 columns")
+    if m > 0 and (np.min(np.asarray(ind)) < 0 or np.max(np.asarray(ind)) >= n):
+        raise ValueError("ind must be in [0, n)")
+    cdef np.ndarray[floatT] dist = np.empty(m,
+        dtype=np.float32 if floatT is float else np.float64)
+    if m == 0:
+        return dist
+
+    with nogil:
+        c_projection.Ceuclidean_at(&X[0,0], X.shape[1], &ind[0,0], m, &dist[0])
+    return dist
+
+
+
+
+cdef void _set_mst_stats(dict stats, ssize_t n, ssize_t n_computed):
+    """(internal) Reports the number of distance evaluations
+    in Cmst_from_complete(), see mst_from_distance()
+    """
+    stats["n_computed"] = n_computed
+    stats["pruned"] = max(0.0, 1.0-n_computed/max(1.0, n*(n-1)/2.0))
+
+
+
+cpdef tuple mst_from_distance(const floatT[:,::1] X,
+       str metric="euclidean", floatT[::1] d_core=None, bint reorder=False,
+       bint quantize=False, metric_params=None, ssize_t n_pivots=0,
+       dict stats=None, bint early_abandon=False, bint assume_metric=False):
     """A Jarník (Prim/Dijkstra)-like algorithm for determining
     a(*) minimum spanning tree (MST) of X with respect to a given metric
     (distance). Distances are computed on the fly.
     Memory use: O(n).
 
+    If reorder is True, then the rows of X are first permuted along
+    the Z-order space-filling curve, see morton_order().
+    This way, the points being processed are close to each other
+    in memory, too, which reduces the number of cache and TLB misses
+    for large n (this does not change the MST, unless there
+    are ties amongst the edge weights).
+
+    X can be memory-mapped (e.g., a numpy.memmap over a raw binary file
+    or the result of numpy.load(..., mmap_mode="r") over an .npy file),
+    which allows for processing datasets and distance matrices that
+    do not fit in RAM. In such a case, X is never copied (reorder
+    is ignored) and the operating system is advised on the access
+    pattern: each iteration of the algorithm reads all the points
+    sequentially, or a single row of a precomputed distance matrix
+    (which is requested as a whole); the run time is then
+    limited by the disk bandwidth.
+
+    If quantize is True (Euclidean distance only), an 8-bit
+    scalar-quantised copy of X is created; it takes 4 (float32)
+    or 8 (float64) times less memory. The codes are used to compute
+    the lower bounds for the distances, and the exact distances are only
+    determined if the bounds do not exclude the corresponding edges from
+    being chosen. This does not change the MST, but it is usually much
+    faster in high-dimensional spaces (say, d >= 128),
+    unless the ranges of the features vary greatly.
+
+    If n_pivots > 0, then the distances between all the points and
+    n_pivots pivots (chosen by means of the farthest-first traversal)
+    are computed first. By the triangle inequality,
+    d(x, y) >= |d(x, p)-d(y, p)| for every pivot p; the exact
+    distance is only determined if this bound does not exclude
+    the corresponding edge (this does not change the MST).
+    On clustered data, most of the distance evaluations can be avoided,
+    which pays off for expensive metrics (e.g., high-dimensional
+    or memory-mapped data). This is valid for metrics only, and hence
+    ignored for `"cosine"`; for `"precomputed"`, the pivots are only
+    used if assume_metric is True. They are also ignored if
+    the Euclidean distances are computed based on the dot products
+    (d >= 64), as all the distances from the most recently added vertex
+    are then determined at once anyway. Pass a dict as stats to learn
+    the number of distances actually computed.
+
+    If early_abandon is True (Euclidean and Manhattan distances only),
+    a copy of X with the features sorted w.r.t. decreasing variances
+    is created. The distance between the most recently added vertex and
+    another point is then accumulated in blocks of 16 features,
+    and abandoned as soon as the partial sum exceeds the distance
+    between the point and its current nearest tree neighbour
+    (this does not change the MST). This pays off in high-dimensional
+    spaces whose features' variances differ (e.g., after PCA).
+    The quantized lower bounds take precedence if quantize is True.
+
+    For the Euclidean distance in the plane (d == 2; d_core is None),
+    the MST is a subgraph of the Delaunay triangulation of X,
+    which has O(n) edges; it is determined by means of
+    the Bowyer–Watson algorithm with exact geometric predicates,
+    see c_delaunay.Cmst_from_delaunay(), and the MST by means of
+    Kruskal's algorithm. This takes O(n log n) expected time
+    (reorder, quantize, n_pivots, and early_abandon are then ignored).
+    Similarly, for the Manhattan distance in the plane, Kruskal's
+    algorithm is run on at most 4n edges joining each point
+    with its nearest neighbours in the 8 octants around it,
+    which are found by means of sweeps over the points sorted
+    w.r.t. x+y, see c_manhattan_mst.Cmst_from_manhattan_2d();
+    O(n log n) time.
+
+
+    References
+    ----------
+
+    [1] M. Gagolewski, M. Bartoszuk, A. Cena,
+    Genie: A new, fast, and outlier-resistant hierarchical clustering algorithm,
+    Information Sciences 363 (2016) 8–23.
+
+    [2] V. Jarník, O jistém problému minimálním,
+    Práce Moravské Přírodovědecké Společnosti 6 (1930) 57–63.
+
+    [3] C.F. Olson, Parallel algorithms for hierarchical clustering,
+    Parallel Comput. 21 (1995) 1313–1325.
+
+    [4] R. Prim, Shortest connection networks and some generalizations,
+    Bell Syst. Tech. J. 36 (1957) 1389–1401.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d), (n,n), or (1,n*(n-1)/2)
+        n data points in a feature space of dimensionality d
+        or, if metric is `"precomputed"`, a symmetric matrix with
+        all the pairwise distances, or a single row with its
+        upper triangle (without the diagonal) stored row by row,
+        i.e., a condensed distance vector, like the one returned by
+        `scipy.spatial.distance.pdist` (which takes half as much memory;
+        note that a 1x1 matrix is never treated as a condensed vector).
+    metric : string
+        one of `"euclidean"` (a.k.a. `"l2"`),
+        `"manhattan"` (synonyms: `"cityblock"`, `"l1"`),
+        `"cosine"`, `"chebyshev"`, `"minkowski"`, `"mahalanobis"`,
+        `"seuclidean"` (standardised Euclidean), `"haversine"`,
+        or `"precomputed"`.
+        More metrics/distances might be supported in future versions.
+        For `"haversine"`, X must have two columns: the latitudes
+        and longitudes of the points (in radians); the distances are
+        the great-circle ones on the unit sphere (multiply them by
+        the Earth's radius to get the actual distances). As the MST
+        w.r.t. this metric is the same as the Euclidean MST of
+        the corresponding 3D unit vectors, the latter is determined
+        by means of Borůvka's algorithm with a K-d tree, see
+        c_knn.Cmst_from_haversine(); this takes O(n log^2 n) time
+        in practice (reorder and quantize are ignored).
+    d_core : c_contiguous ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance
+    reorder : bool
+        whether X should be permuted along a space-filling curve first;
+        not applicable if metric is "precomputed" or X is memory-mapped
+    quantize : bool
+        whether the lower bounds for the Euclidean distances
+        based on an 8-bit copy of X should be used;
+        applicable also to `"mahalanobis"` and `"seuclidean"`,
+        ignored for other metrics
+    metric_params : dict or None
+        additional parameters of the metric, like in
+        scipy.spatial.distance.pdist:
+        `p` for `"minkowski"` (default: 2; integers up to 4 are
+        the fastest), `VI` for `"mahalanobis"` (default:
+        the inverse of the sample covariance matrix of X),
+        and `V` for `"seuclidean"` (default: the sample variances
+        of the features). The Mahalanobis and standardised
+        Euclidean distances are computed as the Euclidean ones
+        between the points transformed once (whitened) via
+        the Cholesky decomposition of VI (or 1/sqrt(V)).
+    n_pivots : int
+        number of pivots for pruning the distance evaluations
+        (see above; the more pivots, the tighter the bounds, but
+        the more costly their computation), 0 to disable
+    stats : dict or None
+        if not None, the following keys will be set:
+        `"n_computed"`, the number of distances actually computed
+        (out of n*(n-1)/2 pairs; including the ones to the pivots),
+        and `"pruned"`, the fraction of the pairs whose distances
+        were never determined
+    early_abandon : bool
+        whether the distance computations should be abandoned early
+        (see above); applicable to `"euclidean"`, `"manhattan"`,
+        `"mahalanobis"`, and `"seuclidean"`; ignored for other metrics
+        or if X is memory-mapped
+    assume_metric : bool
+        whether the precomputed distances are known to fulfil
+        the triangle inequality; required if n_pivots > 0
+        and metric is `"precomputed"` (otherwise, the pruning could
+        yield a tree that is not minimal)
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST:
+          a) the (n-1)-ary array mst_dist is such that
+          mst_dist[i] gives the weight of the i-th edge;
+          b) mst_ind is a matrix with n-1 rows and 2 columns,
+          where {mst[i,0], mst[i,1]} defines the i-th edge of the tree.
+
+        The results are ordered w.r.t. nondecreasing weights.
+        (and then the 1st, and the the 2nd index).
+        For each i, it holds mst[i,0]<mst[i,1].
+    """
+    cdef bint mapped = _is_memory_mapped(X.base)
+    cdef np.ndarray[ssize_t] perm
+    cdef floatT[:,::1] X_perm
+    cdef floatT[::1] d_core_perm = None
+    if metric == "haversine":
+        return _mst_from_haversine(X, d_core)
+
+    if (metric == "euclidean" or metric == "l2") and d_core is None and \
+            X.shape[1] == 2 and X.shape[0] > 1:
+        return _mst_from_delaunay(X, stats)
+
+    if (metric == "manhattan" or metric == "cityblock" or metric == "l1") and \
+            d_core is None and X.shape[1] == 2 and X.shape[0] > 1:
+        return _mst_from_manhattan_2d(X, stats)
+
+    if n_pivots > 0 and metric == "precomputed" and not assume_metric:
+        raise ValueError("n_pivots > 0 requires assume_metric=True "
+            "for precomputed distances")
+
+    metric_params = _get_metric_params(X, metric, metric_params)
+    if reorder and metric != "precomputed" and X.shape[0] > 2 and not mapped:
+        perm = morton_order(X)
+        X_perm = np.asarray(X)[perm,:]
+        if d_core is not None:
+            d_core_perm = np.asarray(d_core)[perm]
+        res_dist, res_ind = mst_from_distance(X_perm, metric, d_core_perm,
+            False, quantize, metric_params, n_pivots, stats, early_abandon,
+            assume_metric)
+        res_ind = perm[res_ind]
+        res_ind.sort(axis=1)
+        perm = np.lexsort((res_ind[:,1], res_ind[:,0], res_dist))
+        return res_dist[perm], res_ind[perm,:]
+
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t d = X.shape[1]
+    cdef ssize_t i
+    if metric == "precomputed" and n == 1 and d != 1:
+        n = _get_condensed_n(d)  # condensed distance vector
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+    cdef c_mst.CDistance[floatT]* dist = NULL
+    cdef c_mst.CDistance[floatT]* dist2 = NULL
+    cdef ssize_t n_computed = 0
+
+    # get squared(!) Euclidean if d_core is None
+    dist = _new_distance(X, metric, d_core is None, quantize, mapped,
+        metric_params, early_abandon)
+
+    if d_core is not None:
+        dist2 = dist # must be deleted separately
+        dist  = <c_mst.CDistance[floatT]*>new c_mst.CDistanceMutualReachability[floatT](&d_core[0], n, dist2)
+
+    c_mst.Cmst_from_complete(dist, n, &mst_dist[0], &mst_ind[0,0],
+        n_pivots, &n_computed)
+    if stats is not None:
+        _set_mst_stats(stats, n, n_computed)
+
+    if d_core is None and metric in ("euclidean", "l2", "mahalanobis", "seuclidean"):
+        for i in range(n-1):
+            mst_dist[i] = libc.math.sqrt(mst_dist[i])
+
+    if dist:  del dist
+    if dist2: del dist2
+
+    return mst_dist, mst_ind
+
+
+
+
+
+cdef tuple _mst_from_delaunay(const floatT[:,::1] X, dict stats):
+    """(internal) See mst_from_distance()"""
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t n_computed
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+
+    with nogil:
+        n_computed = c_delaunay.Cmst_from_delaunay(&X[0,0], n,
+            &mst_dist[0], &mst_ind[0,0])
+    if stats is not None:
+        _set_mst_stats(stats, n, n_computed)
+    return mst_dist, mst_ind
+
+
+
+
+cdef tuple _mst_from_manhattan_2d(const floatT[:,::1] X, dict stats):
+    """(internal) See mst_from_distance()"""
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t n_computed
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+
+    with nogil:
+        n_computed = c_manhattan_mst.Cmst_from_manhattan_2d(&X[0,0], n,
+            &mst_dist[0], &mst_ind[0,0])
+    if stats is not None:
+        _set_mst_stats(stats, n, n_computed)
+    return mst_dist, mst_ind
+
+
+
+
+cpdef np.ndarray delaunay_edges(const floatT[:,::1] X):
+    """Determines the edges of a Delaunay triangulation of a set of points
+    in the plane, see c_delaunay.Cdelaunay_edges().
+
+    The triangulation is constructed by means of the Bowyer–Watson
+    algorithm with exact geometric predicates (the result is valid
+    also for degenerate inputs, e.g., points on a grid).
+    Its edges include all the edges of each Euclidean MST of X.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,2)
+        n points in the plane
+
+
+    Returns
+    -------
+
+    ind : ndarray, shape (m,2)
+        the m <= 3n-6 edges, with ind[j,0] < ind[j,1];
+        duplicated points are connected with their first occurrences only,
+        and collinear points with their successors along the line
+    """
+    cdef ssize_t n = X.shape[0]
+    if X.shape[1] != 2:
+        raise ValueError("X must have 2 columns")
+    if n <= 0:
+        raise ValueError("X must be nonempty")
+
+    cdef vector[ssize_t] edges
+    with nogil:
+        c_delaunay.Cdelaunay_edges(&X[0,0], n, edges)
+
+    cdef np.ndarray[ssize_t,ndim=2] ind = np.empty((edges.size()//2, 2), dtype=np.intp)
+    cdef ssize_t j
+    for j in range(<ssize_t>edges.size()//2):
+        ind[j,0] = edges[2*j+0]
+        ind[j,1] = edges[2*j+1]
+    return ind
+
+
+
+
+cdef tuple _mst_from_haversine(const floatT[:,::1] X, floatT[::1] d_core):
+    """(internal) See mst_from_distance()"""
+    cdef ssize_t n = X.shape[0]
+    if X.shape[1] != 2:
+        raise ValueError("X must have 2 columns (latitudes, longitudes)")
+    if n <= 0:
+        raise ValueError("X must be nonempty")
+    if d_core is not None and d_core.shape[0] != n:
+        raise ValueError("d_core must be of length X.shape[0]")
+
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+    if n == 1:
+        return mst_dist, mst_ind
+
+    c_knn.Cmst_from_haversine(&X[0,0], n,
+        <floatT*>NULL if d_core is None else &d_core[0],
+        &mst_dist[0], &mst_ind[0,0])
+    return mst_dist, mst_ind
+
+
+
+
+def _mst_from_edges(floatT[::1] dist, ssize_t[:,::1] ind, ssize_t n,
+        ssize_t[::1] comp=None):
+    """(internal) A minimum spanning forest of a graph given by
+    an edge list, see c_mst.Cmst_from_edges() and mst_from_graph()
+    """
+    cdef ssize_t m = dist.shape[0]
+    if ind.shape[0] != m or ind.shape[1] != 2:
+        raise ValueError("ind must be of shape (len(dist), 2)")
+    if n <= 0:
+        raise ValueError("n must be positive")
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+    cdef floatT* dist_ptr = &dist[0] if m > 0 else NULL
+    cdef ssize_t* ind_ptr = &ind[0,0] if m > 0 else NULL
+    cdef ssize_t* comp_ptr = NULL
+    if comp is not None:
+        comp_ptr = &comp[0]
+    cdef floatT dummy_dist
+    cdef ssize_t dummy_ind[2]
+    with nogil:
+        c_mst.Cmst_from_edges(dist_ptr, ind_ptr, m, n,
+            &mst_dist[0] if n > 1 else &dummy_dist,
+            &mst_ind[0,0] if n > 1 else dummy_ind, comp_ptr)
+    return mst_dist, mst_ind
+
+
+
+def _mst_from_csr(floatT[::1] data, ssize_t[::1] indices, ssize_t[::1] indptr,
+        ssize_t n, ssize_t[::1] comp=None):
+    """(internal) A minimum spanning forest of a graph given by
+    a CSR matrix, see c_mst.Cmst_from_graph() and mst_from_graph()
+    """
+    if n <= 0:
+        raise ValueError("n must be positive")
+    if indptr.shape[0] != n+1 or indices.shape[0] != data.shape[0] or \
+            indptr[n] != data.shape[0]:
+        raise ValueError("ill-defined CSR matrix")
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+    cdef floatT* data_ptr = &data[0] if data.shape[0] > 0 else NULL
+    cdef ssize_t* indices_ptr = &indices[0] if data.shape[0] > 0 else NULL
+    cdef ssize_t* comp_ptr = NULL
+    if comp is not None:
+        comp_ptr = &comp[0]
+    cdef floatT dummy_dist
+    cdef ssize_t dummy_ind[2]
+    with nogil:
+        c_mst.Cmst_from_graph(data_ptr, indices_ptr, &indptr[0], n,
+            &mst_dist[0] if n > 1 else &dummy_dist,
+            &mst_ind[0,0] if n > 1 else dummy_ind, comp_ptr)
+    return mst_dist, mst_ind
+
+
+
+def mst_from_graph(G, n=None, bint stop_disconnected=False, dict stats=None):
+    """Computes a minimum spanning tree(*) of a weighted undirected graph
+    given by a sparse matrix or an edge list using Kruskal's algorithm,
+    and orders its edges w.r.t. increasing weights,
+    see c_mst.Cmst_from_graph() and c_mst.Cmst_from_edges().
+
+    Unlike in mst_from_nn(), the vertices may have arbitrary degrees
+    (e.g., radius or similarity graphs, or nearest neighbour graphs
+    with missing entries). The edges are sorted in parallel.
+
+    (*) or forest, if the input graph is disconnected; see stats.
+
+
+    Parameters
+    ----------
+
+    G : scipy.sparse matrix, shape (n,n), or a pair (dist, ind)
+        either a sparse matrix whose nonzero element G[i,j] gives
+        the weight of the edge {i, j} (each edge may be given once
+        or twice, e.g., the whole symmetric matrix; the diagonal
+        is ignored; note that the explicitly stored zeros are edges
+        too), or an edge list: a vector dist of length m
+        and a matrix ind with m rows and 2 columns, where dist[j]
+        is the weight of the edge {ind[j,0], ind[j,1]};
+        the weights should be dissimilarities (e.g., 1-similarity)
+    n : int or None
+        number of vertices; only used with an edge list;
+        defaults to ind.max()+1
+    stop_disconnected : bool
+        raise an exception if the input graph is not connected
+    stats : dict or None
+        if not None, the following keys will be set:
+        `"n_components"`, the number of connected components,
+        and `"components"`, an integer vector of length n
+        giving the components' ids (0, 1, ...) of the vertices
+
+
+    Returns
+    -------
+
+    pair : tuple
+        see mst_from_nn()
+    """
+    if scipy.sparse.issparse(G):
+        if G.shape[0] != G.shape[1]:
+            raise ValueError("G must be a square matrix")
+        G = G.tocsr()
+        n = G.shape[0]
+        data = np.ascontiguousarray(G.data,
+            dtype=np.float32 if G.data.dtype == np.float32 else np.float64)
+        indices = np.ascontiguousarray(G.indices, dtype=np.intp)
+        indptr  = np.ascontiguousarray(G.indptr, dtype=np.intp)
+    elif isinstance(G, tuple) and len(G) == 2:
+        dist, ind = G
+        dist = np.ascontiguousarray(dist,
+            dtype=np.float32 if np.asarray(dist).dtype == np.float32 else np.float64)
+        ind = np.ascontiguousarray(ind, dtype=np.intp)
+        if ind.ndim != 2 or ind.shape[1] != 2 or ind.shape[0] != dist.shape[0]:
+            raise ValueError("ind must be of shape (len(dist), 2)")
+        if n is None:
+            n = int(ind.max())+1 if ind.shape[0] > 0 else 1
+    else:
+        raise ValueError("G must be a scipy.sparse matrix or a pair (dist, ind)")
+
+    comp = np.empty(n, dtype=np.intp)
+    if scipy.sparse.issparse(G):
+        mst_dist, mst_ind = _mst_from_csr(data, indices, indptr, n, comp)
+    else:
+        mst_dist, mst_ind = _mst_from_edges(dist, ind, n, comp)
+
+    n_components = int(comp.max())+1 if n > 0 else 0
+    if stop_disconnected and n_components > 1:
+        raise ValueError("graph is disconnected")
+    if stats is not None:
+        stats["n_components"] = n_components
+        stats["components"] = comp
+
+    return mst_dist, mst_ind
+
+
+
+def _mst_from_shard_pair(spec, idx, metric, d_core, metric_params):
+    """(internal) The MST of a subset of points (e.g., the union of
+    two shards) stored in shared memory or a memory-mapped file,
+    see mst_from_distance_sharded()
+
+    spec is ("shm", name, shape, dtype) or ("mmap", filename, offset,
+    shape, dtype); the returned indices refer to the whole dataset
+    """
+    if spec[0] == "shm":
+        shm = multiprocessing.shared_memory.SharedMemory(name=spec[1])
+        try:
+            X = np.ndarray(spec[2], dtype=spec[3], buffer=shm.buf)
+            X_sub = X[idx,:]  # a copy
+            del X
+        finally:
+            shm.close()
+    else:
+        X = np.memmap(spec[1], mode="r", offset=spec[2], shape=spec[3],
+            dtype=spec[4])
+        X_sub = np.ascontiguousarray(X[idx,:])
+        del X
+
+    mst_dist, mst_ind = mst_from_distance(X_sub, metric, d_core,
+        metric_params=metric_params)
+    return mst_dist, idx[mst_ind]
+
+
+
+def mst_from_distance_sharded(X, ssize_t n_shards=4, str metric="euclidean",
+        d_core=None, n_jobs=None, metric_params=None):
+    """Determines an exact minimum spanning tree of X by means of
+    a divide-and-conquer algorithm whose subproblems can be solved
+    in separate processes, each one needing O(n/n_shards) memory.
+
+    The points are split into n_shards shards (of consecutive indices).
+    The MST of the union of each pair of shards is determined
+    (via mst_from_distance(); n_shards*(n_shards-1)/2 independent tasks).
+    Each edge of the complete graph belongs to at least one such subgraph,
+    and an edge not in the subgraph's MST is the heaviest one on some cycle,
+    hence it is not needed in the MST of the whole graph either.
+    Therefore, the MST of the union of the subgraphs' MSTs
+    (determined by means of Kruskal's algorithm) is an MST of X.
+    The total amount of work is about twice that of mst_from_distance().
+
+    The tasks are run in a pool of n_jobs local processes. X is placed
+    in shared memory (multiprocessing.shared_memory), or, if it is
+    a numpy.memmap, each process maps the same file (so that the operating
+    system's page cache is shared); only the two shards are copied
+    in each task.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray or numpy.memmap, shape (n,d)
+        n data points in a feature space of dimensionality d
+    n_shards : int
+        number of shards; 1 is equivalent to calling mst_from_distance()
+    metric : string
+        see mst_from_distance(); `"precomputed"` is not supported
+    d_core : c_contiguous ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance
+    n_jobs : int or None
+        number of processes; None for os.cpu_count();
+        1 to solve all the subproblems in the current process
+    metric_params : dict or None
+        see mst_from_distance(); estimated based on the whole X
+
+
+    Returns
+    -------
+
+    pair : tuple
+        see mst_from_distance()
+    """
+    if metric == "precomputed":
+        raise ValueError("metric=\"precomputed\" is not supported")
+    if n_shards <= 0:
+        raise ValueError("n_shards must be positive")
+    if X.ndim != 2:
+        raise ValueError("X must be a matrix")
+
+    cdef ssize_t n = X.shape[0]
+    if d_core is not None:
+        d_core = np.ascontiguousarray(d_core, dtype=X.dtype)
+        if d_core.shape[0] != n:
+            raise ValueError("d_core must be of length X.shape[0]")
+
+    n_shards = min(n_shards, n)
+    if n_shards <= 1:
+        return mst_from_distance(np.ascontiguousarray(X), metric, d_core,
+            metric_params=metric_params)
+
+    # the subproblems must use the same parameters (e.g., VI)
+    metric_params = _get_metric_params(X, metric, metric_params)
+
+    shards = np.array_split(np.arange(n, dtype=np.intp), n_shards)
+    pairs = [
+        np.r_[shards[i], shards[j]]
+        for i in range(n_shards) for j in range(i+1, n_shards)
+    ]
+    if n_jobs is None:
+        n_jobs = os.cpu_count() or 1
+    n_jobs = max(1, min(int(n_jobs), len(pairs)))
+
+    shm = None
+    if isinstance(X, np.memmap) and X.filename is not None and \
+            X.flags.c_contiguous:
+        spec = ("mmap", X.filename, X.offset, X.shape, X.dtype)
+    else:
+        X = np.ascontiguousarray(X)
+        shm = multiprocessing.shared_memory.SharedMemory(create=True,
+            size=max(1, X.nbytes))
+        np.ndarray(X.shape, dtype=X.dtype, buffer=shm.buf)[:,:] = X
+        spec = ("shm", shm.name, X.shape, X.dtype)
+
+    try:
+        args = [
+            (spec, idx, metric, None if d_core is None else d_core[idx],
+                metric_params)
+            for idx in pairs
+        ]
+        if n_jobs == 1:
+            res = [_mst_from_shard_pair(*a) for a in args]
+        else:
+            with concurrent.futures.ProcessPoolExecutor(n_jobs) as pool:
+                res = list(pool.map(_mst_from_shard_pair, *zip(*args)))
+    finally:
+        if shm is not None:
+            shm.close()
+            shm.unlink()
+
+    # Kruskal's algorithm on the union of the subproblems' MSTs
+    edge_dist = np.concatenate([r[0] for r in res])
+    edge_ind  = np.ascontiguousarray(np.concatenate([r[1] for r in res]),
+        dtype=np.intp)
+    return _mst_from_edges(edge_dist, edge_ind, n)
+
+
+
+
+cpdef tuple knn_from_condensed(const floatT[::1] dist, ssize_t k):
+    """Determines the k nearest neighbours of all the points
+    based on a condensed distance vector (the upper triangle of the pairwise
+    distance matrix stored row by row, see mst_from_distance()).
+
+    The rows of the distance matrix are gathered one at a time,
+    see c_distance.CDistanceCondensedPrecomputed::row().
+
+
+    Parameters
+    ----------
+
+    dist : c_contiguous ndarray of length n*(n-1)/2
+        a condensed distance vector
+    k : int
+        number of nearest neighbours, 1 <= k < n
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (nn_dist, nn_ind) of arrays of shape (n,k);
+        nn_ind[i,j] is the index of the i-th point's (j+1)-th nearest
+        neighbour (the point itself excluded) and nn_dist[i,j]
+        gives the corresponding distance. Ties are resolved
+        in favour of the points with smaller indices.
+    """
+    cdef ssize_t n = _get_condensed_n(dist.shape[0])
+    if not 1 <= k < n:
+        raise ValueError("k must be in [1, n)")
+
+    cdef ssize_t i, j
+    cdef np.ndarray[floatT,ndim=2] nn_dist = np.empty((n, k),
+        dtype=np.float32 if floatT is float else np.float64)
+    cdef np.ndarray[ssize_t,ndim=2] nn_ind = np.empty((n, k), dtype=np.intp)
+    cdef vector[floatT] row = vector[floatT](n)
+    cdef vector[ssize_t] buf = vector[ssize_t](k+1)
+    cdef c_mst.CDistanceCondensedPrecomputed[floatT] dist_condensed = \
+        c_mst.CDistanceCondensedPrecomputed[floatT](&dist[0], n)
+
+    for i in range(n):
+        dist_condensed.row(i, row.data())
+        row[i] = -libc.math.INFINITY  # the point itself will be the 0-th one
+        c_argfuns.Cargkmin(row.data(), n, k, buf.data())
+        for j in range(k):
+            nn_ind[i,j]  = buf[j+1]
+            nn_dist[i,j] = row[buf[j+1]]
+
+    return nn_dist, nn_ind
+
+
+
+
+cpdef tuple knn_from_distance(const floatT[:,::1] X, ssize_t k,
+        str metric="euclidean", metric_params=None):
+    """Determines the k nearest neighbours of all the points
+    w.r.t. any metric supported by mst_from_distance() (brute force;
+    the distances are computed on the fly, see c_knn.Cknn_from_distance()).
+
+    This is what we need to compute the core distances (M>1)
+    w.r.t. the metrics not supported by other nearest neighbour
+    search methods.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d)
+        n data points in a feature space of dimensionality d
+    k : int
+        number of nearest neighbours, 1 <= k < n
+    metric : string
+        see mst_from_distance(); `"precomputed"` is not supported,
+        see knn_from_condensed()
+    metric_params : dict or None
+        see mst_from_distance()
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (nn_dist, nn_ind) of arrays of shape (n,k),
+        see knn_from_condensed().
+    """
+    cdef ssize_t n = X.shape[0]
+    if not 1 <= k < n:
+        raise ValueError("k must be in [1, n)")
+    if metric == "precomputed":
+        raise NotImplementedError("use knn_from_condensed() instead")
+
+    cdef np.ndarray[floatT,ndim=2] nn_dist = np.empty((n, k),
+        dtype=np.float32 if floatT is float else np.float64)
+    cdef np.ndarray[ssize_t,ndim=2] nn_ind = np.empty((n, k), dtype=np.intp)
+    cdef c_mst.CDistance[floatT]* dist = _new_distance(X, metric,
+        False, False, _is_memory_mapped(X.base),
+        _get_metric_params(X, metric, metric_params))
+    try:
+        c_knn.Cknn_from_distance(dist, n, k, &nn_dist[0,0], &nn_ind[0,0])
+    finally:
+        del dist
+
+    return nn_dist, nn_ind
+
+
+
+
+cpdef np.ndarray to_bfloat16(X):
+    """Converts a real matrix to bfloat16 (the upper 16 bits of float32,
+    rounded to the nearest, ties to even), see mst_from_distance_half().
+
+    numpy does not have a bfloat16 data type, hence the bit patterns
+    are returned as an array of dtype uint16.
+
+
+    Parameters
+    ----------
+
+    X : ndarray
+        data matrix
+
+
+    Returns
+    -------
+
+    ndarray
+        A c_contiguous uint16 array of the same shape as X.
+    """
+    cdef np.ndarray bits = np.ascontiguousarray(X, dtype=np.float32).view(np.uint32)
+    bits = bits + (np.uint32(0x7FFF) + ((bits >> np.uint32(16)) & np.uint32(1)))
+    return (bits >> np.uint32(16)).astype(np.uint16)
+
+
+
+cdef c_mst.CDistance[float]* _new_distance_half(np.uint16_t[:,::1] X,
+        str metric, bint bfloat16, bint squared=False) except NULL:
+    """(internal) Creates a new CDistance object for a given metric,
+    with the data stored in half precision (float16 or bfloat16 bit patterns);
+    the caller is responsible for deleting it.
+
+    Note that X is not copied; it must outlive the returned object.
+    """
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t d = X.shape[1]
+    cdef c_mst.CFloat16* X16 = <c_mst.CFloat16*>&X[0,0]
+    cdef c_mst.CBFloat16* Xb16 = <c_mst.CBFloat16*>&X[0,0]
+
+    if metric == "euclidean" or metric == "l2":
+        if bfloat16:
+            return <c_mst.CDistance[float]*>new c_mst.CDistanceEuclidean_bf16(Xb16, n, d, squared)
+        else:
+            return <c_mst.CDistance[float]*>new c_mst.CDistanceEuclidean_f16(X16, n, d, squared)
+    elif metric == "manhattan" or metric == "cityblock" or metric == "l1":
+        if bfloat16:
+            return <c_mst.CDistance[float]*>new c_mst.CDistanceManhattan_bf16(Xb16, n, d)
+        else:
+            return <c_mst.CDistance[float]*>new c_mst.CDistanceManhattan_f16(X16, n, d)
+    elif metric == "cosine":
+        if bfloat16:
+            return <c_mst.CDistance[float]*>new c_mst.CDistanceCosine_bf16(Xb16, n, d)
+        else:
+            return <c_mst.CDistance[float]*>new c_mst.CDistanceCosine_f16(X16, n, d)
+    else:
+        raise NotImplementedError("given `metric` is not supported (yet)")
+
+
+
+cpdef tuple mst_from_distance_half(X, str metric="euclidean",
+        d_core=None, str storage="float16"):
+    """The same as mst_from_distance(), but for data stored in half precision.
+
+    Storing X in half precision halves the memory use and bandwidth
+    (which is the bottleneck of the Prim algorithm for large d)
+    as compared to float32. Distances are computed in float32.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d)
+        n data points in a feature space of dimensionality d;
+        if storage is "float16", an array of dtype float16;
+        if storage is "bfloat16", an array of dtype uint16 giving
+        the bfloat16 bit patterns, see to_bfloat16().
+        Other arrays are converted (copied) accordingly.
+    metric : string
+        one of `"euclidean"` (a.k.a. `"l2"`),
+        `"manhattan"` (synonyms: `"cityblock"`, `"l1"`), or
+        `"cosine"`.
+    d_core : ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance
+    storage : string
+        `"float16"` (IEEE 754 half precision) or `"bfloat16"`
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST,
+        see mst_from_distance(); mst_dist is of dtype float32.
+    """
+    cdef bint bfloat16
+    if storage == "float16":
+        X = np.ascontiguousarray(X, dtype=np.float16)
+        bfloat16 = False
+    elif storage == "bfloat16":
+        if X.dtype != np.uint16:
+            X = to_bfloat16(X)
+        X = np.ascontiguousarray(X)
+        bfloat16 = True
+    else:
+        raise ValueError("storage should be one of 'float16' or 'bfloat16'")
+
+    if X.ndim != 2 or X.shape[0] <= 0:
+        raise ValueError("X must be a nonempty matrix")
+
+    cdef np.uint16_t[:,::1] X_bits = X.view(np.uint16)
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t i
+    cdef float[::1] d_core32 = None
+    if d_core is not None:
+        d_core32 = np.ascontiguousarray(d_core, dtype=np.float32)
+        if d_core32.shape[0] != n:
+            raise ValueError("d_core must be of length X.shape[0]")
+
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[float]          mst_dist = np.empty(n-1, dtype=np.float32)
+
+    cdef c_mst.CDistance[float]* dist = NULL
+    cdef c_mst.CDistance[float]* dist2 = NULL
+
+    # get squared(!) Euclidean if d_core is None
+    dist = _new_distance_half(X_bits, metric, bfloat16, d_core is None)
+    try:
+        if d_core is not None:
+            dist2 = dist # must be deleted separately
+            dist  = <c_mst.CDistance[float]*>new c_mst.CDistanceMutualReachability[float](&d_core32[0], n, dist2)
+
+        c_mst.Cmst_from_complete(dist, n, &mst_dist[0], &mst_ind[0,0])
+    finally:
+        if dist2 and dist2 != dist: del dist2
+        if dist:  del dist
+
+    if d_core is None and (metric == "euclidean" or metric == "l2"):
+        for i in range(n-1):
+            mst_dist[i] = libc.math.sqrt(mst_dist[i])
+
+    return mst_dist, mst_ind
+
+
+
+def _as_csr(X):
+    """(internal) Converts X to a CSR matrix (float32 or float64)
+    with sorted indices, no duplicates, and the indices of type intp;
+    the data are only copied if necessary.
+
+    Returns a tuple (X, indices, indptr).
+    """
+    X = scipy.sparse.csr_matrix(X,
+        dtype=np.float32 if X.dtype == np.float32 else np.float64)
+    if not X.has_canonical_format:
+        X = X.copy()
+        X.sum_duplicates()
+    indices = np.ascontiguousarray(X.indices, dtype=np.intp)
+    indptr  = np.ascontiguousarray(X.indptr, dtype=np.intp)
+    return X, indices, indptr
+
+
+
+cdef c_mst.CDistance[floatT]* _new_distance_sparse(const floatT[::1] data,
+        const ssize_t[::1] indices, const ssize_t[::1] indptr,
+        ssize_t d, str metric, bint squared=False) except NULL:
+    """(internal) Creates a new CDistance object for a given metric,
+    for the rows of a CSR matrix (see _as_csr());
+    the caller is responsible for deleting it.
+
+    Note that the arrays are not copied; they must outlive
+    the returned object.
+    """
+    cdef ssize_t n = indptr.shape[0]-1
+    # data and indices might be empty
+    cdef const floatT* data_ptr = &data[0] if data.shape[0] > 0 else NULL
+    cdef const ssize_t* indices_ptr = &indices[0] if indices.shape[0] > 0 else NULL
+
+    if metric == "euclidean" or metric == "l2":
+        return <c_mst.CDistance[floatT]*>new c_mst.CDistanceSparseEuclidean[floatT](
+            data_ptr, indices_ptr, &indptr[0], n, d, squared)
+    elif metric == "manhattan" or metric == "cityblock" or metric == "l1":
+        return <c_mst.CDistance[floatT]*>new c_mst.CDistanceSparseManhattan[floatT](
+            data_ptr, indices_ptr, &indptr[0], n, d)
+    elif metric == "cosine":
+        return <c_mst.CDistance[floatT]*>new c_mst.CDistanceSparseCosine[floatT](
+            data_ptr, indices_ptr, &indptr[0], n, d)
+    else:
+        raise NotImplementedError("given `metric` is not supported (yet)")
+
+
+
+def _mst_from_distance_sparse(const floatT[::1] data,
+        const ssize_t[::1] indices, const ssize_t[::1] indptr, ssize_t d,
+        str metric, floatT[::1] d_core):
+    """(internal) See mst_from_distance_sparse()"""
+    cdef ssize_t n = indptr.shape[0]-1
+    cdef ssize_t i
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
+        dtype=np.float32 if floatT is float else np.float64)
+
+    cdef c_mst.CDistance[floatT]* dist = NULL
+    cdef c_mst.CDistance[floatT]* dist2 = NULL
+
+    # get squared(!) Euclidean if d_core is None
+    dist = _new_distance_sparse(data, indices, indptr, d, metric, d_core is None)
+    try:
+        if d_core is not None:
+            dist2 = dist # must be deleted separately
+            dist  = <c_mst.CDistance[floatT]*>new c_mst.CDistanceMutualReachability[floatT](&d_core[0], n, dist2)
+
+        c_mst.Cmst_from_complete(dist, n, &mst_dist[0], &mst_ind[0,0])
+    finally:
+        if dist2 and dist2 != dist: del dist2
+        if dist:  del dist
+
+    if d_core is None and (metric == "euclidean" or metric == "l2"):
+        for i in range(n-1):
+            mst_dist[i] = libc.math.sqrt(mst_dist[i])
+
+    return mst_dist, mst_ind
+
+
+
+cpdef tuple mst_from_distance_sparse(X, str metric="euclidean", d_core=None):
+    """The same as mst_from_distance(), but for points given by
+    the rows of a sparse matrix, e.g., TF-IDF or one-hot encoded features
+    in spaces of very high dimensionality which cannot be densified.
+
+    The distances are computed based on the nonzero elements only:
+    the row of the most recently added vertex is scattered into a dense
+    working vector, and then its dot products with the remaining rows
+    are computed in time proportional to the numbers of their nonzero
+    elements; the norms of the rows are precomputed.
+
+
+    Parameters
+    ----------
+
+    X : scipy.sparse matrix, shape (n,d)
+        n data points in a feature space of dimensionality d;
+        converted to the CSR format (float32 data are kept as they are,
+        others are converted to float64).
+    metric : string
+        one of `"euclidean"` (a.k.a. `"l2"`),
+        `"manhattan"` (synonyms: `"cityblock"`, `"l1"`), or
+        `"cosine"`.
+    d_core : ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST,
+        see mst_from_distance().
+    """
+    X, indices, indptr = _as_csr(X)
+    if X.shape[0] <= 0:
+        raise ValueError("X must be nonempty")
+
+    if d_core is not None:
+        d_core = np.ascontiguousarray(d_core, dtype=X.dtype)
+        if d_core.shape[0] != X.shape[0]:
+            raise ValueError("d_core must be of length X.shape[0]")
+
+    # dispatches on X.dtype
+    return _mst_from_distance_sparse(X.data, indices, indptr,
+        X.shape[1], metric, d_core)
+
+
+
+cpdef np.ndarray pack_bits(X):
+    """Packs binary data so that each point is represented
+    by a sequence of 64-bit words; the nonzero elements
+    of X are treated as 1s (set bits).
+
+    This way, binary data (e.g., fingerprints) take 32 times less
+    memory than float32 ones and the Hamming or Jaccard distances
+    are computed by means of popcounts, see mst_from_distance_binary().
+
+
+    Parameters
+    ----------
+
+    X : ndarray, shape (n,d)
+        n points in {0,1}^d
+
+
+    Returns
+    -------
+
+    P : ndarray, shape (n,ceil(d/64)), dtype=np.uint64
+        the packed points; the padding bits are zeros
+    """
+    X = np.array(X, copy=False, ndmin=2)
+    if X.ndim != 2:
+        raise ValueError("X must be a matrix")
+    cdef ssize_t w = (X.shape[1]+63)//64
+    B = np.packbits(X != 0, axis=1, bitorder="little")
+    P = np.zeros((X.shape[0], 8*w), dtype=np.uint8)
+    P[:, :B.shape[1]] = B
+    return P.view(np.uint64)
+
+
+
+def _get_packed_bits(X, n_bits):
+    """(internal) Returns a pair (P, d), where P gives the bit-packed
+    points (see pack_bits()) and d is the number of bits per point.
+
+    A uint64 X is assumed to be packed already.
+    """
+    if isinstance(X, np.ndarray) and X.dtype == np.uint64 and X.ndim == 2:
+        X = np.ascontiguousarray(X)
+        if n_bits is None:
+            n_bits = 64*X.shape[1]
+    else:
+        if n_bits is not None and n_bits != np.shape(X)[1]:
+            raise ValueError("n_bits must be equal to X.shape[1]")
+        n_bits = np.shape(X)[1]
+        X = pack_bits(X)
+
+    if not 0 < n_bits <= 64*X.shape[1]:
+        raise ValueError("n_bits must be in [1, 64*X.shape[1]]")
+    if X.shape[0] <= 0:
+        raise ValueError("X must be nonempty")
+    return X, n_bits
+
+
+
+cdef c_mst.CDistance[double]* _new_distance_binary(const np.uint64_t[:,::1] X,
+        ssize_t d, str metric) except NULL:
+    """(internal) Creates a new CDistance object for a given metric,
+    for bit-packed binary data (see pack_bits());
+    the caller is responsible for deleting it.
+    """
+    cdef ssize_t n = X.shape[0]
+    cdef ssize_t w = X.shape[1]
+
+    if metric == "hamming":
+        return <c_mst.CDistance[double]*>new c_mst.CDistanceHamming[double](
+            <const uint64_t*>&X[0,0], n, w, d)
+    elif metric == "jaccard":
+        return <c_mst.CDistance[double]*>new c_mst.CDistanceJaccardBits[double](
+            <const uint64_t*>&X[0,0], n, w, d)
+    else:
+        raise NotImplementedError("given `metric` is not supported (yet)")
+
+
+
+cpdef tuple mst_from_distance_binary(X, str metric="hamming",
+        d_core=None, n_bits=None):
+    """The same as mst_from_distance(), but for binary data,
+    e.g., molecular fingerprints.
+
+    The points are represented as bit-packed vectors (see pack_bits())
+    and the distances are computed by means of popcounts
+    (the numbers of bits set in the points are precomputed,
+    hence only |x AND y| needs to be determined for each pair).
+
+
+    Parameters
+    ----------
+
+    X : ndarray, shape (n,d) or (n,w)
+        n points in {0,1}^d (nonzero elements are treated as 1s)
+        or, if X.dtype is np.uint64, the result of pack_bits().
+    metric : string
+        `"hamming"` (the proportion of disagreeing bits, like in
+        scipy.spatial.distance.hamming) or `"jaccard"`
+        (|x XOR y|/|x OR y|, like in scipy.spatial.distance.jaccard).
+    d_core : ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance
+    n_bits : int or None
+        for packed X, the number of bits per point (features);
+        defaults to 64*X.shape[1]; used in the Hamming distance only
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST,
+        see mst_from_distance(); mst_dist is of type float64.
+    """
+    cdef np.uint64_t[:,::1] P
+    cdef double[::1] d_core_view
+    cdef ssize_t n
+
+    P, n_bits = _get_packed_bits(X, n_bits)
+    n = P.shape[0]
+
+    if d_core is not None:
+        d_core = np.ascontiguousarray(d_core, dtype=np.float64)
+        if d_core.shape[0] != n:
+            raise ValueError("d_core must be of length X.shape[0]")
+        d_core_view = d_core
+
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[double]         mst_dist = np.empty(n-1, dtype=np.float64)
+
+    cdef c_mst.CDistance[double]* dist = NULL
+    cdef c_mst.CDistance[double]* dist2 = NULL
+
+    dist = _new_distance_binary(P, n_bits, metric)
+    try:
+        if d_core is not None:
+            dist2 = dist # must be deleted separately
+            dist  = <c_mst.CDistance[double]*>new c_mst.CDistanceMutualReachability[double](&d_core_view[0], n, dist2)
+
+        c_mst.Cmst_from_complete(dist, n, &mst_dist[0], &mst_ind[0,0])
+    finally:
+        if dist2 and dist2 != dist: del dist2
+        if dist:  del dist
+
+    return mst_dist, mst_ind
+
+
+
+cpdef tuple knn_from_distance_binary(X, ssize_t k, str metric="hamming",
+        n_bits=None):
+    """Determines the k nearest neighbours of each point
+    w.r.t. the Hamming or Jaccard distance (brute force;
+    bit-packed data), see mst_from_distance_binary().
+
+    This is what we need to compute the core distances (M>1).
+
+
+    Parameters
+    ----------
+
+    X : ndarray, shape (n,d) or (n,w)
+        see mst_from_distance_binary()
+    k : int
+        number of nearest neighbours, 1 <= k < n
+    metric : string
+        `"hamming"` or `"jaccard"`
+    n_bits : int or None
+        see mst_from_distance_binary()
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (nn_dist, nn_ind) of ndarrays of shape (n,k)
+        (float64 and intp, respectively), where nn_ind[i,:]
+        gives the indices of the k nearest neighbours of the i-th point
+        (in the order of increasing distances, ties resolved
+        in favour of smaller indices) and nn_dist[i,:] are
+        the corresponding distances.
+    """
+    cdef np.uint64_t[:,::1] P
+    P, n_bits = _get_packed_bits(X, n_bits)
+    cdef ssize_t n = P.shape[0]
+    if not 1 <= k < n:
+        raise ValueError("k must be in [1, n-1]")
+
+    cdef np.ndarray[double,ndim=2]  nn_dist = np.empty((n, k), dtype=np.float64)
+    cdef np.ndarray[ssize_t,ndim=2] nn_ind  = np.empty((n, k), dtype=np.intp)
+
+    cdef c_mst.CDistance[double]* dist = _new_distance_binary(P, n_bits, metric)
+    try:
+        c_knn.Cknn_from_distance(dist, n, k, &nn_dist[0,0], &nn_ind[0,0])
+    finally:
+        del dist
+
+    return nn_dist, nn_ind
+
+
+
+cpdef np.ndarray minhash(X, ssize_t n_hashes=128, uint64_t seed=0):
+    """Computes the MinHash signatures of sets of tokens
+    (e.g., word or character shingles of documents),
+    see c_minhash.Cminhash().
+
+    The proportion of disagreeing elements of two signatures
+    is an unbiased estimate of the Jaccard distance between the sets,
+    see mst_from_minhash() and knn_from_minhash().
 
-    References
+
+    Parameters
     ----------
 
-    [1] M. Gagolewski, M. Bartoszuk, A. Cena,
-    Genie: A new, fast, and outlier-resistant hierarchical clustering algorithm,
-    Information Sciences 363 (2016) 8–23.
+    X : scipy.sparse matrix, shape (n,d), or a sequence of length n
+        either a sparse matrix whose i-th set consists of
+        the column indices of the nonzero elements in the i-th row,
+        or a sequence of iterables (e.g., lists or sets) of tokens;
+        integer tokens are hashed directly, other ones (e.g., strings)
+        are mapped to integers first (via numpy.unique; the signatures
+        generated by separate calls are not comparable then)
+    n_hashes : int
+        signature length; the standard error of the estimated
+        distances is at most 0.5/sqrt(n_hashes)
+    seed : int
+        seed for the hash functions
 
-    [2] V. Jarník, O jistém problému minimálním,
-    Práce Moravské Přírodovědecké Společnosti 6 (1930) 57–63.
 
-    [3] C.F. Olson, Parallel algorithms for hierarchical clustering,
-    Parallel Comput. 21 (1995) 1313–1325.
+    Returns
+    -------
+
+    S : ndarray, shape (n,n_hashes)
+        uint32 signatures
+    """
+    cdef np.ndarray[ssize_t] tokens
+    cdef np.ndarray[ssize_t] indptr
+    if n_hashes <= 0:
+        raise ValueError("n_hashes must be positive")
+
+    if scipy.sparse.issparse(X):
+        X = scipy.sparse.csr_matrix(X, copy=True)
+        X.eliminate_zeros()
+        tokens = X.indices.astype(np.intp)
+        indptr = X.indptr.astype(np.intp)
+    else:
+        X = [list(x) for x in X]
+        indptr = np.r_[0, np.cumsum([len(x) for x in X])].astype(np.intp)
+        flat = np.asarray([t for x in X for t in x])
+        if flat.shape[0] == 0 or flat.dtype.kind in "iub":
+            tokens = flat.astype(np.intp)
+        else:
+            tokens = np.unique(flat, return_inverse=True)[1].astype(np.intp)
+
+    cdef ssize_t n = indptr.shape[0]-1
+    cdef np.ndarray[uint32_t,ndim=2] S = np.empty((n, n_hashes), dtype=np.uint32)
+    if n == 0:
+        return S
+    if tokens.shape[0] == 0:
+        tokens = np.zeros(1, dtype=np.intp)  # unused
+
+    cdef ssize_t* tokens_ptr = &tokens[0]
+    cdef ssize_t* indptr_ptr = &indptr[0]
+    cdef uint32_t* S_ptr = &S[0,0]
+    with nogil:
+        c_minhash.Cminhash(tokens_ptr, indptr_ptr, n, n_hashes, seed, S_ptr)
+    return S
+
+
+
+def _get_minhash_signatures(S):
+    """(internal) Checks if S is a matrix of MinHash signatures"""
+    S = np.ascontiguousarray(S)
+    if S.ndim != 2 or S.dtype != np.uint32:
+        raise ValueError("S must be a uint32 matrix, see minhash()")
+    if S.shape[0] <= 0 or S.shape[1] <= 0:
+        raise ValueError("S must be nonempty")
+    return S
+
 
-    [4] R. Prim, Shortest connection networks and some generalizations,
-    Bell Syst. Tech. J. 36 (1957) 1389–1401.
+
+cpdef tuple knn_from_minhash(S, ssize_t k, n_bands=None,
+        ssize_t max_bucket_size=256):
+    """Determines the approximate k nearest neighbours of each set
+    w.r.t. the estimated Jaccard distance by means of locality-sensitive
+    hashing (LSH) of the MinHash signatures, see minhash()
+    and c_minhash.Cminhash_lsh_knn().
+
+    Two sets are considered as candidate neighbours if their signatures
+    agree on all the elements in at least one of the n_bands bands.
+    Only the candidates' distances are computed, which takes
+    subquadratic time for data with a reasonable cluster structure.
 
 
     Parameters
     ----------
 
-    X : c_contiguous ndarray, shape (n,d)
-        n data points in a feature space of dimensionality d.
-    metric : string
-        one of `"euclidean"` (a.k.a. `"l2"`),
-        `"manhattan"` (synonyms: `"cityblock"`, `"l1"`), or
-        `"cosine"`.
-        More metrics/distances might be supported in future versions.
-    d_core : c_contiguous ndarray of length n; optional (default=None)
-        core distances for computing the mutual reachability distance
+    S : ndarray, shape (n,h)
+        signatures, see minhash()
+    k : int
+        number of nearest neighbours, 1 <= k < n
+    n_bands : int or None
+        number of bands, 1 <= n_bands <= h; defaults to max(1, h//4);
+        more bands of fewer elements each increase the chance of finding
+        the neighbours at the cost of evaluating more candidates
+    max_bucket_size : int
+        points in larger LSH buckets are only compared to
+        max_bucket_size/2 preceding and following ones
 
 
     Returns
     -------
 
     pair : tuple
-        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST:
-          a) the (n-1)-ary array mst_dist is such that
-          mst_dist[i] gives the weight of the i-th edge;
-          b) mst_ind is a matrix with n-1 rows and 2 columns,
-          where {mst[i,0], mst[i,1]} defines the i-th edge of the tree.
+        A pair (nn_dist, nn_ind) of ndarrays of shape (n,k),
+        see knn_from_distance_binary(). If fewer than k neighbours
+        of the i-th set were found, the i-th rows are padded
+        with inf and i, respectively.
+    """
+    S = _get_minhash_signatures(S)
+    cdef uint32_t[:,::1] S_view = S
+    cdef ssize_t n = S.shape[0], h = S.shape[1]
+    cdef ssize_t b = max(1, h//4) if n_bands is None else n_bands
+    if not 1 <= k < n:
+        raise ValueError("k must be in [1, n-1]")
+    if not 1 <= b <= h:
+        raise ValueError("n_bands must be in [1, S.shape[1]]")
 
-        The results are ordered w.r.t. nondecreasing weights.
-        (and then the 1st, and the the 2nd index).
-        For each i, it holds mst[i,0]<mst[i,1].
+    cdef np.ndarray[double,ndim=2]  nn_dist = np.empty((n, k), dtype=np.float64)
+    cdef np.ndarray[ssize_t,ndim=2] nn_ind  = np.empty((n, k), dtype=np.intp)
+    cdef double* nn_dist_ptr = &nn_dist[0,0]
+    cdef ssize_t* nn_ind_ptr = &nn_ind[0,0]
+    with nogil:
+        c_minhash.Cminhash_lsh_knn(&S_view[0,0], n, h, b, k, max_bucket_size,
+            nn_dist_ptr, nn_ind_ptr)
+
+    return nn_dist, nn_ind
+
+
+
+cpdef tuple mst_from_minhash(S, d_core=None, bint exact=False, k=None,
+        n_bands=None, ssize_t max_bucket_size=256):
+    """Determines a minimum spanning tree of sets w.r.t. the estimated
+    Jaccard distance (or the mutual reachability distance based thereon)
+    between their MinHash signatures, see minhash().
+
+    If exact is True, all the pairwise distances between the signatures
+    are computed on the fly (see mst_from_distance()).
+
+    Otherwise, an MST of the approximate k-nearest neighbour graph
+    (see knn_from_minhash()) is determined, see mst_from_nn();
+    no n*n matrix is needed, which makes this approach suitable
+    for millions of sets. If d_core is given, the weights of the graph's
+    edges are replaced with the mutual reachability distances.
+
+
+    Parameters
+    ----------
+
+    S : ndarray, shape (n,h)
+        signatures, see minhash()
+    d_core : ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance,
+        e.g., knn_from_minhash(S, M-1)[0][:,-1]
+    exact : bool
+        whether the MST of the complete graph should be determined
+    k : int or None
+        number of nearest neighbours in the approximate method;
+        defaults to min(32, ceil(sqrt(n)))
+    n_bands : int or None
+        see knn_from_minhash()
+    max_bucket_size : int
+        see knn_from_minhash()
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST,
+        see mst_from_distance(); mst_dist is of type float64.
+        In the approximate method, the k-nearest neighbour graph
+        might be disconnected: then the last c-1 edges (where c is
+        the number of connected components) have infinite weights
+        and indices equal to -1, see mst_from_nn().
     """
-    cdef ssize_t n = X.shape[0]
-    cdef ssize_t d = X.shape[1]
-    cdef ssize_t i
+    S = _get_minhash_signatures(S)
+    cdef uint32_t[:,::1] S_view = S
+    cdef ssize_t n = S.shape[0], h = S.shape[1]
+    cdef double[::1] d_core_view
+    cdef double[:,::1] nn_dist_view
+    cdef ssize_t[:,::1] nn_ind_view
+
+    if d_core is not None:
+        d_core = np.ascontiguousarray(d_core, dtype=np.float64)
+        if d_core.shape[0] != n:
+            raise ValueError("d_core must be of length S.shape[0]")
+        d_core_view = d_core
+
+    if not exact:
+        if k is None:
+            k = min(n-1, min(32, int(np.ceil(np.sqrt(n)))))
+        nn_dist, nn_ind = knn_from_minhash(S, k, n_bands, max_bucket_size)
+        if d_core is not None:
+            nn_dist = np.maximum(nn_dist,
+                np.maximum(d_core.reshape(-1, 1), d_core[nn_ind]))
+            o = np.argsort(nn_dist, axis=1, kind="stable")
+            nn_dist = np.take_along_axis(nn_dist, o, axis=1)
+            nn_ind  = np.take_along_axis(nn_ind, o, axis=1)
+        nn_dist_view = np.ascontiguousarray(nn_dist)
+        nn_ind_view  = np.ascontiguousarray(nn_ind)
+        return mst_from_nn(nn_dist_view, nn_ind_view, stop_disconnected=False)
+
     cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
-    cdef np.ndarray[floatT]         mst_dist = np.empty(n-1,
-        dtype=np.float32 if floatT is float else np.float64)
-    cdef c_mst.CDistance[floatT]* dist = NULL
-    cdef c_mst.CDistance[floatT]* dist2 = NULL
-    cdef dict metric_params_dict
+    cdef np.ndarray[double]         mst_dist = np.empty(n-1, dtype=np.float64)
 
-    if metric == "euclidean" or metric == "l2":
-        # get squared(!) Euclidean if d_core is None
-        dist = <c_mst.CDistance[floatT]*>new c_mst.CDistanceEuclidean[floatT](&X[0,0], n, d, d_core is None)
-    elif metric == "manhattan" or metric == "cityblock" or metric == "l1":
-        dist = <c_mst.CDistance[floatT]*>new c_mst.CDistanceManhattan[floatT](&X[0,0], n, d)
-    elif metric == "cosine":
-        dist = <c_mst.CDistance[floatT]*>new c_mst.CDistanceCosine[floatT](&X[0,0], n, d)
-    elif metric == "precomputed":
-        dist = <c_mst.CDistance[floatT]*>new c_mst.CDistanceCompletePrecomputed[floatT](&X[0,0], n)
+    cdef c_mst.CDistance[double]* dist = NULL
+    cdef c_mst.CDistance[double]* dist2 = NULL
+
+    dist = <c_mst.CDistance[double]*>new c_mst.CDistanceMinHash[double](
+        &S_view[0,0], n, h)
+    try:
+        if d_core is not None:
+            dist2 = dist # must be deleted separately
+            dist  = <c_mst.CDistance[double]*>new c_mst.CDistanceMutualReachability[double](&d_core_view[0], n, dist2)
+
+        c_mst.Cmst_from_complete(dist, n, &mst_dist[0], &mst_ind[0,0])
+    finally:
+        if dist2 and dist2 != dist: del dist2
+        if dist:  del dist
+
+    return mst_dist, mst_ind
+
+
+
+cdef size_t _get_callback_address(callback) except 0:
+    """(internal) Returns the address of a native distance callback,
+    see mst_from_callback()
+    """
+    cdef size_t addr
+    if hasattr(callback, "address"):  # numba.cfunc
+        addr = callback.address
+    elif isinstance(callback, ctypes._CFuncPtr):
+        addr = ctypes.cast(callback, ctypes.c_void_p).value or 0
+    elif isinstance(callback, int):
+        addr = callback
     else:
-        raise NotImplementedError("given `metric` is not supported (yet)")
+        raise ValueError("callback must be a numba cfunc, "
+            "a ctypes function pointer, or an address")
+    if addr == 0:
+        raise ValueError("callback must not be NULL")
+    return addr
 
-    if d_core is not None:
-        dist2 = dist # must be deleted separately
-        dist  = <c_mst.CDistance[floatT]*>new c_mst.CDistanceMutualReachability[floatT](&d_core[0], n, dist2)
 
-    c_mst.Cmst_from_complete(dist, n, &mst_dist[0], &mst_ind[0,0])
 
-    if d_core is None and (metric == "euclidean" or metric == "l2"):
-        for i in range(n-1):
-            mst_dist[i] = libc.math.sqrt(mst_dist[i])
+cpdef tuple mst_from_callback(callback, ssize_t n, d_core=None,
+        ssize_t chunk_size=256, ssize_t n_pivots=0, dict stats=None,
+        bint assume_metric=False):
+    """The same as mst_from_distance(), but with the distances computed by
+    a user-supplied native function, so that custom metrics can be used
+    with O(n) memory and no Python overhead.
+
+    The callback must have the C signature
+
+        void fn(ssize_t i, const ssize_t* M, ssize_t k, double* out)
+
+    and set out[j] to the distance between the i-th and the M[j]-th
+    point, j=0,...,k-1; e.g., a numba.cfunc with signature
+    `void(intp, CPointer(intp), intp, CPointer(float64))`
+    accessing the data via a closure.
+
+    The callback is invoked with the GIL released,
+    from many threads at a time (see c_distance.CDistanceCallback).
+    Python functions wrapped with ctypes.CFUNCTYPE
+    are supported too, but they are slow.
 
-    if dist:  del dist
-    if dist2: del dist2
+
+    Parameters
+    ----------
+
+    callback : numba cfunc, ctypes function pointer, or int
+        the distance function or its address
+    n : int
+        number of points
+    d_core : ndarray of length n; optional (default=None)
+        core distances for computing the mutual reachability distance
+    chunk_size : int
+        maximal k in a single call to the callback
+    n_pivots : int
+        number of pivots for pruning the distance evaluations,
+        see mst_from_distance(); only the distances
+        that the bounds do not exclude are requested
+    stats : dict or None
+        see mst_from_distance()
+    assume_metric : bool
+        whether the callback is known to define a metric
+        (fulfil the triangle inequality); required if n_pivots > 0
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (mst_dist, mst_ind) defining the n-1 edges of the MST,
+        see mst_from_distance(); mst_dist is of type float64.
+    """
+    cdef size_t addr = _get_callback_address(callback)
+    cdef ssize_t n_computed = 0
+    cdef double[::1] d_core_view
+    if n <= 0:
+        raise ValueError("n must be positive")
+
+    if n_pivots > 0 and not assume_metric:
+        raise ValueError("n_pivots > 0 requires assume_metric=True")
+
+    if d_core is not None:
+        d_core = np.ascontiguousarray(d_core, dtype=np.float64)
+        if d_core.shape[0] != n:
+            raise ValueError("d_core must be of length n")
+        d_core_view = d_core
+
+    cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+    cdef np.ndarray[double]         mst_dist = np.empty(n-1, dtype=np.float64)
+    cdef ssize_t* mst_ind_ptr = &mst_ind[0,0] if n > 1 else NULL
+    cdef double* mst_dist_ptr = &mst_dist[0] if n > 1 else NULL
+
+    cdef c_mst.CDistance[double]* dist = NULL
+    cdef c_mst.CDistance[double]* dist2 = NULL
+
+    dist = <c_mst.CDistance[double]*>new c_mst.CDistanceCallback[double](
+        <const void*>addr, n, chunk_size)
+    try:
+        if d_core is not None:
+            dist2 = dist # must be deleted separately
+            dist  = <c_mst.CDistance[double]*>new c_mst.CDistanceMutualReachability[double](&d_core_view[0], n, dist2)
+
+        with nogil:
+            c_mst.Cmst_from_complete(dist, n, mst_dist_ptr, mst_ind_ptr,
+                n_pivots, &n_computed)
+    finally:
+        if dist2 and dist2 != dist: del dist2
+        if dist:  del dist
+
+    if stats is not None:
+        _set_mst_stats(stats, n, n_computed)
 
     return mst_dist, mst_ind
 
 
 
+cpdef tuple knn_from_callback(callback, ssize_t n, ssize_t k,
+        ssize_t chunk_size=256):
+    """Determines the k nearest neighbours of each point
+    w.r.t. the distance given by a native callback (brute force),
+    see mst_from_callback().
+
+    This is what we need to compute the core distances (M>1).
+
+
+    Parameters
+    ----------
+
+    callback : numba cfunc, ctypes function pointer, or int
+        see mst_from_callback()
+    n : int
+        number of points
+    k : int
+        number of nearest neighbours, 1 <= k < n
+    chunk_size : int
+        see mst_from_callback()
+
+
+    Returns
+    -------
+
+    pair : tuple
+        A pair (nn_dist, nn_ind) of ndarrays of shape (n,k),
+        see knn_from_distance_binary().
+    """
+    cdef size_t addr = _get_callback_address(callback)
+    if not 1 <= k < n:
+        raise ValueError("k must be in [1, n-1]")
+
+    cdef np.ndarray[double,ndim=2]  nn_dist = np.empty((n, k), dtype=np.float64)
+    cdef np.ndarray[ssize_t,ndim=2] nn_ind  = np.empty((n, k), dtype=np.intp)
+    cdef double* nn_dist_ptr = &nn_dist[0,0]
+    cdef ssize_t* nn_ind_ptr = &nn_ind[0,0]
+
+    cdef c_mst.CDistance[double]* dist = <c_mst.CDistance[double]*>new c_mst.CDistanceCallback[double](
+        <const void*>addr, n, chunk_size)
+    try:
+        with nogil:
+            c_knn.Cknn_from_distance(dist, n, k, nn_dist_ptr, nn_ind_ptr)
+    finally:
+        del dist
+
+    return nn_dist, nn_ind
+
 
 
 cpdef tuple mst_from_nn(floatT[:,::1] dist, ssize_t[:,::1] ind,
@@ -324,6 +2204,626 @@ cpdef tuple mst_from_nn(floatT[:,::1] dist, ssize_t[:,::1] ind,
 
 
 
+################################################################################
+# Nearest neighbour search
+################################################################################
+
+
+
+
+cdef class NNIndex:
+    """A nearest neighbour search index
+
+    Finds the nearest neighbours of new (query) points amongst
+    the indexed ones. For the Euclidean metric in low-dimensional spaces,
+    a K-d tree is used. Otherwise, distances to all the indexed points
+    are computed (in parallel) by brute force; the auxiliary data
+    on the indexed points (e.g., their norms or 8-bit codes, see `quantize`)
+    are computed once, when the index is built, and the query points
+    are compared against them directly (see c_distance.CDistance::set_queries()).
+    Hence, query() must not be called concurrently on the same index.
+
+    If the core distances d_core are given, then for each query point y
+    we look for the indexed point x that minimises
+    max(d(x, y), d_core(x)), i.e., the mutual reachability distance
+    between x and y, see genieclust.internal.mst_from_distance().
+    Note that d_core(y) is constant, therefore it does not affect
+    the choice of the nearest neighbour.
+
+    The indexed points are copied, unless `copy` is False or
+    `ind` is given and X is memory-mapped or of dtype float16:
+    then X is not copied (nor cast) at all and the points are read
+    from it block by block during each search (by brute force;
+    the distances are computed in float32 for float16 data).
+    Such an X must not be modified afterwards.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray or scipy.sparse matrix, shape (n,d)
+        n points in a feature space of dimensionality d;
+        float32 or float64. Sparse matrices are always searched
+        by brute force, see mst_from_distance_sparse().
+    metric : string
+        one of `"euclidean"` (a.k.a. `"l2"`),
+        `"manhattan"` (synonyms: `"cityblock"`, `"l1"`),
+        `"cosine"`, `"chebyshev"`, `"minkowski"`, `"mahalanobis"`,
+        `"seuclidean"`, `"haversine"`, `"hamming"`, or `"jaccard"`;
+        for the last two, X is packed (see pack_bits())
+        and the distances are computed in double precision.
+        For `"haversine"`, X gives the latitudes and longitudes
+        (in radians) and a K-d tree over the corresponding 3D unit vectors
+        is used, see mst_from_distance().
+    d_core : ndarray of length n or None
+        core distances of the indexed points
+    quantize : bool
+        whether the brute force search for the Euclidean metric
+        should use the lower bounds for the distances based on
+        8-bit copies of the points, see mst_from_distance();
+        this does not change the results
+    metric_params : dict or None
+        additional parameters of the metric, see mst_from_distance();
+        the defaults are determined based on the indexed points
+    ind : ndarray of ints or None
+        if not None, only the points X[ind,:] are indexed;
+        the indices returned by query() refer to ind then
+        (d_core must be of length len(ind))
+    copy : bool
+        whether the points need to be copied; use False
+        if X is a temporary array (ignored if `ind` is given)
+    """
+    cdef c_knn.CKDTree[float]*  tree32
+    cdef c_knn.CKDTree[double]* tree64
+    cdef c_mst.CDistance[float]*  dist32
+    cdef c_mst.CDistance[double]* dist64
+    cdef object X
+    cdef object indices  # of a CSR matrix X, see _as_csr()
+    cdef object indptr
+    cdef object ind
+    cdef object d_core
+    cdef str metric
+    cdef bint quantize
+    cdef ssize_t n_bits
+    cdef dict metric_params
+
+
+    def __cinit__(self, X, str metric="euclidean", d_core=None,
+            bint quantize=False, metric_params=None, ind=None,
+            bint copy=True):
+        cdef float[:,::1]  X32
+        cdef double[:,::1] X64
+        cdef float[::1]    d_core32
+        cdef double[::1]   d_core64
+
+        self.tree32 = NULL
+        self.tree64 = NULL
+        self.dist32 = NULL
+        self.dist64 = NULL
+        self.ind = None
+        self.metric = metric.lower()
+        self.quantize = quantize
+
+        if ind is not None:
+            ind = np.array(ind, dtype=np.intp, order="C", ndmin=1)
+            if self.metric not in ("hamming", "jaccard") and \
+                    not scipy.sparse.issparse(X) and \
+                    (_is_memory_mapped(X) or X.dtype == np.float16):
+                self._init_blockwise(X, ind, d_core, metric_params)
+                return
+            X = X[ind,:]  # a copy
+            copy = False
+
+        if self.metric in ("hamming", "jaccard"):
+            X, self.n_bits = _get_packed_bits(X, None)
+            if d_core is not None:
+                d_core = np.array(d_core, dtype=np.float64, order="C")
+                if d_core.shape[0] != X.shape[0]:
+                    raise ValueError("d_core must be of length X.shape[0]")
+            self.X = X
+            self.d_core = d_core
+            self.dist64 = _new_distance_binary(X, self.n_bits, self.metric)
+            return
+
+        if scipy.sparse.issparse(X):
+            if self.metric not in ("euclidean", "l2", "manhattan",
+                                   "cityblock", "l1", "cosine"):
+                raise NotImplementedError("given `metric` is not supported (yet)")
+            X = _as_csr(X)[0]
+            if copy: X = X.copy()
+            X, self.indices, self.indptr = _as_csr(X)
+            if X.shape[0] <= 0:
+                raise ValueError("X must be nonempty")
+            if d_core is not None:
+                d_core = np.array(d_core, dtype=X.dtype, order="C")
+                if d_core.shape[0] != X.shape[0]:
+                    raise ValueError("d_core must be of length X.shape[0]")
+            self.X = X
+            self.d_core = d_core
+            if X.dtype == np.float32:
+                self.dist32 = _new_distance_sparse[float](X.data,
+                    self.indices, self.indptr, X.shape[1], self.metric)
+            else:
+                self.dist64 = _new_distance_sparse[double](X.data,
+                    self.indices, self.indptr, X.shape[1], self.metric)
+            return
+
+        X = np.array(X, order="C", copy=False, ndmin=2)
+        if X.dtype != np.float32:
+            X = X.astype(np.float64, order="C", copy=False)
+        if X.shape[0] <= 0:
+            raise ValueError("X must be nonempty")
+        if d_core is not None:
+            d_core = np.array(d_core, dtype=X.dtype, order="C")
+            if d_core.shape[0] != X.shape[0]:
+                raise ValueError("d_core must be of length X.shape[0]")
+
+        if self.metric == "haversine":
+            # Euclidean (chord) distances between the unit vectors
+            # are converted to the arc lengths in query()
+            X = _latlon_to_unit(X)
+            if d_core is not None:
+                d_core = _arc_to_chord(d_core)
+
+        if self.metric in ("euclidean", "l2", "haversine") and X.shape[1] <= 16:
+            # K-d trees are efficient in low-dimensional spaces only
+            if X.dtype == np.float32:
+                X32 = X
+                d_core32 = d_core
+                self.tree32 = new c_knn.CKDTree[float](&X32[0,0],
+                    X.shape[0], X.shape[1],
+                    <float*>NULL if d_core is None else &d_core32[0], 32)
+            else:
+                X64 = X
+                d_core64 = d_core
+                self.tree64 = new c_knn.CKDTree[double](&X64[0,0],
+                    X.shape[0], X.shape[1],
+                    <double*>NULL if d_core is None else &d_core64[0], 32)
+        else:
+            # brute force
+            if self.metric not in ("euclidean", "l2", "manhattan",
+                                   "cityblock", "l1", "cosine", "chebyshev",
+                                   "minkowski", "mahalanobis", "seuclidean"):
+                raise NotImplementedError("given `metric` is not supported (yet)")
+            self.X = X.copy() if copy else X
+            self.d_core = d_core
+            self.metric_params = _get_metric_params(X, self.metric,
+                metric_params)
+            if X.dtype == np.float32:
+                X32 = self.X
+                self.dist32 = _new_distance[float](X32, self.metric, False,
+                    quantize, False, self.metric_params)
+            else:
+                X64 = self.X
+                self.dist64 = _new_distance[double](X64, self.metric, False,
+                    quantize, False, self.metric_params)
+
+
+    cdef _init_blockwise(self, X, ind, d_core, metric_params):
+        """(internal) __cinit__() for X that is not to be copied"""
+        if X.ndim != 2 or ind.shape[0] <= 0:
+            raise ValueError("X[ind,:] must be a nonempty matrix")
+        if ind.min() < 0 or ind.max() >= X.shape[0]:
+            raise ValueError("ind not in [0, X.shape[0])")
+        if self.metric not in ("euclidean", "l2", "manhattan",
+                               "cityblock", "l1", "cosine", "chebyshev",
+                               "minkowski", "mahalanobis", "seuclidean",
+                               "haversine"):
+            raise NotImplementedError("given `metric` is not supported (yet)")
+        dtype = np.float64 if X.dtype == np.float64 else np.float32
+        if d_core is not None:
+            d_core = np.array(d_core, dtype=dtype, order="C")
+            if d_core.shape[0] != ind.shape[0]:
+                raise ValueError("d_core must be of length len(ind)")
+            if self.metric == "haversine":
+                d_core = _arc_to_chord(d_core)
+        self.X = X
+        self.ind = ind
+        self.d_core = d_core
+        if self.metric in ("minkowski", "mahalanobis", "seuclidean"):
+            key = {"mahalanobis": "VI", "seuclidean": "V"}.get(self.metric)
+            if key is not None and (metric_params is None or
+                    metric_params.get(key) is None):
+                Xp = np.asarray(X[ind,:], dtype=dtype)  # to estimate the defaults
+            else:
+                Xp = np.empty((0, X.shape[1]), dtype=dtype)
+            self.metric_params = _get_metric_params(Xp, self.metric,
+                metric_params)
+
+
+    def __dealloc__(self):
+        if self.tree32: del self.tree32
+        if self.tree64: del self.tree64
+        if self.dist32: del self.dist32
+        if self.dist64: del self.dist64
+
+
+    cpdef tuple query(self, Y):
+        """Finds the nearest neighbours of given points
+
+
+        Parameters
+        ----------
+
+        Y : ndarray or scipy.sparse matrix, shape (m,d)
+            m query points
+
+
+        Returns
+        -------
+
+        pair : tuple
+            A pair (nn_dist, nn_ind) of vectors of length m,
+            where nn_ind[i] gives the index of the indexed point
+            nearest to Y[i,:] and nn_dist[i] is the corresponding distance
+            (or max(d(x, y), d_core(x)) if the core distances are given).
+        """
+        cdef float[:,::1]  Y32
+        cdef double[:,::1] Y64
+        cdef float[:,::1]  nn_dist32
+        cdef double[:,::1] nn_dist64
+        cdef ssize_t[:,::1] nn_ind_view
+        cdef ssize_t n, d, m
+
+        if self.metric in ("hamming", "jaccard"):
+            return self._query_binary(Y)
+        elif self.ind is not None:
+            return self._query_blockwise(Y)
+
+        if self.tree32:
+            n, d = self.tree32.get_n(), self.tree32.get_d()
+            Y = np.array(Y, dtype=np.float32, order="C", ndmin=2)
+        elif self.tree64:
+            n, d = self.tree64.get_n(), self.tree64.get_d()
+            Y = np.array(Y, dtype=np.float64, order="C", ndmin=2)
+        elif scipy.sparse.issparse(self.X):
+            n, d = self.X.shape[0], self.X.shape[1]
+            Y, Y_indices, Y_indptr = _as_csr(
+                scipy.sparse.csr_matrix(Y, dtype=self.X.dtype))
+        else:
+            n, d = self.X.shape[0], self.X.shape[1]
+            Y = np.array(Y, dtype=self.X.dtype, order="C", ndmin=2)
+
+        if self.metric == "haversine":
+            if Y.shape[1] != 2:
+                raise ValueError("Y must have 2 columns (latitudes, longitudes)")
+            Y = _latlon_to_unit(Y)
+
+        if Y.shape[1] != d:
+            raise ValueError("Y.shape[1] does not match the dimensionality of the indexed points")
+        m = Y.shape[0]
+
+        nn_dist = np.empty((m, 1), dtype=Y.dtype)
+        nn_ind  = np.empty((m, 1), dtype=np.intp)
+        if m == 0:
+            return nn_dist[:,0], nn_ind[:,0]
+
+        nn_ind_view = nn_ind
+        if self.tree32:
+            Y32 = Y
+            nn_dist32 = nn_dist
+            self.tree32.kneighbours(&Y32[0,0], m, 1,
+                &nn_dist32[0,0], &nn_ind_view[0,0], False)
+            nn_dist = np.sqrt(nn_dist)
+        elif self.tree64:
+            Y64 = Y
+            nn_dist64 = nn_dist
+            self.tree64.kneighbours(&Y64[0,0], m, 1,
+                &nn_dist64[0,0], &nn_ind_view[0,0], False)
+            nn_dist = np.sqrt(nn_dist)
+        elif scipy.sparse.issparse(self.X):
+            if self.dist32:
+                _nn_query_sparse[float](self.dist32, n, Y.data, Y_indices,
+                    Y_indptr, self.d_core, nn_dist[:,0], nn_ind[:,0])
+            else:
+                _nn_query_sparse[double](self.dist64, n, Y.data, Y_indices,
+                    Y_indptr, self.d_core, nn_dist[:,0], nn_ind[:,0])
+        elif self.dist32:
+            _nn_query[float](self.dist32, n, Y, self.d_core,
+                nn_dist[:,0], nn_ind[:,0])
+        else:
+            _nn_query[double](self.dist64, n, Y, self.d_core,
+                nn_dist[:,0], nn_ind[:,0])
+
+        if self.metric == "haversine":
+            nn_dist = _chord_to_arc(nn_dist)
+
+        return nn_dist[:,0], nn_ind[:,0]
+
+
+    cdef tuple _query_blockwise(self, Y):
+        """(internal) query() for X that has not been copied"""
+        cdef ssize_t n = self.ind.shape[0], d = self.X.shape[1]
+        cdef ssize_t block_size = 65536, start
+        cdef str metric = "euclidean" if self.metric == "haversine" else self.metric
+        dtype = np.float64 if self.X.dtype == np.float64 else np.float32
+
+        Y = np.array(Y, dtype=dtype, order="C", ndmin=2)
+        if Y.shape[1] != d:
+            raise ValueError("Y.shape[1] does not match the dimensionality of the indexed points")
+        if self.metric == "haversine":
+            Y = _latlon_to_unit(Y)
+        cdef ssize_t m = Y.shape[0]
+
+        nn_dist = np.full(m, np.inf, dtype=dtype)
+        nn_ind  = np.zeros(m, dtype=np.intp)
+        if m == 0:
+            return nn_dist, nn_ind
+
+        block_dist = np.empty(m, dtype=dtype)
+        block_ind  = np.empty(m, dtype=np.intp)
+        for start in range(0, n, block_size):
+            # only a block of the points is converted at a time
+            Xb = np.asarray(self.X[self.ind[start:start+block_size],:],
+                dtype=dtype)
+            if self.metric == "haversine":
+                Xb = _latlon_to_unit(Xb)
+            _nn_from_distance(Xb, Y, metric,
+                None if self.d_core is None else
+                    self.d_core[start:start+block_size],
+                block_dist, block_ind, self.quantize, self.metric_params)
+            better = (block_dist < nn_dist)  # ties: the first block wins
+            nn_dist[better] = block_dist[better]
+            nn_ind[better]  = block_ind[better]+start
+
+        if self.metric == "haversine":
+            nn_dist = _chord_to_arc(nn_dist)
+
+        return nn_dist, nn_ind
+
+
+    cdef tuple _query_binary(self, Y):
+        """(internal) query() for the Hamming and Jaccard distances"""
+        cdef double[::1] d_core_view
+        cdef np.uint64_t[:,::1] Y_view
+        cdef ssize_t n = self.X.shape[0]
+
+        Y = np.array(Y, copy=False, ndmin=2)
+        if Y.shape[1] != self.n_bits:
+            raise ValueError("Y.shape[1] does not match the dimensionality of the indexed points")
+        cdef ssize_t m = Y.shape[0]
+
+        cdef np.ndarray[double]  nn_dist = np.empty(m, dtype=np.float64)
+        cdef np.ndarray[ssize_t] nn_ind  = np.empty(m, dtype=np.intp)
+        if m == 0:
+            return nn_dist, nn_ind
+
+        if self.d_core is not None:
+            d_core_view = self.d_core
+        Y_view = pack_bits(Y)
+        self.dist64.set_queries_bits(<const uint64_t*>&Y_view[0,0], m)
+        try:
+            c_knn.Cnn_from_distance(self.dist64, n, m,
+                <double*>NULL if self.d_core is None else &d_core_view[0],
+                &nn_dist[0], &nn_ind[0])
+        finally:
+            self.dist64.set_queries_bits(NULL, 0)
+
+        return nn_dist, nn_ind
+
+
+
+
+cdef void _nn_query(c_mst.CDistance[floatT]* dist, ssize_t n,
+        const floatT[:,::1] Y, floatT[::1] d_core,
+        floatT[::1] nn_dist, ssize_t[::1] nn_ind) except *:
+    """(internal) Finds the nearest neighbours of the points in Y
+    amongst the n points indexed by dist, see c_knn.Cnn_from_distance()
+    and NNIndex.query(); Y is nonempty
+    """
+    cdef ssize_t m = Y.shape[0]
+    dist.set_queries(&Y[0,0], m)
+    try:
+        c_knn.Cnn_from_distance(dist, n, m,
+            <floatT*>NULL if d_core is None else &d_core[0],
+            &nn_dist[0], &nn_ind[0])
+    finally:
+        dist.set_queries(NULL, 0)
+
+
+
+cdef void _nn_query_sparse(c_mst.CDistance[floatT]* dist, ssize_t n,
+        const floatT[::1] data, const ssize_t[::1] indices,
+        const ssize_t[::1] indptr, floatT[::1] d_core,
+        floatT[::1] nn_dist, ssize_t[::1] nn_ind) except *:
+    """(internal) Like _nn_query(), but the query points are the rows
+    of a CSR matrix (see _as_csr())
+    """
+    cdef ssize_t m = indptr.shape[0]-1
+    # data and indices might be empty
+    cdef const floatT* data_ptr = &data[0] if data.shape[0] > 0 else NULL
+    cdef const ssize_t* indices_ptr = &indices[0] if indices.shape[0] > 0 else NULL
+    dist.set_queries_csr(data_ptr, indices_ptr, &indptr[0], m)
+    try:
+        c_knn.Cnn_from_distance(dist, n, m,
+            <floatT*>NULL if d_core is None else &d_core[0],
+            &nn_dist[0], &nn_ind[0])
+    finally:
+        dist.set_queries_csr(NULL, NULL, NULL, 0)
+
+
+
+def _nn_from_distance(const floatT[:,::1] X, const floatT[:,::1] Y,
+        str metric, floatT[::1] d_core, floatT[::1] nn_dist,
+        ssize_t[::1] nn_ind, bint quantize=False, dict metric_params=None):
+    """(internal) Finds the nearest neighbours of the points in Y
+    amongst the ones in X, see _nn_query() and NNIndex._query_blockwise()
+    """
+    cdef c_mst.CDistance[floatT]* dist = _new_distance(X, metric, False,
+        quantize, False, metric_params)
+    try:
+        _nn_query(dist, X.shape[0], Y, d_core, nn_dist, nn_ind)
+    finally:
+        del dist
+
+
+
+
+
+
+################################################################################
+# Dynamic minimum spanning trees
+################################################################################
+
+
+
+
+cdef class DynamicMST:
+    """A Euclidean minimum spanning tree of a dynamic point set
+
+    New points are inserted in batches. For each new point, its
+    n_neighbors nearest neighbours amongst the existing points
+    and amongst the points in the same batch are the candidate edges.
+    The tree is updated by means of the cycle property:
+    a candidate edge replaces the heaviest edge on the cycle it creates
+    (if the latter is heavier). This takes O(log n) amortised
+    time per candidate edge, see c_dynamic_mst.CDynamicMST.
+
+    Points can also be removed (e.g., the expired ones in a sliding
+    window). The pieces of the tree are then reconnected using
+    a pool of the candidate edges gathered so far.
+
+    The points are numbered 0, 1, ..., n-1 in the order of insertion;
+    removing a point decreases the indices of the subsequent ones.
+    These indices are translated to the internal ones in O(log n) time
+    each, so a removal costs O(m log n) plus the reconnection.
+
+    Only the tree is maintained incrementally: any clustering derived
+    from it (e.g., by Genie, see genie.Genie.partial_fit) must be
+    recomputed from get_mst() after each update.
+
+    Note that the resulting tree is an approximate MST
+    (the edges to farther points are never considered),
+    compare mst_from_nn().
+
+    All the computations are performed in double precision.
+    The points are copied.
+
+
+    Parameters
+    ----------
+
+    X : c_contiguous ndarray, shape (n,d)
+        n initial points in a feature space of dimensionality d
+    mst_ind : c_contiguous ndarray, shape (n-1,2) or None
+        edges of an existing Euclidean MST of X,
+        see mst_from_distance(); if None, it is computed here
+    n_neighbors : int
+        number of candidate edges per new point
+    """
+    cdef c_dynamic_mst.CDynamicMST[double]* mst
+
+
+    def __cinit__(self, X, mst_ind=None, ssize_t n_neighbors=16):
+        cdef double[:,::1] X64
+        cdef ssize_t[:,::1] mst_ind_view
+
+        self.mst = NULL
+
+        X64 = np.array(X, dtype=np.float64, order="C", ndmin=2)
+        if X64.shape[0] <= 0:
+            raise ValueError("X must be nonempty")
+
+        if mst_ind is not None:
+            mst_ind_view = np.array(mst_ind, dtype=np.intp, order="C", ndmin=2)
+            if mst_ind_view.shape[0] != X64.shape[0]-1 or mst_ind_view.shape[1] != 2:
+                raise ValueError("mst_ind must be of shape (n-1,2)")
+
+        self.mst = new c_dynamic_mst.CDynamicMST[double](&X64[0,0],
+            X64.shape[0], X64.shape[1],
+            <ssize_t*>NULL if mst_ind is None or X64.shape[0] == 1
+                else &mst_ind_view[0,0],
+            n_neighbors)
+
+
+    def __dealloc__(self):
+        if self.mst: del self.mst
+
+
+    def __len__(self):
+        return self.mst.get_n()
+
+
+    cpdef np.ndarray insert(self, Y):
+        """Adds new points to the tree
+
+
+        Parameters
+        ----------
+
+        Y : ndarray, shape (m,d)
+            m new points
+
+
+        Returns
+        -------
+
+        ids : ndarray, shape (m,)
+            indices of the new points, i.e., n, n+1, ..., n+m-1,
+            where n is the number of points before the insertion
+        """
+        cdef double[:,::1] Y64 = np.array(Y, dtype=np.float64, order="C", ndmin=2)
+        cdef ssize_t n = self.mst.get_n()
+        cdef ssize_t m = Y64.shape[0]
+
+        if Y64.shape[1] != self.mst.get_d():
+            raise ValueError("Y.shape[1] does not match the dimensionality of the points")
+
+        if m > 0:
+            n = self.mst.insert(&Y64[0,0], m)
+
+        return np.arange(n, n+m, dtype=np.intp)
+
+
+    cpdef remove(self, ind):
+        """Removes given points from the tree
+
+        The indices of the remaining points are shifted so that they
+        are consecutive, e.g., removing the first m points makes
+        the (m+1)-th one the first.
+
+
+        Parameters
+        ----------
+
+        ind : ndarray, shape (m,)
+            indices of the points to remove, m < n
+        """
+        cdef ssize_t[::1] ind_view = np.array(ind, dtype=np.intp, order="C", ndmin=1)
+        if ind_view.shape[0] > 0:
+            self.mst.remove(&ind_view[0], ind_view.shape[0])
+
+
+    cpdef tuple get_mst(self):
+        """Returns the current spanning tree
+
+
+        Returns
+        -------
+
+        pair : tuple
+            A pair (mst_dist, mst_ind), see mst_from_distance().
+        """
+        cdef ssize_t n = self.mst.get_n()
+        cdef np.ndarray[ssize_t,ndim=2] mst_ind  = np.empty((n-1, 2), dtype=np.intp)
+        cdef np.ndarray[double]         mst_dist = np.empty(n-1, dtype=np.float64)
+        if n > 1:
+            self.mst.get_mst(&mst_dist[0], &mst_ind[0,0])
+        return mst_dist, mst_ind
+
+
+    cpdef np.ndarray get_data(self):
+        """Returns a copy of all the points, shape (n,d)"""
+        cdef np.ndarray[double,ndim=2] X = np.empty(
+            (self.mst.get_n(), self.mst.get_d()), dtype=np.float64)
+        self.mst.get_data(&X[0,0])
+        return X
+
+
+
+
+
+
 ################################################################################
 # Graph pre-processing routines
 ################################################################################
@@ -1105,6 +3605,69 @@ cpdef dict genie_from_mst(
 
 
 
+def genie_from_graph(
+        G,
+        ssize_t n_clusters=1,
+        double gini_threshold=0.3,
+        n=None,
+        bint noise_leaves=False,
+        bint compute_full_tree=True,
+        bint compute_all_cuts=False):
+    """Compute a k-partition based on a weighted undirected graph
+    given by a sparse matrix or an edge list, e.g., a radius graph,
+    a (symmetrised) nearest neighbour graph with arbitrary degrees,
+    or a dissimilarity graph constructed by the user.
+
+    The minimum spanning forest is determined by mst_from_graph()
+    and then passed to genie_from_mst(). If the graph is disconnected,
+    its connected components are joined by edges of infinite weights
+    (the Genie correction cannot cope with clusters that cannot be merged
+    any further). Hence, they are linked in the last iterations,
+    unless the Genie correction merges the small ones earlier
+    (e.g., isolated vertices are treated like outliers;
+    see also `noise_leaves`).
+
+
+    Parameters
+    ----------
+
+    G : scipy.sparse matrix or a pair (dist, ind)
+        see mst_from_graph()
+    n_clusters, gini_threshold, noise_leaves, compute_full_tree, compute_all_cuts
+        see genie_from_mst()
+    n : int or None
+        see mst_from_graph()
+
+
+    Returns
+    -------
+
+    res : dict
+        see genie_from_mst(); additionally, `n_components` gives the number
+        of connected components of G and `components` their ids
+    """
+    cdef dict stats = dict()
+    mst_d, mst_i = mst_from_graph(G, n=n, stats=stats)
+
+    cdef ssize_t n_components = stats["n_components"]
+    if n_components > 1:
+        # the last n_components-1 edges are missing; link the first vertex
+        # of each component with the first vertex of the 0th one
+        first = np.unique(stats["components"], return_index=True)[1]
+        mst_i[-(n_components-1):, 0] = first[0]
+        mst_i[-(n_components-1):, 1] = first[1:]
+
+    if mst_d.dtype == np.float32:
+        res = genie_from_mst[float](mst_d, mst_i, n_clusters,
+            gini_threshold, noise_leaves, compute_full_tree, compute_all_cuts)
+    else:
+        res = genie_from_mst[double](mst_d, mst_i, n_clusters,
+            gini_threshold, noise_leaves, compute_full_tree, compute_all_cuts)
+    res.update(stats)
+    return res
+
+
+
 
 
 #############################################################################
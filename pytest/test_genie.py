@@ -93,8 +93,8 @@ def test_genie_precomputed():
         X = (X-X.mean(axis=0))/X.std(axis=None, ddof=1)
         X = X.astype("float32")
 
-        D = scipy.spatial.distance.pdist(X)
-        D = scipy.spatial.distance.squareform(D)
+        D_condensed = scipy.spatial.distance.pdist(X)
+        D = scipy.spatial.distance.squareform(D_condensed)
 
         for g in [0.01, 0.3, 0.5, 0.7, 1.0]:
             gc.collect()
@@ -109,9 +109,22 @@ def test_genie_precomputed():
             print("ARI=%.3f" % ari, end="\t")
             assert ari>1.0-1e-12
 
-            res1, res2 = None, None
+            res3 = Genie(k, g, exact=True,
+                         affinity="precomputed",
+                         compute_full_tree=False).fit_predict(D_condensed)+1
+            assert np.all(res1 == res3)
+
+            res1, res2, res3 = None, None, None
             print("")
 
+        # condensed distance vectors with M>1 (the core distances and
+        # the boundary points are based on the nearest neighbours)
+        res1 = Genie(k, 0.3, exact=True, affinity="precomputed",
+            M=5).fit_predict(D)
+        res2 = Genie(k, 0.3, exact=True, affinity="precomputed",
+            M=5).fit_predict(D_condensed)
+        assert adjusted_rand_score(res1, res2) > 1.0-1e-12
+
 
         # test compute_all_cuts
         K = 16
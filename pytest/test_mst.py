@@ -1,8 +1,14 @@
 import numpy as np
 import sklearn.neighbors
+import sklearn.metrics.pairwise
 import scipy.spatial.distance
+import scipy.spatial
+import scipy.sparse
 import time
 import gc
+import os
+import tempfile
+import ctypes
 import genieclust.internal
 import genieclust.deprecated
 
@@ -18,6 +24,17 @@ def mst_check(X, metric='euclidean', **kwargs):
     print("    precomputed      %10.3fs" % (time.time()-t0,))
 
 
+    t0 = time.time()
+    dist_condensed = scipy.spatial.distance.pdist(X, metric=metric)
+    mst_d0, mst_i0 = genieclust.internal.mst_from_distance(
+        dist_condensed.reshape(1, -1), metric="precomputed")
+    print("    condensed        %10.3fs" % (time.time()-t0,))
+
+    assert np.allclose(mst_d.sum(), mst_d0.sum())
+    assert np.all(mst_i == mst_i0)
+    assert np.allclose(mst_d, mst_d0)
+
+
     t0 = time.time()
     nn = sklearn.neighbors.NearestNeighbors(n_neighbors=n_neighbors, metric=metric, **kwargs)
     nn.fit(X)
@@ -39,6 +56,16 @@ def mst_check(X, metric='euclidean', **kwargs):
     assert np.allclose(mst_d, mst_d2)
 
 
+    t0 = time.time()
+    mst_d3, mst_i3 = genieclust.internal.mst_from_distance(X, metric=metric,
+        reorder=True)
+    print("    reordered        %10.3fs" % (time.time()-t0,))
+
+    assert np.allclose(mst_d.sum(), mst_d3.sum())
+    assert np.all(mst_i == mst_i3)
+    assert np.allclose(mst_d, mst_d3)
+
+
     #for nnn in [8, 32, 128]:
         #t0 = time.time()
         #nn = sklearn.neighbors.NearestNeighbors(n_neighbors=nnn, metric=metric, **kwargs)
@@ -76,14 +103,21 @@ def mst_mutreach_check(X, metric='euclidean'):
         #assert np.all(mst_i1 == mst_i2)   # mutreach dist - many duplicates
         assert np.allclose(mst_d1, mst_d2)
 
+        mst_d3, mst_i3 = genieclust.internal.mst_from_distance(X, metric=metric,
+            d_core=d_core, reorder=True)
+        assert np.allclose(mst_d1.sum(), mst_d3.sum())
+        assert np.allclose(mst_d1, mst_d3)
+
     return True
 
 
 def test_MST():
     path = "benchmark_data"
-    for dataset in ["pathbased", "h2mg_64_50", "big_one"]:
+    for dataset in ["pathbased", "h2mg_64_50", "big_one", "high_dim"]:
         if dataset == "big_one":
             X =  np.random.rand(1_000, 2)
+        elif dataset == "high_dim":
+            X =  np.random.rand(500, 128)
         else:
             X = np.loadtxt("%s/%s.data.gz" % (path,dataset), ndmin=2)
 
@@ -98,5 +132,622 @@ def test_MST():
         mst_mutreach_check(X, metric='cosine')
         gc.collect()
 
+def test_MST_half():
+    np.random.seed(123)
+    for d in [2, 5, 100]:
+        X = np.random.randn(300, d)
+        X16 = X.astype(np.float16)
+        Xb16 = genieclust.internal.to_bfloat16(X)
+        Xb32 = (Xb16.astype(np.uint32) << np.uint32(16)).view(np.float32)
+        d_core = np.random.rand(300).astype(np.float32)
+
+        for metric in ["euclidean", "manhattan", "cosine"]:
+            for c in [None, d_core]:
+                mst_d1, mst_i1 = genieclust.internal.mst_from_distance(
+                    X16.astype(np.float32), metric, c)
+                mst_d2, mst_i2 = genieclust.internal.mst_from_distance_half(
+                    X16, metric, c)
+                assert mst_d2.dtype == np.float32
+                assert np.allclose(mst_d1, mst_d2)
+                assert np.allclose(mst_d1.sum(), mst_d2.sum())
+
+                mst_d1, mst_i1 = genieclust.internal.mst_from_distance(
+                    Xb32, metric, c)
+                mst_d2, mst_i2 = genieclust.internal.mst_from_distance_half(
+                    Xb16, metric, c, storage="bfloat16")
+                assert np.allclose(mst_d1, mst_d2)
+                assert np.allclose(mst_d1.sum(), mst_d2.sum())
+
+    # metrics without half-precision support: X16 is cast to float32
+    X16 = (np.random.rand(300, 2)-0.5).astype(np.float16)
+    for metric in ["euclidean", "chebyshev", "mahalanobis", "haversine"]:
+        for cast_float32 in [True, False]:
+            g1 = genieclust.Genie(3, affinity=metric,
+                cast_float32=cast_float32).fit(X16)
+            g2 = genieclust.Genie(3, affinity=metric).fit(
+                X16.astype(np.float32))
+            assert np.allclose(g1._mst_dist_, g2._mst_dist_)
+            assert np.all(g1.predict(X16[:10,:]) == g1.labels_[:10])
+
+
+def test_MST_quantize():
+    np.random.seed(123)
+    for d in [5, 150]:
+        X = np.random.randn(400, d)
+        X[:200,:] += 5.0
+        X[:,0] *= 10.0
+        d_core = np.random.rand(400)*d**0.5
+
+        for dtype in [np.float32, np.float64]:
+            Xt = X.astype(dtype)
+            for c in [None, d_core.astype(dtype)]:
+                mst_d1, mst_i1 = genieclust.internal.mst_from_distance(
+                    Xt, "euclidean", c)
+                mst_d2, mst_i2 = genieclust.internal.mst_from_distance(
+                    Xt, "euclidean", c, quantize=True)
+                assert np.allclose(mst_d1, mst_d2)
+                assert np.allclose(mst_d1.sum(), mst_d2.sum())
+                if c is None:
+                    assert np.all(mst_i1 == mst_i2)
+
+                idx1 = genieclust.internal.NNIndex(Xt[:300,:],
+                    d_core=None if c is None else c[:300])
+                idx2 = genieclust.internal.NNIndex(Xt[:300,:],
+                    d_core=None if c is None else c[:300], quantize=True)
+                nn_d1, nn_i1 = idx1.query(Xt[300:,:])
+                nn_d2, nn_i2 = idx2.query(Xt[300:,:])
+                assert np.allclose(nn_d1, nn_d2)
+                if c is None:
+                    assert np.all(nn_i1 == nn_i2)
+
+
+def test_MST_mmap():
+    np.random.seed(123)
+    X = np.random.randn(300, 5)
+    D = scipy.spatial.distance.pdist(X)
+    with tempfile.TemporaryDirectory() as tmpdir:
+        np.save(os.path.join(tmpdir, "X.npy"), X)
+        np.save(os.path.join(tmpdir, "D.npy"), scipy.spatial.distance.squareform(D))
+        D.tofile(os.path.join(tmpdir, "D.bin"))
+
+        Xm = np.load(os.path.join(tmpdir, "X.npy"), mmap_mode="r")
+        Dm = np.load(os.path.join(tmpdir, "D.npy"), mmap_mode="r")
+        Dc = np.memmap(os.path.join(tmpdir, "D.bin"), dtype=np.float64, mode="r")
+
+        mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X)
+        for metric, Y in [("euclidean", Xm), ("precomputed", Dm),
+                          ("precomputed", Dc.reshape(1, -1))]:
+            mst_d2, mst_i2 = genieclust.internal.mst_from_distance(Y,
+                metric, reorder=True)
+            assert np.allclose(mst_d1, mst_d2)
+            assert np.all(mst_i1 == mst_i2)
+
+        d_core = np.random.rand(300)
+        mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X, "manhattan", d_core)
+        mst_d2, mst_i2 = genieclust.internal.mst_from_distance(Xm, "manhattan", d_core)
+        assert np.allclose(mst_d1, mst_d2)
+        del Xm, Dm, Dc
+
+
+def test_MST_sparse():
+    np.random.seed(123)
+    X = scipy.sparse.random(300, 1000, density=0.02, format="csr",
+        random_state=123)
+    X = X + scipy.sparse.eye(300, 1000) # no zero rows (cosine)
+    Xd = X.toarray()
+    d_core = np.random.rand(300)
+
+    for metric in ["euclidean", "manhattan", "cosine"]:
+        for dtype in [np.float64, np.float32]:
+            for dc in [None, d_core.astype(dtype)]:
+                mst_d1, mst_i1 = genieclust.internal.mst_from_distance(
+                    Xd.astype(dtype), metric, dc)
+                mst_d2, mst_i2 = genieclust.internal.mst_from_distance_sparse(
+                    X.astype(dtype), metric, dc)
+                assert mst_d2.dtype == dtype
+                assert np.allclose(mst_d1, mst_d2,
+                    rtol=1e-4 if dtype == np.float32 else 1e-7)
+                if dtype == np.float64:
+                    assert np.all(mst_i1 == mst_i2)
+
+    # unsorted indices, duplicates, and the COO format
+    Xc = scipy.sparse.coo_matrix(X)
+    Xc = scipy.sparse.coo_matrix((np.r_[Xc.data, Xc.data][::-1],
+        (np.r_[Xc.row, Xc.row][::-1], np.r_[Xc.col, Xc.col][::-1])),
+        shape=X.shape)
+    mst_d1, mst_i1 = genieclust.internal.mst_from_distance(2*Xd)
+    mst_d2, mst_i2 = genieclust.internal.mst_from_distance_sparse(Xc)
+    assert np.allclose(mst_d1, mst_d2)
+    assert np.all(mst_i1 == mst_i2)
+
+    # (M>1 would yield many ties in the mutual reachability distances)
+    g1 = genieclust.Genie(n_clusters=3, cast_float32=False)
+    g2 = genieclust.Genie(n_clusters=3, cast_float32=False)
+    assert np.all(g1.fit_predict(Xd) == g2.fit_predict(X))
+    assert np.all(g1.predict(Xd[:10]) == g2.predict(X[:10]))
+
+    # approximate MSTs based on the nearest neighbour graphs
+    Xs = scipy.sparse.random(300, 50, density=0.2, format="csr",
+        random_state=123)
+    Xs = scipy.sparse.csr_matrix(Xs + scipy.sparse.eye(300, 50))
+    for metric in ["cosine", "manhattan"]:
+        g1 = genieclust.Genie(n_clusters=2, affinity=metric, exact=False)
+        g2 = genieclust.Genie(n_clusters=2, affinity=metric)
+        labels1 = g1.fit_predict(Xs)
+        labels2 = g2.fit_predict(Xs)
+        assert labels1.shape == (300,)
+        assert np.all(np.isfinite(g1._mst_dist_))
+        assert g1._mst_dist_.sum() >= g2._mst_dist_.sum()-1e-9
+    try:
+        genieclust.Genie(n_clusters=2, affinity="chebyshev",
+            exact=False).fit(Xd)
+        assert False
+    except ValueError:
+        pass
+
+
+def test_MST_metrics():
+    np.random.seed(123)
+    X = np.random.randn(200, 4)*[1.0, 2.0, 0.5, 3.0]
+    X[:,1] += X[:,0]
+    d_core = np.random.rand(200)
+    VI = np.linalg.inv(np.cov(X, rowvar=False))
+    V = np.var(X, axis=0, ddof=1)
+
+    for metric, params, scipy_params in [
+            ("chebyshev", None, dict()),
+            ("minkowski", dict(p=3), dict(p=3)),
+            ("minkowski", dict(p=1.5), dict(p=1.5)),
+            ("minkowski", dict(p=np.inf), dict(p=np.inf)),
+            ("mahalanobis", None, dict(VI=VI)),
+            ("seuclidean", dict(V=np.ones(4)), dict(V=np.ones(4))),
+            ("seuclidean", None, dict(V=V))]:
+        D = scipy.spatial.distance.squareform(
+            scipy.spatial.distance.pdist(X, metric, **scipy_params))
+        for dc in [None, d_core]:
+            mst_d1, mst_i1 = genieclust.internal.mst_from_complete(
+                D if dc is None else
+                np.maximum(D, np.maximum.outer(dc, dc)))
+            mst_d2, mst_i2 = genieclust.internal.mst_from_distance(
+                X, metric, dc, metric_params=params)
+            assert np.allclose(mst_d1, mst_d2)
+            assert np.all(mst_i1 == mst_i2)
+
+        nn_dist, nn_ind = genieclust.internal.knn_from_distance(X, 5,
+            metric, params)
+        np.fill_diagonal(D, np.inf)
+        assert np.allclose(nn_dist, np.sort(D, axis=1)[:,:5])
+        assert np.all(nn_ind == np.argsort(D, axis=1, kind="stable")[:,:5])
+
+    try:
+        genieclust.internal.mst_from_distance(X, "minkowski",
+            metric_params=dict(p=0.5))
+        assert False
+    except ValueError:
+        pass
+
+    g = genieclust.Genie(n_clusters=3, M=3, affinity="mahalanobis").fit(X)
+    assert g.predict(X[:10]).shape == (10, )
+
+
+def test_MST_binary():
+    np.random.seed(123)
+    X = (np.random.rand(250, 150) < np.random.rand(250, 1)*0.5)
+    P = genieclust.internal.pack_bits(X)
+    assert P.shape == (250, 3) and P.dtype == np.uint64
+    d_core = np.random.rand(250)*0.1
+
+    for metric in ["hamming", "jaccard"]:
+        D = scipy.spatial.distance.squareform(
+            scipy.spatial.distance.pdist(X, metric))
+        for dc in [None, d_core]:
+            mst_d1, mst_i1 = genieclust.internal.mst_from_complete(
+                D if dc is None else
+                np.maximum(D, np.maximum.outer(dc, dc)))
+            mst_d2, mst_i2 = genieclust.internal.mst_from_distance_binary(
+                X, metric, dc)
+            # many ties: the MST weights are unique, the edges might be not
+            assert np.allclose(mst_d1, mst_d2)
+            mst_d3, mst_i3 = genieclust.internal.mst_from_distance_binary(
+                P, metric, dc, n_bits=150)
+            assert np.all(mst_d2 == mst_d3) and np.all(mst_i2 == mst_i3)
+
+        nn_dist, nn_ind = genieclust.internal.knn_from_distance_binary(
+            X, 5, metric)
+        np.fill_diagonal(D, np.inf)
+        assert np.allclose(nn_dist, np.sort(D, axis=1)[:,:5])
+        assert np.allclose(nn_dist, D[np.arange(250).reshape(-1, 1), nn_ind])
+
+    g = genieclust.Genie(n_clusters=3, M=3, affinity="jaccard").fit(X)
+    assert np.all(np.bincount(g.labels_+1) > 0)
+    g = genieclust.Genie(n_clusters=3, affinity="hamming").fit(X)
+    assert np.all(g.predict(X[:10]) == g.labels_[:10])
+
+
+def test_MST_haversine():
+    np.random.seed(123)
+    X = np.c_[np.random.uniform(-np.pi/2, np.pi/2, 400),
+              np.random.uniform(-np.pi, np.pi, 400)]
+    X[:100,:] = X[:100,:]*1e-4  # a dense cluster
+    D = sklearn.metrics.pairwise.haversine_distances(X)
+    d_core = np.random.rand(400)*0.1
+
+    for dc in [None, d_core]:
+        mst_d1, mst_i1 = genieclust.internal.mst_from_complete(
+            D if dc is None else np.maximum(D, np.maximum.outer(dc, dc)))
+        mst_d2, mst_i2 = genieclust.internal.mst_from_distance(
+            X, "haversine", dc)
+        # ties between core distances: only the weights are unique
+        assert np.allclose(mst_d1, mst_d2)
+        if dc is None:
+            assert np.all(mst_i1 == mst_i2)
+
+    nn_dist, nn_ind = genieclust.internal.knn_from_distance(X, 5, "haversine")
+    np.fill_diagonal(D, np.inf)
+    assert np.allclose(nn_dist, np.sort(D, axis=1)[:,:5])
+    assert np.all(nn_ind == np.argsort(D, axis=1, kind="stable")[:,:5])
+
+    idx = genieclust.internal.NNIndex(X[:300,:], metric="haversine")
+    nn_dist, nn_ind = idx.query(X[300:,:])
+    D = sklearn.metrics.pairwise.haversine_distances(X[300:,:], X[:300,:])
+    assert np.allclose(nn_dist, D.min(axis=1))
+    assert np.all(nn_ind == D.argmin(axis=1))
+
+    g = genieclust.Genie(n_clusters=3, affinity="haversine").fit(X)
+    assert np.all(g.predict(X[:10]) == g.labels_[:10])
+
+
+def test_MST_callback():
+    np.random.seed(123)
+    X = np.random.randn(150, 3)
+    D = scipy.spatial.distance.squareform(
+        scipy.spatial.distance.pdist(X, "canberra"))
+    d_core = np.random.rand(150)
+
+    # a (slow) Python function; numba.cfunc-s are supported too
+    @ctypes.CFUNCTYPE(None, ctypes.c_ssize_t, ctypes.POINTER(ctypes.c_ssize_t),
+        ctypes.c_ssize_t, ctypes.POINTER(ctypes.c_double))
+    def canberra(i, M, k, out):
+        M = np.ctypeslib.as_array(M, (k, ))
+        out = np.ctypeslib.as_array(out, (k, ))
+        out[:] = D[i, M]
+
+    for dc in [None, d_core]:
+        mst_d1, mst_i1 = genieclust.internal.mst_from_complete(
+            D if dc is None else np.maximum(D, np.maximum.outer(dc, dc)))
+        for chunk_size in [256, 7]:
+            mst_d2, mst_i2 = genieclust.internal.mst_from_callback(
+                canberra, 150, dc, chunk_size=chunk_size)
+            assert np.allclose(mst_d1, mst_d2)
+            if dc is None:
+                assert np.all(mst_i1 == mst_i2)
+
+    nn_dist, nn_ind = genieclust.internal.knn_from_callback(
+        ctypes.cast(canberra, ctypes.c_void_p).value, 150, 5)
+    np.fill_diagonal(D, np.inf)
+    assert np.allclose(nn_dist, np.sort(D, axis=1)[:,:5])
+    assert np.all(nn_ind == np.argsort(D, axis=1, kind="stable")[:,:5])
+
+    try:
+        genieclust.internal.mst_from_callback(lambda i, M, k, out: None, 150)
+        assert False
+    except ValueError:
+        pass
+
+
+def test_MST_minhash():
+    np.random.seed(123)
+    n = 300
+    labels = np.random.choice(3, n)
+    sets = [
+        np.r_[100*l+np.random.choice(50, 40, replace=False),
+              np.random.choice(10000, 3)]
+        for l in labels
+    ]
+    X = scipy.sparse.lil_matrix((n, 10000))
+    for i in range(n): X[i, sets[i]] = 1
+
+    S = genieclust.internal.minhash(sets, 256)
+    assert S.shape == (n, 256) and S.dtype == np.uint32
+    assert np.all(S == genieclust.internal.minhash(X, 256))
+    assert genieclust.internal.minhash([[], ["a", "b"]], 8).shape == (2, 8)
+
+    D = scipy.spatial.distance.squareform(
+        scipy.spatial.distance.pdist(X.toarray(), "jaccard"))
+    D_est = (S[:,None,:] != S[None,:,:]).mean(axis=2)
+    assert np.abs(D-D_est).mean() < 0.05
+
+    d_core = np.random.rand(n)*0.1
+    for dc in [None, d_core]:
+        mst_d1, mst_i1 = genieclust.internal.mst_from_complete(
+            D_est if dc is None else np.maximum(D_est, np.maximum.outer(dc, dc)))
+        mst_d2, mst_i2 = genieclust.internal.mst_from_minhash(S, dc, exact=True)
+        assert np.allclose(mst_d1, mst_d2)
+        # 3 clusters with no common tokens (almost surely)
+        mst_d3, mst_i3 = genieclust.internal.mst_from_minhash(S, dc)
+        assert np.all(np.isinf(mst_d3[-2:])) and np.all(mst_i3[-2:,:] == -1)
+        assert np.allclose(mst_d1[:-2], mst_d3[:-2])
+
+    nn_dist, nn_ind = genieclust.internal.knn_from_minhash(S, 10)
+    assert np.allclose(nn_dist, D_est[np.arange(n).reshape(-1, 1), nn_ind])
+    np.fill_diagonal(D_est, np.inf)
+    assert np.allclose(nn_dist, np.sort(D_est, axis=1)[:,:10])
+
+
+def test_MST_pivots():
+    np.random.seed(123)
+    n = 1000
+    X = np.random.randn(n, 10)*0.1 + np.random.randn(10, 10)[np.random.choice(10, n),:]*5
+    d_core = np.random.rand(n)*0.1
+    D = scipy.spatial.distance.squareform(scipy.spatial.distance.pdist(X))
+
+    for metric, Y in [("euclidean", X), ("cityblock", X),
+            ("chebyshev", X), ("precomputed", D)]:
+        for dc in [None, d_core]:
+            mst_d1, mst_i1 = genieclust.internal.mst_from_distance(Y, metric, dc)
+            stats = dict()
+            mst_d2, mst_i2 = genieclust.internal.mst_from_distance(Y, metric, dc,
+                n_pivots=8, stats=stats, assume_metric=True)
+            assert np.allclose(mst_d1, mst_d2)
+            assert np.all(mst_i1 == mst_i2)
+            assert stats["pruned"] > 0.5
+            assert stats["n_computed"] < n*(n-1)/4
+
+    @ctypes.CFUNCTYPE(None, ctypes.c_ssize_t, ctypes.POINTER(ctypes.c_ssize_t),
+        ctypes.c_ssize_t, ctypes.POINTER(ctypes.c_double))
+    def euclidean(i, M, k, out):
+        M = np.ctypeslib.as_array(M, (k, ))
+        out = np.ctypeslib.as_array(out, (k, ))
+        out[:] = D[i, M]
+
+    X = X[:300, :]
+    D = D[:300, :300]
+    stats = dict()
+    mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X, "euclidean")
+    mst_d2, mst_i2 = genieclust.internal.mst_from_callback(euclidean, 300,
+        n_pivots=8, stats=stats, assume_metric=True)
+    assert np.allclose(mst_d1, mst_d2)
+    assert np.all(mst_i1 == mst_i2)
+    assert stats["pruned"] > 0.5
+
+    # the triangle inequality is not assumed by default
+    for f in [
+            lambda: genieclust.internal.mst_from_distance(D, "precomputed",
+                n_pivots=8),
+            lambda: genieclust.internal.mst_from_callback(euclidean, 300,
+                n_pivots=8)]:
+        try:
+            f()
+            assert False
+        except ValueError:
+            pass
+
+    # all the distances are computed anyway in high-dimensional spaces
+    Z = np.random.randn(300, 64)
+    stats = dict()
+    mst_d1, mst_i1 = genieclust.internal.mst_from_distance(Z, "euclidean")
+    mst_d2, mst_i2 = genieclust.internal.mst_from_distance(Z, "euclidean",
+        n_pivots=8, stats=stats)
+    assert np.allclose(mst_d1, mst_d2)
+    assert stats["n_computed"] == 300*299/2
+
+
+
+def test_MST_early_abandon():
+    np.random.seed(123)
+    n = 1000
+    d = 50
+    X = np.random.randn(n, d)*np.linspace(0.1, 10.0, d)[np.random.permutation(d)]
+    d_core = np.random.rand(n)
+
+    for metric in ["euclidean", "cityblock", "seuclidean"]:
+        for dc in [None, d_core]:
+            mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X, metric, dc)
+            mst_d2, mst_i2 = genieclust.internal.mst_from_distance(X, metric, dc,
+                early_abandon=True)
+            assert np.allclose(mst_d1, mst_d2)
+            assert np.all(mst_i1 == mst_i2)
+
+            mst_d2, mst_i2 = genieclust.internal.mst_from_distance(X, metric, dc,
+                early_abandon=True, n_pivots=4, reorder=True)
+            assert np.allclose(mst_d1, mst_d2)
+            assert np.all(mst_i1 == mst_i2)
+
+
+
+def test_MST_delaunay():
+    np.random.seed(123)
+    n = 2000
+    X = np.random.randn(n, 2)
+    X[:500,:] = X[:500,:]*1e-6  # a dense cluster
+    X[-10:,:] = X[:10,:]        # duplicates
+    grid = np.array(np.meshgrid(np.arange(30), np.arange(20))).reshape(2, -1).T
+    line = np.c_[np.arange(50), 2*np.arange(50)][np.random.permutation(50),:]
+
+    for Y in [X, X.astype(np.float32), grid*0.1, line*1.0, X[:2,:]]:
+        D = scipy.spatial.distance.squareform(scipy.spatial.distance.pdist(Y))
+        mst_d1, mst_i1 = genieclust.internal.mst_from_complete(D)
+        mst_d2, mst_i2 = genieclust.internal.mst_from_distance(
+            np.ascontiguousarray(Y), "euclidean")
+        assert mst_d2.dtype == Y.dtype
+        assert np.allclose(mst_d1, mst_d2)
+        assert np.all(mst_i2[:,0] < mst_i2[:,1])
+        if Y is X:
+            assert np.all(mst_i1 == mst_i2)
+
+    X = np.random.rand(n, 2)  # qhull merges the nearly coincident points
+    ind = genieclust.internal.delaunay_edges(X)
+    tri = scipy.spatial.Delaunay(X).simplices
+    ind2 = np.sort(np.r_[tri[:,[0,1]], tri[:,[1,2]], tri[:,[0,2]]], axis=1)
+    ind2 = np.unique(ind2, axis=0)
+    assert np.all(np.unique(ind, axis=0) == ind2)
+
+
+
+def test_MST_manhattan_2d():
+    np.random.seed(123)
+    n = 2000
+    X = np.random.randn(n, 2)
+    X[:500,:] = X[:500,:]*1e-6  # a dense cluster
+    X[-10:,:] = X[:10,:]        # duplicates
+    grid = np.array(np.meshgrid(np.arange(30), np.arange(20))).reshape(2, -1).T
+    line = np.c_[np.arange(50), -2*np.arange(50)][np.random.permutation(50),:]
+    Z = np.random.rand(n, 2)  # a unique MST
+
+    for Y in [X, X.astype(np.float32), grid*0.1, line*1.0, X[:2,:], Z]:
+        D = scipy.spatial.distance.squareform(
+            scipy.spatial.distance.pdist(Y, "cityblock"))
+        mst_d1, mst_i1 = genieclust.internal.mst_from_complete(D)
+        stats = dict()
+        mst_d2, mst_i2 = genieclust.internal.mst_from_distance(
+            np.ascontiguousarray(Y), "cityblock", stats=stats)
+        assert mst_d2.dtype == Y.dtype
+        assert np.allclose(mst_d1, mst_d2)
+        assert np.all(mst_i2[:,0] < mst_i2[:,1])
+        assert stats["n_computed"] <= 4*Y.shape[0]
+        if Y is Z:
+            assert np.all(mst_i1 == mst_i2)
+
+
+
+def test_MST_projection():
+    np.random.seed(123)
+    n = 1000
+    d = 2000
+    centres = np.random.randn(5, d)
+    y = np.random.choice(5, n)
+    X = centres[y,:] + np.random.randn(n, d)*0.2
+
+    Y = genieclust.internal.random_projection(X, 200)
+    assert Y.shape == (n, 200)
+    ind = np.c_[np.arange(n-1), np.arange(1, n)]
+    D1 = genieclust.internal.euclidean_distances_at(X, ind)
+    D2 = genieclust.internal.euclidean_distances_at(Y, ind)
+    assert np.allclose(D1, np.sqrt(np.sum((X[:-1,:]-X[1:,:])**2, axis=1)))
+    assert np.all(np.abs(D2/D1-1.0) < 0.3)
+
+    for M in [1, 3]:
+        g1 = genieclust.Genie(n_clusters=5, M=M, postprocess="all")
+        g2 = genieclust.Genie(n_clusters=5, M=M, postprocess="all", projection=0.5)
+        l1 = g1.fit_predict(X)
+        l2 = g2.fit_predict(X)
+        assert genieclust.compare_partitions.adjusted_rand_score(l1, l2) > 0.99
+        assert np.all(np.diff(g2._mst_dist_) >= 0)
+        assert np.allclose(g2._mst_dist_, np.maximum(
+            genieclust.internal.euclidean_distances_at(X.astype(np.float32), g2._mst_ind_),
+            0.0 if M == 1 else np.maximum(g2._d_core_[g2._mst_ind_[:,0]],
+                                          g2._d_core_[g2._mst_ind_[:,1]])))
+
+
+
+def test_MST_sharded():
+    np.random.seed(123)
+    n = 1000
+    X = np.random.randn(n, 5)
+    d_core = np.random.rand(n)
+
+    for metric, dc, n_shards, n_jobs in [("euclidean", None, 4, 1),
+            ("cityblock", d_core, 3, 1), ("mahalanobis", None, 5, 1),
+            ("euclidean", d_core, 4, 2)]:
+        mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X, metric, dc)
+        mst_d2, mst_i2 = genieclust.internal.mst_from_distance_sharded(X,
+            n_shards, metric, dc, n_jobs=n_jobs)
+        assert np.allclose(mst_d1, mst_d2)
+        if dc is None:
+            assert np.all(mst_i1 == mst_i2)
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        fname = os.path.join(tmpdir, "X.bin")
+        Y = np.memmap(fname, dtype=np.float64, mode="w+", shape=X.shape)
+        Y[:,:] = X
+        Y.flush()
+        Y = np.memmap(fname, dtype=np.float64, mode="r", shape=X.shape)
+        mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X)
+        mst_d2, mst_i2 = genieclust.internal.mst_from_distance_sharded(Y,
+            3, n_jobs=2)
+        assert np.allclose(mst_d1, mst_d2)
+        assert np.all(mst_i1 == mst_i2)
+        del Y
+
+
+def test_MST_graph():
+    np.random.seed(123)
+    n = 500
+    X = np.random.rand(n, 3)
+    D = scipy.spatial.distance.squareform(scipy.spatial.distance.pdist(X))
+    mst_d1, mst_i1 = genieclust.internal.mst_from_distance(X)
+
+    G = scipy.sparse.csr_matrix(D)  # the whole symmetric matrix, no diagonal
+    mst_d2, mst_i2 = genieclust.internal.mst_from_graph(G)
+    assert np.allclose(mst_d1, mst_d2)
+    assert np.all(mst_i1 == mst_i2)
+
+    i, j = np.triu_indices(n, 1)  # each edge once
+    stats = dict()
+    mst_d3, mst_i3 = genieclust.internal.mst_from_graph(
+        (D[i, j].astype(np.float32), np.c_[i, j]), stats=stats)
+    assert mst_d3.dtype == np.float32
+    assert np.allclose(mst_d1, mst_d3)
+    assert np.all(mst_i1 == mst_i3)
+    assert stats["n_components"] == 1
+    assert np.all(stats["components"] == 0)
+
+    # a radius graph consisting of two connected components
+    # and an isolated point
+    X[:200, 0] += 10.0
+    X[-1, 1] += 20.0
+    D = scipy.spatial.distance.squareform(scipy.spatial.distance.pdist(X))
+    D[D > 1.0] = 0.0
+    G = scipy.sparse.csr_matrix(D)
+    stats = dict()
+    mst_d4, mst_i4 = genieclust.internal.mst_from_graph(G, stats=stats)
+    assert stats["n_components"] == 3
+    comp = stats["components"]
+    assert np.all(comp[:200] == 0) and np.all(comp[200:-1] == 1) and comp[-1] == 2
+    assert np.all(np.isinf(mst_d4[-2:])) and np.all(mst_i4[-2:, :] == -1)
+    assert np.all(np.isfinite(mst_d4[:-2]))
+    try:
+        genieclust.internal.mst_from_graph(G, stop_disconnected=True)
+        assert False
+    except ValueError:
+        pass
+
+    res = genieclust.internal.genie_from_graph(G, n_clusters=3,
+        gini_threshold=1.0)
+    assert res["n_components"] == 3
+    assert np.all(res["labels"] == comp)
+    for g in [0.1, 0.3, 0.5]:
+        # the isolated vertex is an outlier
+        res = genieclust.internal.genie_from_graph(G, n_clusters=2,
+            gini_threshold=g)
+        assert np.all(res["labels"][:-1] == comp[:-1])
+        res = genieclust.internal.genie_from_graph(G, n_clusters=2,
+            gini_threshold=g, noise_leaves=True)
+        assert res["labels"][-1] == -1
+
+    for G in [(np.r_[1.0], np.array([[0, n]])), np.zeros((n, n))]:
+        try:
+            genieclust.internal.mst_from_graph(G, n=n)
+            assert False
+        except ValueError:
+            pass
+
+
 if __name__ == "__main__":
     test_MST()
+    test_MST_half()
+    test_MST_quantize()
+    test_MST_mmap()
+    test_MST_sparse()
+    test_MST_metrics()
+    test_MST_binary()
+    test_MST_haversine()
+    test_MST_callback()
+    test_MST_minhash()
+    test_MST_pivots()
+    test_MST_early_abandon()
+    test_MST_delaunay()
+    test_MST_manhattan_2d()
+    test_MST_projection()
+    test_MST_sharded()
+    test_MST_graph()
@@ -0,0 +1,168 @@
+import numpy as np
+from genieclust.genie import *
+from genieclust.internal import DynamicMST, DisjointSets, mst_from_distance
+from genieclust.compare_partitions import adjusted_rand_score
+import time
+import gc
+
+import os
+if os.path.exists("benchmark_data"):
+    path = "benchmark_data"
+else:
+    path = "../benchmark_data"
+
+
+
+def test_dynamic_mst():
+    np.random.seed(123)
+    for dataset in ["jain", "pathbased", "h2mg_64_50"]:
+        X = np.loadtxt("%s/%s.data.gz" % (path,dataset), ndmin=2)
+        X = (X-X.mean(axis=0))/X.std(axis=None, ddof=1)
+        X += np.random.normal(0, 0.0001, X.shape)
+        X = X[np.random.permutation(X.shape[0]),:]
+        n = X.shape[0]
+
+        mst_dist_ref, mst_ind_ref = mst_from_distance(X, "euclidean")
+
+        for n_neighbors in [4, 16, n]:
+            gc.collect()
+            print(dataset, n_neighbors)
+            t0 = time.time()
+            mst = DynamicMST(X[:n//4,:], n_neighbors=n_neighbors)
+            i = n//4
+            while i < n:
+                m = np.random.randint(1, 50)
+                ids = mst.insert(X[i:(i+m),:])
+                assert np.all(ids == np.arange(i, min(n, i+m)))
+                i += m
+            mst_dist, mst_ind = mst.get_mst()
+            print("    insert %10.3fs" % (time.time()-t0,))
+
+            assert len(mst) == n
+            assert np.allclose(mst.get_data(), X)
+            assert np.all(mst_ind >= 0) and np.all(mst_ind[:,0] < mst_ind[:,1])
+            assert np.all(np.diff(mst_dist) >= 0)
+            assert np.allclose(mst_dist,
+                np.sqrt(np.sum((X[mst_ind[:,0],:]-X[mst_ind[:,1],:])**2, axis=1)))
+            # a spanning tree: n-1 edges, connected
+            ds = DisjointSets(n)
+            for j in range(n-1):
+                ds.union(int(mst_ind[j,0]), int(mst_ind[j,1]))
+            assert ds.get_k() == 1
+
+            print("    total weight %.6f vs %.6f" % (mst_dist.sum(), mst_dist_ref.sum()))
+            assert mst_dist.sum() >= mst_dist_ref.sum()-1e-9
+            if n_neighbors >= 16:
+                assert mst_dist.sum() <= mst_dist_ref.sum()*1.001
+            if n_neighbors == n:
+                assert np.allclose(mst_dist, mst_dist_ref)
+
+
+def test_dynamic_mst_remove():
+    np.random.seed(123)
+    for dataset in ["jain", "pathbased", "h2mg_64_50"]:
+        X = np.loadtxt("%s/%s.data.gz" % (path,dataset), ndmin=2)
+        X = (X-X.mean(axis=0))/X.std(axis=None, ddof=1)
+        X += np.random.normal(0, 0.0001, X.shape)
+        X = X[np.random.permutation(X.shape[0]),:]
+        n = X.shape[0]
+        w = n//3  # sliding window
+
+        gc.collect()
+        print(dataset)
+        t0 = time.time()
+        mst = DynamicMST(X[:w,:])
+        cur = np.arange(w)
+        i = w
+        while i < n:
+            m = np.random.randint(1, 50)
+            mst.insert(X[i:(i+m),:])
+            cur = np.r_[cur, np.arange(i, min(n, i+m))]
+            i += m
+
+            # remove the oldest points and a random one
+            r = np.r_[np.arange(m), np.random.randint(m, len(cur))]
+            mst.remove(r)
+            cur = np.delete(cur, r)
+
+            assert len(mst) == len(cur)
+            assert np.allclose(mst.get_data(), X[cur,:])
+        mst_dist, mst_ind = mst.get_mst()
+        print("    sliding window %10.3fs" % (time.time()-t0,))
+
+        mst_dist_ref, mst_ind_ref = mst_from_distance(X[cur,:], "euclidean")
+        print("    total weight %.6f vs %.6f" % (mst_dist.sum(), mst_dist_ref.sum()))
+        assert np.all(mst_ind >= 0)
+        assert np.allclose(mst_dist,
+            np.sqrt(np.sum((X[cur[mst_ind[:,0]],:]-X[cur[mst_ind[:,1]],:])**2, axis=1)))
+        ds = DisjointSets(len(cur))
+        for j in range(len(cur)-1):
+            ds.union(int(mst_ind[j,0]), int(mst_ind[j,1]))
+        assert ds.get_k() == 1
+        assert mst_dist_ref.sum()-1e-9 <= mst_dist.sum() <= mst_dist_ref.sum()*1.001
+
+    try:
+        mst.remove([0, 0])
+        assert False
+    except ValueError:
+        pass
+
+
+def test_partial_fit():
+    np.random.seed(123)
+    for dataset in ["jain", "pathbased", "h2mg_64_50"]:
+        X = np.loadtxt("%s/%s.data.gz" % (path,dataset), ndmin=2)
+        labels = np.loadtxt("%s/%s.labels0.gz" % (path,dataset), dtype=np.intp)-1
+        k = len(np.unique(labels[labels>=0]))
+        X = (X-X.mean(axis=0))/X.std(axis=None, ddof=1)
+        X += np.random.normal(0, 0.0001, X.shape)
+        X = X[np.random.permutation(X.shape[0]),:]
+        n = X.shape[0]
+
+        for g in [Genie(k), GIc(k)]:
+            gc.collect()
+            print(dataset, type(g).__name__)
+            ref = g.fit_predict(X)
+
+            t0 = time.time()
+            g.partial_fit(X[:n//2,:])
+            assert g.labels_.shape == (n//2,)
+            for i in range(n//2, n, 100):
+                g.partial_fit(X[i:(i+100),:])
+            print("    partial_fit %10.3fs" % (time.time()-t0,))
+
+            assert g.n_samples_ == n
+            assert g.labels_.shape == (n,)
+            assert g._mst_ind_.shape == (n-1, 2)
+            assert g._predict_index_ is None  # built on demand
+            ari = adjusted_rand_score(g.labels_, ref)
+            print("    ARI=%.3f" % ari)
+            assert ari > 0.9
+            assert np.all(g.predict(X) == g.labels_)
+
+            # fit() starts from scratch
+            assert np.all(g.fit_predict(X) == ref)
+
+            # sliding window
+            g.partial_fit(X[:n//2,:])
+            g.partial_fit(X[n//2:,:], remove=np.arange(n//4))
+            assert g.n_samples_ == n-n//4
+            assert g._predict_index_ is None  # built on demand
+            assert np.all(g.predict(X[n//4:,:]) == g.labels_)
+            ari = adjusted_rand_score(g.labels_, g.fit_predict(X[n//4:,:]))
+            print("    ARI=%.3f" % ari)
+            assert ari > 0.9
+
+
+    g = Genie(2, M=2)
+    try:
+        g.partial_fit(X)
+        assert False
+    except NotImplementedError:
+        pass
+
+
+if __name__ == "__main__":
+    test_dynamic_mst()
+    test_dynamic_mst_remove()
+    test_partial_fit()
@@ -0,0 +1,154 @@
+import numpy as np
+from genieclust.genie import *
+import scipy.spatial.distance
+import time
+import gc
+import tempfile
+
+import os
+if os.path.exists("benchmark_data"):
+    path = "benchmark_data"
+else:
+    path = "../benchmark_data"
+
+
+
+def predict_check(g, X, Y, metric):
+    D = scipy.spatial.distance.cdist(Y, X, metric=metric)
+    labels = g.labels_ if g.labels_.ndim == 1 else g.labels_[-1,:]
+    ind = np.flatnonzero(labels >= 0)
+    D = D[:,ind]
+    if g.M > 1:
+        D = np.maximum(D, g._d_core_[ind].reshape(1, -1))
+    nn_ind = np.argmin(D, axis=1)
+    nn_dist = D[np.arange(D.shape[0]), nn_ind]
+    res_ref = labels[ind][nn_ind]
+    if g.M > 1 and g.postprocess != "all":
+        res_ref[nn_dist > g._d_core_[ind][nn_ind]] = -1
+
+    t0 = time.time()
+    res = g.predict(Y)
+    print("    predict %10.3fs" % (time.time()-t0,))
+
+    assert res.shape == (Y.shape[0],)
+    assert np.all(res == res_ref)
+    return True
+
+
+def test_predict():
+    np.random.seed(123)
+    for dataset in ["jain", "pathbased", "h2mg_64_50"]:
+        X = np.loadtxt("%s/%s.data.gz" % (path,dataset), ndmin=2)
+        labels = np.loadtxt("%s/%s.labels0.gz" % (path,dataset), dtype=np.intp)-1
+        k = len(np.unique(labels[labels>=0]))
+
+        # center X + scale (NOT: standardize!)
+        X = (X-X.mean(axis=0))/X.std(axis=None, ddof=1)
+        X += np.random.normal(0, 0.0001, X.shape)
+        Y = X[np.random.choice(X.shape[0], 100),:]+np.random.normal(0, 0.05, (100, X.shape[1]))
+
+        for metric in ["euclidean", "cityblock", "cosine"]:
+            for M in [1, 2, 5]:
+                for postprocess in ["boundary", "all"]:
+                    gc.collect()
+                    print(dataset, metric, M, postprocess)
+                    g = Genie(k, M=M, affinity=metric,
+                        postprocess=postprocess, cast_float32=False)
+                    res = g.fit_predict(X)
+
+                    if M == 1:
+                        # the fitted points are their own nearest neighbours
+                        assert np.all(g.predict(X) == res)
+
+                    predict_check(g, X, Y, metric)
+
+
+def test_predict_precomputed():
+    np.random.seed(123)
+    X = np.random.normal(size=(500, 2))
+    X[:250,:] += 10.0
+    D = scipy.spatial.distance.squareform(scipy.spatial.distance.pdist(X))
+    Y = np.random.normal(size=(100, 2))
+    Y[:50,:] += 10.0
+    for M in [1, 3]:
+        g1 = Genie(2, M=M, postprocess="all", cast_float32=False)
+        g2 = Genie(2, M=M, postprocess="all", affinity="precomputed")
+        res1 = g1.fit(X).predict(Y)
+        res2 = g2.fit(D).predict(scipy.spatial.distance.cdist(Y, X))
+        assert np.all(res1 == res2)
+        assert np.all(res1[:50] == res1[0]) and np.all(res1[50:] == res1[50])
+        assert res1[0] != res1[50]
+
+
+def test_predict_lazy():
+    np.random.seed(123)
+    X = np.random.normal(size=(1000, 3))
+    X[:500,:] += 10.0
+    Y = np.random.normal(size=(100, 3))
+    Y[:50,:] += 10.0
+    with tempfile.TemporaryDirectory() as tmpdir:
+        fname = os.path.join(tmpdir, "X.bin")
+        Xm = np.memmap(fname, dtype=np.float64, mode="w+", shape=X.shape)
+        Xm[:,:] = X
+        Xm.flush()
+        Xm = np.memmap(fname, dtype=np.float64, mode="r", shape=X.shape)
+        X16 = X.astype(np.float16)
+        for Z in [Xm, X16]:
+            for M in [1, 3]:
+                g = Genie(2, M=M)
+                g.fit(Z)
+                assert g._predict_index_ is None  # built on demand
+                predict_check(g, Z.astype(np.float64), Y, "euclidean")
+                assert g._predict_index_ is not None
+        del g, Xm
+
+
+
+def test_nnindex_queries():
+    # the index is built once and queried repeatedly
+    import scipy.sparse
+    import genieclust.internal
+    np.random.seed(123)
+    for d in [5, 70, 150]:
+        X = np.random.normal(size=(300, d))
+        d_core = np.random.rand(300)*d**0.5
+        Ys = [np.random.normal(size=(m, d)) for m in [1, 40, 7]]
+        for metric, sp_metric in [("euclidean", "euclidean"),
+                ("manhattan", "cityblock"), ("cosine", "cosine"),
+                ("chebyshev", "chebyshev")]:
+            for c in [None, d_core]:
+                idx = genieclust.internal.NNIndex(X, metric=metric,
+                    d_core=c, quantize=(d > 100))
+                for Y in Ys:
+                    D = scipy.spatial.distance.cdist(Y, X, sp_metric)
+                    if c is not None: D = np.maximum(D, c.reshape(1, -1))
+                    nn_dist, nn_ind = idx.query(Y)
+                    assert np.allclose(nn_dist, D.min(axis=1))
+                    assert np.all(nn_ind == D.argmin(axis=1))
+
+        Xs = X*(np.random.rand(300, d) < 0.5)
+        Xs[:,0] = 1.0  # no zero rows
+        Xs = scipy.sparse.csr_matrix(Xs)
+        for metric, sp_metric in [("euclidean", "euclidean"),
+                ("manhattan", "cityblock"), ("cosine", "cosine")]:
+            idx = genieclust.internal.NNIndex(Xs, metric=metric)
+            for Y in [Xs[250:,:], Xs[:3,:]]:
+                D = scipy.spatial.distance.cdist(Y.toarray(), Xs.toarray(),
+                    sp_metric)
+                nn_dist, nn_ind = idx.query(Y)
+                assert np.allclose(nn_dist, D.min(axis=1))
+
+    B = np.random.rand(300, 100) < 0.3
+    for metric in ["hamming", "jaccard"]:
+        idx = genieclust.internal.NNIndex(B, metric=metric)
+        for Y in [B[:10,:], np.random.rand(20, 100) < 0.3]:
+            D = scipy.spatial.distance.cdist(Y, B, metric)
+            nn_dist, nn_ind = idx.query(Y)
+            assert np.allclose(nn_dist, D.min(axis=1))
+
+
+if __name__ == "__main__":
+    test_predict()
+    test_predict_precomputed()
+    test_predict_lazy()
+    test_nnindex_queries()
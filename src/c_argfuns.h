@@ -101,7 +101,9 @@ void Cargsort(ssize_t* ret, const T* x, ssize_t n, bool stable=true)
  *  or almost sorted (increasingly) data.
  *
  *
- *  If buf is not NULL, it must be of length at least k+1.
+ *  If buf is not NULL, it must be of length at least k+1;
+ *  on output, buf[0], ..., buf[k] give the indices of the k+1 smallest
+ *  values in x, in the order of their (stable) ranks.
  *
  *  @param x data
  *  @param n length of x
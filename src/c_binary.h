@@ -0,0 +1,203 @@
+/*  Distances Between Bit-Packed Binary Vectors
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_binary_h
+#define __c_binary_h
+
+#include "c_common.h"
+#include "c_distance.h"
+#include <cstdint>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! Returns the number of bits set in x.
+ *
+ *  If the popcnt instruction is available, the compiler's builtin
+ *  is used; otherwise, a branch-free bit-twiddling variant is applied,
+ *  which, unlike the builtin (a library call in such a case),
+ *  can be vectorised.
+ */
+inline uint64_t __popcount64(uint64_t x)
+{
+#if (defined(__GNUC__) || defined(__clang__)) && \
+        (defined(__POPCNT__) || defined(__aarch64__))
+    return (uint64_t)__builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+    x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+    return (x * UINT64_C(0x0101010101010101)) >> 56;
+#endif
+}
+
+
+/*! Returns the number of bits set in both x and y, each of w words.
+ *
+ *  With -mavx512vpopcntdq, the loop is vectorised to VPOPCNTQ.
+ */
+inline ssize_t __popcount_and(const uint64_t* x, const uint64_t* y, ssize_t w)
+{
+    uint64_t s = 0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:s)
+#endif
+    for (ssize_t u=0; u<w; ++u)
+        s += __popcount64(x[u] & y[u]);
+    return (ssize_t)s;
+}
+
+
+
+/*! (internal) A base class for the distances between bit-packed
+ *  binary vectors: the i-th point is given by the bits of X[i*w],
+ *  ..., X[i*w+w-1] (e.g., as generated by genieclust.internal.pack_bits()).
+ *
+ *  The numbers of bits set in each point are precomputed;
+ *  then, |x XOR y| = |x|+|y|-2|x AND y| and |x OR y| = |x|+|y|-|x AND y|,
+ *  therefore a single popcount pass is needed for each pair of points.
+ *
+ *  operator()(i, M, k) calls DERIVED::pairwise(i, M[j]) for each j
+ *  (in parallel).
+ */
+template<class T, class DERIVED>
+struct __CDistanceBinary : public CDistance<T> {
+    const uint64_t* X;
+    ssize_t n;
+    ssize_t w;
+    ssize_t d;
+    const uint64_t* Y;  // query points, see set_queries_bits()
+    ssize_t m;
+    std::vector<ssize_t> count;
+    std::vector<T> buf;
+
+    /*!
+     * @param X n*w c_contiguous array of 64-bit words
+     * @param n number of points
+     * @param w number of words per point
+     * @param d number of bits per point (features), d <= 64*w;
+     *     the remaining (padding) bits must be zero
+     */
+    __CDistanceBinary(const uint64_t* X, ssize_t n, ssize_t w, ssize_t d)
+        : X(X), n(n), w(w), d(d), Y(NULL), m(0), count(n), buf(n)
+    {
+        for (ssize_t i=0; i<n; ++i)
+            count[i] = __popcount_and(row(i), row(i), w);
+    }
+
+    /*! Returns the i-th point (an indexed or a query one) */
+    inline const uint64_t* row(ssize_t i) const {
+        return (i < n)?(X+i*w):(Y+(i-n)*w);
+    }
+
+    /*! See CDistance::set_queries_bits(); Y is an m*w array */
+    virtual void set_queries_bits(const uint64_t* Y, ssize_t m) {
+        this->Y = Y;
+        this->m = m;
+        count.resize(n+m);
+        for (ssize_t i=n; i<n+m; ++i)
+            count[i] = __popcount_and(row(i), row(i), w);
+    }
+
+    /*! Returns |x_i AND x_j| */
+    inline ssize_t count_and(ssize_t i, ssize_t j) const {
+        return __popcount_and(row(i), row(j), w);
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+        const DERIVED* self = static_cast<const DERIVED*>(this);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t v = M[j];
+            // GENIECLUST_ASSERT(v>=0 && v<n)
+            __buf[v] = self->pairwise(i, v);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! The Hamming distances between bit-packed binary vectors,
+ *  i.e., the proportions of the disagreeing bits
+ *  (like in scipy.spatial.distance.hamming).
+ */
+template<class T>
+struct CDistanceHamming : public __CDistanceBinary< T, CDistanceHamming<T> > {
+
+    /*! See __CDistanceBinary */
+    CDistanceHamming(const uint64_t* X, ssize_t n, ssize_t w, ssize_t d)
+        : __CDistanceBinary< T, CDistanceHamming<T> >(X, n, w, d)
+    {
+        if (d <= 0 || d > 64*w) throw std::domain_error("d not in [1, 64*w]");
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        ssize_t nxor = this->count[i]+this->count[j]-2*this->count_and(i, j);
+        return (T)nxor/(T)this->d;
+    }
+};
+
+
+
+/*! The Jaccard distances between bit-packed binary vectors,
+ *  i.e., |x XOR y|/|x OR y|, with 0/0 = 0
+ *  (like in scipy.spatial.distance.jaccard).
+ */
+template<class T>
+struct CDistanceJaccardBits : public __CDistanceBinary< T, CDistanceJaccardBits<T> > {
+
+    /*! See __CDistanceBinary */
+    CDistanceJaccardBits(const uint64_t* X, ssize_t n, ssize_t w, ssize_t d)
+        : __CDistanceBinary< T, CDistanceJaccardBits<T> >(X, n, w, d)
+    { }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        ssize_t nand = this->count_and(i, j);
+        ssize_t nor  = this->count[i]+this->count[j]-nand;
+        if (nor == 0) return 0.0;
+        return (T)(nor-nand)/(T)nor;
+    }
+};
+
+
+#endif
@@ -0,0 +1,580 @@
+/*  Delaunay triangulations in the plane and Euclidean minimum spanning trees
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_delaunay_h
+#define __c_delaunay_h
+
+#include "c_common.h"
+#include "c_mst.h"
+#include "c_reorder.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! (internal) Floating-point expansions (sums of nonoverlapping doubles,
+ *  in the order of increasing magnitude) used to evaluate the geometric
+ *  predicates exactly when the approximate evaluation is not conclusive,
+ *  see J.R. Shewchuk, Adaptive precision floating-point arithmetic
+ *  and fast robust geometric predicates, Discrete Comput. Geom. 18 (1997)
+ *  305–363.
+ */
+struct __CExpansion
+{
+    std::vector<double> e;
+
+    __CExpansion() : e(1, 0.0) { }
+    __CExpansion(double a) : e(1, a) { }
+
+    static inline void two_sum(double a, double b, double& x, double& y) {
+        x = a+b;
+        double bv = x-a;
+        double av = x-bv;
+        y = (a-av)+(b-bv);
+    }
+
+    static inline void two_product(double a, double b, double& x, double& y) {
+        x = a*b;
+        y = std::fma(a, b, -x);  // exact
+    }
+
+    /*! the exact difference a-b */
+    static __CExpansion diff(double a, double b) {
+        __CExpansion r;
+        double x, y;
+        two_sum(a, -b, x, y);
+        r.e[0] = y;
+        r.e.push_back(x);
+        return r;
+    }
+
+    /*! returns this+b */
+    __CExpansion grow(double b) const {
+        __CExpansion r;
+        r.e.clear();
+        double q = b;
+        for (double ei: e) {
+            double qnew, h;
+            two_sum(q, ei, qnew, h);
+            if (h != 0.0) r.e.push_back(h);
+            q = qnew;
+        }
+        if (q != 0.0 || r.e.empty()) r.e.push_back(q);
+        return r;
+    }
+
+    /*! returns this*b */
+    __CExpansion scale(double b) const {
+        __CExpansion r;
+        r.e.clear();
+        double q, h;
+        two_product(e[0], b, q, h);
+        if (h != 0.0) r.e.push_back(h);
+        for (size_t i=1; i<e.size(); ++i) {
+            double p1, p0, sum;
+            two_product(e[i], b, p1, p0);
+            two_sum(q, p0, sum, h);
+            if (h != 0.0) r.e.push_back(h);
+            two_sum(p1, sum, q, h);
+            if (h != 0.0) r.e.push_back(h);
+        }
+        if (q != 0.0 || r.e.empty()) r.e.push_back(q);
+        return r;
+    }
+
+    __CExpansion operator+(const __CExpansion& f) const {
+        __CExpansion r = *this;
+        for (double fi: f.e) r = r.grow(fi);
+        return r;
+    }
+
+    __CExpansion operator-(const __CExpansion& f) const {
+        __CExpansion r = *this;
+        for (double fi: f.e) r = r.grow(-fi);
+        return r;
+    }
+
+    __CExpansion operator*(const __CExpansion& f) const {
+        __CExpansion r;
+        for (double fi: f.e) r = r+scale(fi);
+        return r;
+    }
+
+    /*! the sign of the represented value: that of the largest component */
+    inline int sign() const {
+        double v = e.back();
+        return (v > 0.0)-(v < 0.0);
+    }
+};
+
+
+
+/*! Returns a positive value if the points a, b, c (pairs of coordinates)
+ *  occur in the counterclockwise order, a negative one if they occur
+ *  in the clockwise order, and 0 if they are collinear.
+ *
+ *  The sign is always correct: if the floating-point evaluation
+ *  is not conclusive, exact arithmetic is used.
+ */
+inline int Corient2d(const double* a, const double* b, const double* c)
+{
+    double detleft  = (a[0]-c[0])*(b[1]-c[1]);
+    double detright = (a[1]-c[1])*(b[0]-c[0]);
+    double det = detleft-detright;
+    const double eps = std::numeric_limits<double>::epsilon()*0.5;
+    double errbound = (3.0+16.0*eps)*eps*(fabs(detleft)+fabs(detright));
+    if (det > errbound)  return 1;
+    if (-det > errbound) return -1;
+
+    __CExpansion e = __CExpansion::diff(a[0], c[0])*__CExpansion::diff(b[1], c[1])
+                   - __CExpansion::diff(a[1], c[1])*__CExpansion::diff(b[0], c[0]);
+    return e.sign();
+}
+
+
+/*! Returns a positive value if the point d lies inside the circle
+ *  passing through a, b, c (which occur in the counterclockwise order),
+ *  a negative one if it lies outside, and 0 if the four points
+ *  are cocircular.
+ *
+ *  The sign is always correct (see Corient2d()).
+ */
+inline int Cincircle(const double* a, const double* b, const double* c,
+    const double* d)
+{
+    double adx = a[0]-d[0], ady = a[1]-d[1];
+    double bdx = b[0]-d[0], bdy = b[1]-d[1];
+    double cdx = c[0]-d[0], cdy = c[1]-d[1];
+
+    double bdxcdy = bdx*cdy, cdxbdy = cdx*bdy;
+    double cdxady = cdx*ady, adxcdy = adx*cdy;
+    double adxbdy = adx*bdy, bdxady = bdx*ady;
+    double alift = adx*adx+ady*ady;
+    double blift = bdx*bdx+bdy*bdy;
+    double clift = cdx*cdx+cdy*cdy;
+
+    double det = alift*(bdxcdy-cdxbdy)+blift*(cdxady-adxcdy)+clift*(adxbdy-bdxady);
+    double permanent = (fabs(bdxcdy)+fabs(cdxbdy))*alift
+                     + (fabs(cdxady)+fabs(adxcdy))*blift
+                     + (fabs(adxbdy)+fabs(bdxady))*clift;
+    const double eps = std::numeric_limits<double>::epsilon()*0.5;
+    double errbound = (10.0+96.0*eps)*eps*permanent;
+    if (det > errbound)  return 1;
+    if (-det > errbound) return -1;
+
+    __CExpansion eadx = __CExpansion::diff(a[0], d[0]);
+    __CExpansion eady = __CExpansion::diff(a[1], d[1]);
+    __CExpansion ebdx = __CExpansion::diff(b[0], d[0]);
+    __CExpansion ebdy = __CExpansion::diff(b[1], d[1]);
+    __CExpansion ecdx = __CExpansion::diff(c[0], d[0]);
+    __CExpansion ecdy = __CExpansion::diff(c[1], d[1]);
+    __CExpansion e =
+          (eadx*eadx+eady*eady)*(ebdx*ecdy-ecdx*ebdy)
+        + (ebdx*ebdx+ebdy*ebdy)*(ecdx*eady-eadx*ecdy)
+        + (ecdx*ecdx+ecdy*ecdy)*(eadx*ebdy-ebdx*eady);
+    return e.sign();
+}
+
+
+
+/*! A Delaunay triangulation of a set of distinct, not all collinear
+ *  points in the plane, constructed incrementally by means of
+ *  the Bowyer–Watson algorithm.
+ *
+ *  The points are inserted in the order of the Z-order (Morton) curve
+ *  (see Cmorton_order()), and each one is located by a visibility walk
+ *  starting at a triangle created in the previous step, which takes
+ *  O(1) steps on average; overall, the expected run time is O(n log n),
+ *  dominated by the sorting.
+ *
+ *  The triangles are stored in the counterclockwise order. The convex
+ *  hull's edges are adjacent to "ghost" triangles sharing a vertex
+ *  at infinity (GHOST), so that the points outside of the current hull
+ *  need no special treatment. The predicates are exact
+ *  (see Corient2d() and Cincircle()), hence the result is a valid
+ *  Delaunay triangulation even for degenerate inputs
+ *  (e.g., points on a grid).
+ */
+class CDelaunay
+{
+protected:
+    static const ssize_t GHOST = -1;
+
+    struct Triangle {
+        ssize_t v[3];    //!< vertices (counterclockwise), possibly GHOST
+        ssize_t nbr[3];  //!< nbr[k] - the triangle across the edge opposite v[k]
+        bool alive;
+    };
+
+    struct Boundary { ssize_t a, b, outer; };
+
+    const double* X;  //!< n*2 c_contiguous array
+    ssize_t n;
+    std::vector<Triangle> tri;
+    std::vector<ssize_t> free_tri;
+    std::vector<ssize_t> stamp;    // the last insertion that visited a triangle
+    std::vector<ssize_t> by_start; // scratch: new triangles by their 1st vertex
+    std::vector<ssize_t> by_end;   // scratch: new triangles by their 2nd vertex
+    ssize_t last;                  // a live, non-ghost triangle
+    uint64_t rng;
+    std::vector<ssize_t> stack, cavity, created;  // scratch, see insert()
+    std::vector<Boundary> boundary;
+
+
+    inline const double* pt(ssize_t i) const { return X+2*i; }
+
+    inline bool is_ghost(ssize_t t) const {
+        const Triangle& tt = tri[t];
+        return tt.v[0] == GHOST || tt.v[1] == GHOST || tt.v[2] == GHOST;
+    }
+
+
+    /*! whether p is strictly inside the circumcircle of t;
+     *  for a ghost triangle (a, b, GHOST): whether p lies strictly
+     *  on the outer side of the hull edge ab, or in its relative interior
+     */
+    bool in_conflict(ssize_t t, ssize_t p) const
+    {
+        const Triangle& tt = tri[t];
+        for (ssize_t k=0; k<3; ++k) {
+            if (tt.v[k] != GHOST) continue;
+            const double* a = pt(tt.v[(k+1)%3]);
+            const double* b = pt(tt.v[(k+2)%3]);
+            const double* c = pt(p);
+            int o = Corient2d(a, b, c);
+            if (o != 0) return o > 0;
+            // collinear:
+            if (a[0] != b[0])
+                return std::min(a[0], b[0]) < c[0] && c[0] < std::max(a[0], b[0]);
+            else
+                return std::min(a[1], b[1]) < c[1] && c[1] < std::max(a[1], b[1]);
+        }
+        return Cincircle(pt(tt.v[0]), pt(tt.v[1]), pt(tt.v[2]), pt(p)) > 0;
+    }
+
+
+    ssize_t new_triangle(ssize_t a, ssize_t b, ssize_t c)
+    {
+        ssize_t t;
+        if (!free_tri.empty()) {
+            t = free_tri.back();
+            free_tri.pop_back();
+        }
+        else {
+            t = (ssize_t)tri.size();
+            tri.push_back(Triangle());
+            stamp.push_back(-1);
+        }
+        Triangle& tt = tri[t];
+        tt.v[0] = a; tt.v[1] = b; tt.v[2] = c;
+        tt.nbr[0] = tt.nbr[1] = tt.nbr[2] = -1;
+        tt.alive = true;
+        return t;
+    }
+
+
+    /*! a triangle in conflict with p: the one that contains it or
+     *  a ghost triangle whose hull edge p is beyond
+     */
+    ssize_t locate(ssize_t p)
+    {
+        ssize_t t = last;
+        while (true) {
+            if (is_ghost(t)) return t;
+            const Triangle& tt = tri[t];
+            rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;  // xorshift
+            ssize_t k0 = (ssize_t)(rng%3);
+            ssize_t next = -1;
+            for (ssize_t u=0; u<3; ++u) {
+                ssize_t k = (k0+u)%3;
+                if (Corient2d(pt(tt.v[(k+1)%3]), pt(tt.v[(k+2)%3]), pt(p)) < 0) {
+                    next = tt.nbr[k];
+                    break;
+                }
+            }
+            if (next < 0) return t;
+            t = next;
+        }
+    }
+
+
+    /*! adds the p-th point: removes all the triangles in conflict with it
+     *  (they form a star-shaped cavity) and connects p with the cavity's
+     *  boundary
+     */
+    void insert(ssize_t p)
+    {
+        ssize_t t0 = locate(p);
+        GENIECLUST_ASSERT(in_conflict(t0, p));
+
+        stack.assign(1, t0);
+        cavity.clear();
+        boundary.clear();
+        stamp[t0] = p;
+        tri[t0].alive = false;  // marks membership in the cavity
+        while (!stack.empty()) {
+            ssize_t t = stack.back();
+            stack.pop_back();
+            cavity.push_back(t);
+            for (ssize_t k=0; k<3; ++k) {
+                ssize_t s = tri[t].nbr[k];
+                if (stamp[s] == p && !tri[s].alive) continue;  // already in the cavity
+                if (stamp[s] != p && in_conflict(s, p)) {
+                    stamp[s] = p;
+                    tri[s].alive = false;  // marks membership in the cavity
+                    stack.push_back(s);
+                }
+                else if (tri[s].alive) {
+                    stamp[s] = p;
+                    boundary.push_back(Boundary{tri[t].v[(k+1)%3], tri[t].v[(k+2)%3], s});
+                }
+            }
+        }
+
+        // the new triangles (a, b, p), where ab is a boundary edge
+        created.resize(boundary.size());
+        for (size_t u=0; u<boundary.size(); ++u) {
+            const Boundary& e = boundary[u];
+            ssize_t t = new_triangle(e.a, e.b, p);
+            created[u] = t;
+            by_start[e.a+1] = t;  // GHOST == -1
+            by_end[e.b+1] = t;
+
+            // link with the outer neighbour
+            Triangle& so = tri[e.outer];
+            for (ssize_t k=0; k<3; ++k) {
+                if (so.v[(k+1)%3] == e.b && so.v[(k+2)%3] == e.a) {
+                    so.nbr[k] = t;
+                    break;
+                }
+            }
+            tri[t].nbr[2] = e.outer;
+        }
+        for (size_t u=0; u<created.size(); ++u) {
+            Triangle& tt = tri[created[u]];
+            tt.nbr[0] = by_start[tt.v[1]+1];  // the edge (b, p)
+            tt.nbr[1] = by_end[tt.v[0]+1];    // the edge (p, a)
+            if (tt.v[0] != GHOST && tt.v[1] != GHOST) last = created[u];
+        }
+
+        for (ssize_t t: cavity) free_tri.push_back(t);
+    }
+
+
+public:
+    /*! Triangulates n distinct points, not all collinear.
+     *
+     *  @param X n*2 c_contiguous array; it must outlive this object
+     *  @param n number of points
+     */
+    CDelaunay(const double* X, ssize_t n)
+        : X(X), n(n), by_start(n+1, -1), by_end(n+1, -1), rng(0x9E3779B97F4A7C15ULL)
+    {
+        if (n < 3) throw std::domain_error("n < 3");
+
+        std::vector<ssize_t> perm(n);
+        Cmorton_order(X, n, 2, perm.data());
+
+        // the initial triangle: the first two points and the first point
+        // not collinear with them (in the Morton order)
+        ssize_t a = perm[0], b = perm[1], c = -1, o = 0;
+        for (ssize_t i=2; i<n; ++i) {
+            o = Corient2d(pt(a), pt(b), pt(perm[i]));
+            if (o != 0) { c = perm[i]; break; }
+        }
+        if (c < 0) throw std::domain_error("all the points are collinear");
+        if (o < 0) std::swap(a, b);
+
+        tri.reserve(2*n+4);
+        stamp.reserve(2*n+4);
+        ssize_t t = new_triangle(a, b, c);
+        ssize_t gab = new_triangle(b, a, GHOST);
+        ssize_t gbc = new_triangle(c, b, GHOST);
+        ssize_t gca = new_triangle(a, c, GHOST);
+        tri[t].nbr[0] = gbc; tri[t].nbr[1] = gca; tri[t].nbr[2] = gab;
+        // ghost (x, y, GHOST): nbr[2] - the real triangle,
+        // nbr[0] - the ghost sharing (y, GHOST), nbr[1] - the one sharing (GHOST, x)
+        tri[gab].nbr[2] = t; tri[gab].nbr[0] = gca; tri[gab].nbr[1] = gbc;
+        tri[gbc].nbr[2] = t; tri[gbc].nbr[0] = gab; tri[gbc].nbr[1] = gca;
+        tri[gca].nbr[2] = t; tri[gca].nbr[0] = gbc; tri[gca].nbr[1] = gab;
+        last = t;
+
+        for (ssize_t i=0; i<n; ++i) {
+            ssize_t p = perm[i];
+            if (p == a || p == b || p == c) continue;
+            insert(p);
+        }
+    }
+
+
+    /*! Returns the edges of the triangulation (each one once,
+     *  with the smaller index first); there are at most 3n-6 of them.
+     */
+    void get_edges(std::vector<ssize_t>& edges) const
+    {
+        edges.clear();
+        for (const Triangle& tt: tri) {
+            if (!tt.alive) continue;
+            for (ssize_t k=0; k<3; ++k) {
+                ssize_t u = tt.v[(k+1)%3], v = tt.v[(k+2)%3];
+                // each edge is shared by two triangles, in opposite directions
+                if (u != GHOST && v != GHOST && u < v) {
+                    edges.push_back(u);
+                    edges.push_back(v);
+                }
+            }
+        }
+    }
+};
+
+
+
+/*! Determines the edges of a Delaunay triangulation of a set of points
+ *  in the plane (a planar graph whose subgraph is a Euclidean
+ *  minimum spanning tree), see CDelaunay.
+ *
+ *  Duplicated points are connected with their first occurrences only.
+ *  If all the points are collinear, then each one is connected with
+ *  its successor along the line.
+ *
+ *  @param X n*2 c_contiguous array
+ *  @param n number of points
+ *  @param edges [out] consecutive pairs of vertices (i < j)
+ */
+template <class T>
+void Cdelaunay_edges(const T* X, ssize_t n, std::vector<ssize_t>& edges)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    edges.clear();
+
+    // identify the duplicates: sort w.r.t. (x, y, index)
+    std::vector<ssize_t> o(n);
+    for (ssize_t i=0; i<n; ++i) o[i] = i;
+    std::sort(o.begin(), o.end(), [X](ssize_t i, ssize_t j) {
+        if (X[2*i+0] != X[2*j+0]) return X[2*i+0] < X[2*j+0];
+        if (X[2*i+1] != X[2*j+1]) return X[2*i+1] < X[2*j+1];
+        return i < j;
+    });
+
+    std::vector<ssize_t> uniq;  // the first occurrences, in the above order
+    std::vector<double> U;      // their coordinates
+    for (ssize_t u=0; u<n; ++u) {
+        ssize_t i = o[u];
+        if (u > 0 && X[2*i+0] == X[2*o[u-1]+0] && X[2*i+1] == X[2*o[u-1]+1]) {
+            edges.push_back(uniq.back());
+            edges.push_back(i);
+            continue;
+        }
+        uniq.push_back(i);
+        U.push_back((double)X[2*i+0]);
+        U.push_back((double)X[2*i+1]);
+    }
+
+    ssize_t m = (ssize_t)uniq.size();
+    bool collinear = true;
+    for (ssize_t i=2; i<m && collinear; ++i)
+        collinear = (Corient2d(U.data(), U.data()+2, U.data()+2*i) == 0);
+
+    if (collinear) {
+        // the lexicographic order is the order along the line
+        for (ssize_t i=1; i<m; ++i) {
+            edges.push_back(std::min(uniq[i-1], uniq[i]));
+            edges.push_back(std::max(uniq[i-1], uniq[i]));
+        }
+        return;
+    }
+
+    CDelaunay tri(U.data(), m);
+    std::vector<ssize_t> e;
+    tri.get_edges(e);
+    for (size_t j=0; j<e.size(); j += 2) {
+        ssize_t u = uniq[e[j]], v = uniq[e[j+1]];
+        edges.push_back(std::min(u, v));
+        edges.push_back(std::max(u, v));
+    }
+}
+
+
+
+/*! Determines a Euclidean minimum spanning tree of a set of points
+ *  in the plane: the MST is a subgraph of a Delaunay triangulation
+ *  (see Cdelaunay_edges()), which has O(n) edges; those are fed to
+ *  Kruskal's algorithm (see Cmst_from_edges()).
+ *
+ *  Overall, the expected run time is O(n log n), compared with O(n^2)
+ *  in Cmst_from_complete().
+ *
+ *  @param X n*2 c_contiguous array
+ *  @param n number of points
+ *  @param mst_dist [out] vector of length n-1, see Cmst_from_complete()
+ *  @param mst_ind [out] vector of length 2*(n-1), see Cmst_from_complete()
+ *  @return the number of the triangulation's edges
+ */
+template <class T>
+ssize_t Cmst_from_delaunay(const T* X, ssize_t n, T* mst_dist, ssize_t* mst_ind)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    if (n == 1) return 0;
+
+    std::vector<ssize_t> edges;
+    Cdelaunay_edges(X, n, edges);
+    ssize_t m = (ssize_t)edges.size()/2;
+
+    std::vector<T> dist(m);
+    const ssize_t* __edges = edges.data();
+    T* __dist = dist.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t j=0; j<m; ++j) {
+        const T* x = X+2*__edges[2*j+0];
+        const T* y = X+2*__edges[2*j+1];
+        __dist[j] = (T)sqrt(square((double)x[0]-(double)y[0])+
+                            square((double)x[1]-(double)y[1]));
+    }
+
+    ssize_t ret = Cmst_from_edges(dist.data(), edges.data(), m, n, mst_dist, mst_ind);
+    GENIECLUST_ASSERT(ret == n-1);
+
+    return m;
+}
+
+
+#endif
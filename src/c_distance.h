@@ -35,8 +35,14 @@
 #define __c_distance_h
 
 #include "c_common.h"
+#include "c_half.h"
+#include "c_quantize.h"
+#include "c_mmap.h"
+#include <cstdint>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <utility>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -48,6 +54,157 @@ template<class T>
 inline T square(T x) { return x*x; }
 
 
+/*! In spaces of at least this dimensionality, CDistanceEuclidean
+ *  computes the squared distances via ||x||^2+||y||^2-2<x,y>
+ */
+#define GENIECLUST_EUCLIDEAN_DOT_MIN_D 64
+
+/*! If ||x||^2+||y||^2-2<x,y> is smaller than this fraction
+ *  of ||x||^2+||y||^2, the result might suffer from catastrophic
+ *  cancellation; hence, it is recomputed as sum((x-y)^2)
+ */
+#define GENIECLUST_EUCLIDEAN_DOT_RECOMPUTE 0.0625
+
+/*! The number of features accumulated between the checks
+ *  in __bounded_distance()
+ */
+#define GENIECLUST_ABANDON_BLOCK 16
+
+/*! pi (M_PI is not a part of the C++ standard) */
+#define GENIECLUST_PI 3.14159265358979323846
+
+
+/*! Computes the 4 dot products between the vector x and
+ *  the vectors y[0], ..., y[3] of length d; out[c] = <x, y[c]>.
+ *
+ *  The accumulators are kept in registers and each element of x
+ *  is loaded once and used 4 times.
+ */
+template<class T>
+inline void __dot_tile_1x4(const T* x, const T* const* y, ssize_t d, T* out)
+{
+    const T* y0 = y[0]; const T* y1 = y[1]; const T* y2 = y[2]; const T* y3 = y[3];
+    T s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    for (ssize_t u=0; u<d; ++u) {
+        T a = x[u];
+        s0 += a*y0[u]; s1 += a*y1[u]; s2 += a*y2[u]; s3 += a*y3[u];
+    }
+    out[0] = s0; out[1] = s1; out[2] = s2; out[3] = s3;
+}
+
+
+/*! Computes the 16 dot products between the vectors x[0], ..., x[3]
+ *  and y[0], ..., y[3] of length d; out[4*r+c] = <x[r], y[c]>.
+ *
+ *  The 16 accumulators are kept in registers and each element
+ *  of x[r] (y[c]) is loaded once and used 4 times.
+ */
+template<class T>
+inline void __dot_tile_4x4(const T* const* x, const T* const* y, ssize_t d, T* out)
+{
+    const T* x0 = x[0]; const T* x1 = x[1]; const T* x2 = x[2]; const T* x3 = x[3];
+    const T* y0 = y[0]; const T* y1 = y[1]; const T* y2 = y[2]; const T* y3 = y[3];
+    T s00 = 0.0, s01 = 0.0, s02 = 0.0, s03 = 0.0;
+    T s10 = 0.0, s11 = 0.0, s12 = 0.0, s13 = 0.0;
+    T s20 = 0.0, s21 = 0.0, s22 = 0.0, s23 = 0.0;
+    T s30 = 0.0, s31 = 0.0, s32 = 0.0, s33 = 0.0;
+    for (ssize_t u=0; u<d; ++u) {
+        T a0 = x0[u], a1 = x1[u], a2 = x2[u], a3 = x3[u];
+        T b0 = y0[u], b1 = y1[u], b2 = y2[u], b3 = y3[u];
+        s00 += a0*b0; s01 += a0*b1; s02 += a0*b2; s03 += a0*b3;
+        s10 += a1*b0; s11 += a1*b1; s12 += a1*b2; s13 += a1*b3;
+        s20 += a2*b0; s21 += a2*b1; s22 += a2*b2; s23 += a2*b3;
+        s30 += a3*b0; s31 += a3*b1; s32 += a3*b2; s33 += a3*b3;
+    }
+    out[ 0] = s00; out[ 1] = s01; out[ 2] = s02; out[ 3] = s03;
+    out[ 4] = s10; out[ 5] = s11; out[ 6] = s12; out[ 7] = s13;
+    out[ 8] = s20; out[ 9] = s21; out[10] = s22; out[11] = s23;
+    out[12] = s30; out[13] = s31; out[14] = s32; out[15] = s33;
+}
+
+
+
+/*! Converts k values stored as S (e.g., CFloat16) to T */
+template<class T, class S>
+inline void __convert(const S* in, T* out, ssize_t k)
+{
+    for (ssize_t i=0; i<k; ++i) out[i] = (T)in[i];
+}
+
+
+/*! Returns x if S is T; otherwise, converts x to T and stores
+ *  the result in buf.
+ */
+template<class T>
+inline const T* __as_T(const T* x, std::vector<T>& /*buf*/, ssize_t /*k*/)
+{
+    return x;
+}
+
+template<class T, class S>
+inline const T* __as_T(const S* x, std::vector<T>& buf, ssize_t k)
+{
+    buf.resize(k);
+    __convert(x, buf.data(), k);
+    return buf.data();
+}
+
+
+/*! (internal) Returns the query points Y (see CDistance::set_queries())
+ *  as S*, which is only possible if S is T (X serves as a type tag).
+ */
+template<class T>
+inline const T* __as_S(const T* Y, const T* /*X*/)
+{
+    return Y;
+}
+
+template<class T, class S>
+inline const S* __as_S(const T* /*Y*/, const S* /*X*/)
+{
+    throw std::domain_error("query points are only supported if the data are stored as T");
+}
+
+
+/*! Variants of __dot_tile_1x4() and __dot_tile_4x4() for vectors
+ *  stored as S (e.g., CFloat16): chunks of the vectors are converted
+ *  to T first (in a vectorisable loop) and then processed
+ *  by the T-kernels. In the former case, x is already a T vector.
+ */
+template<class T, class S>
+inline void __dot_tile_1x4(const T* x, const S* const* y, ssize_t d, T* out)
+{
+    const ssize_t chunk = 256;
+    T yb[4][chunk], tmp[4];
+    const T* yp[4] = { yb[0], yb[1], yb[2], yb[3] };
+    for (ssize_t c=0; c<4; ++c) out[c] = 0.0;
+    for (ssize_t u=0; u<d; u+=chunk) {
+        ssize_t l = std::min(chunk, d-u);
+        for (ssize_t c=0; c<4; ++c) __convert(y[c]+u, yb[c], l);
+        __dot_tile_1x4(x+u, yp, l, tmp);
+        for (ssize_t c=0; c<4; ++c) out[c] += tmp[c];
+    }
+}
+
+
+template<class T, class S>
+inline void __dot_tile_4x4(const S* const* x, const S* const* y, ssize_t d, T* out)
+{
+    const ssize_t chunk = 256;
+    T xb[4][chunk], yb[4][chunk], tmp[16];
+    const T* xp[4] = { xb[0], xb[1], xb[2], xb[3] };
+    const T* yp[4] = { yb[0], yb[1], yb[2], yb[3] };
+    for (ssize_t c=0; c<16; ++c) out[c] = 0.0;
+    for (ssize_t u=0; u<d; u+=chunk) {
+        ssize_t l = std::min(chunk, d-u);
+        for (ssize_t r=0; r<4; ++r) __convert(x[r]+u, xb[r], l);
+        for (ssize_t c=0; c<4; ++c) __convert(y[c]+u, yb[c], l);
+        __dot_tile_4x4(xp, yp, l, tmp);
+        for (ssize_t c=0; c<16; ++c) out[c] += tmp[c];
+    }
+}
+
+
 
 /*! Abstract base class for all distances */
 template<class T>
@@ -64,6 +221,38 @@ struct CDistance {
      *         the function is not thread-safe
      */
     virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) = 0;
+
+    /*! Sets the query points, which are numbered n, n+1, ..., n+m-1 then,
+     *  where n is the number of the indexed points; see Cnn_from_distance().
+     *  This way, the auxiliary data on the indexed points (e.g., the norms)
+     *  are not recomputed for each batch of queries.
+     *
+     *  Only the distances between the query and the indexed points
+     *  are supported; the query points are not copied.
+     *
+     *  @param Y m*d c_contiguous array (data of the same form
+     *     as the indexed points)
+     *  @param m number of query points
+     */
+    virtual void set_queries(const T* /*Y*/, ssize_t /*m*/) {
+        throw std::domain_error("query points are not supported");
+    }
+
+    /*! Like set_queries(), but for the distances between the rows
+     *  of CSR matrices, see CCsrMatrix
+     */
+    virtual void set_queries_csr(const T* /*data*/, const ssize_t* /*indices*/,
+        const ssize_t* /*indptr*/, ssize_t /*m*/)
+    {
+        throw std::domain_error("query points are not supported");
+    }
+
+    /*! Like set_queries(), but for the distances between bit-packed
+     *  binary vectors, see __CDistanceBinary
+     */
+    virtual void set_queries_bits(const uint64_t* /*Y*/, ssize_t /*m*/) {
+        throw std::domain_error("query points are not supported");
+    }
 };
 
 
@@ -71,11 +260,15 @@ struct CDistance {
 /*! A class to "compute" the distances from the i-th point
  *  to all n points based on a pre-computed n*n symmetric,
  *  complete pairwise distance c_contiguous matrix.
+ *
+ *  If the matrix is memory-mapped (see set_mapped()), the rows
+ *  can be prefetched as a whole, see prefetch().
  */
 template<class T>
 struct CDistanceCompletePrecomputed : public CDistance<T> {
     const T* dist;
     ssize_t n;
+    bool mapped;
 
     /*!
      * @param dist n*n c_contiguous array, dist[i,j] is the distance between
@@ -85,11 +278,31 @@ struct CDistanceCompletePrecomputed : public CDistance<T> {
     CDistanceCompletePrecomputed(const T* dist, ssize_t n) {
         this->n = n;
         this->dist = dist;
+        this->mapped = false;
     }
 
     CDistanceCompletePrecomputed()
         : CDistanceCompletePrecomputed(NULL, 0) { }
 
+    /*! Marks the matrix as backed by a memory-mapped file:
+     *  the rows are accessed in a random order,
+     *  hence no read-ahead beyond what prefetch() requests.
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(dist, sizeof(T)*n*n, GENIECLUST_ADVICE_RANDOM);
+    }
+
+    /*! Requests the i-th row be read (if mapped) */
+    inline void prefetch(ssize_t i) const {
+        if (mapped) Cmadvise(dist+i*n, sizeof(T)*n, GENIECLUST_ADVICE_WILLNEED);
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        return dist[i*n+j];
+    }
+
     virtual const T* operator()(ssize_t i, const ssize_t* /*M*/, ssize_t /*k*/) {
         return &this->dist[i*n]; // the i-th row of dist
     }
@@ -97,19 +310,208 @@ struct CDistanceCompletePrecomputed : public CDistance<T> {
 
 
 
+/*! A class to "compute" the distances from the i-th point
+ *  to all n points based on a pre-computed condensed distance vector,
+ *  i.e., the upper triangle of the n*n pairwise distance matrix (without
+ *  the diagonal) stored row by row, as returned by scipy.spatial.distance.pdist.
+ *  Twice less memory than with CDistanceCompletePrecomputed is needed.
+ *
+ *  The distance between the i-th and the j-th point, i<j,
+ *  is stored at index n*i-i*(i+1)/2+j-i-1.
+ */
+template<class T>
+struct CDistanceCondensedPrecomputed : public CDistance<T> {
+    const T* dist;
+    ssize_t n;
+    bool mapped;
+    std::vector<T> buf;
+
+    /*!
+     * @param dist c_contiguous array of length n*(n-1)/2
+     * @param n number of points
+     */
+    CDistanceCondensedPrecomputed(const T* dist, ssize_t n)
+            : buf(n)
+    {
+        this->n = n;
+        this->dist = dist;
+        this->mapped = false;
+    }
+
+    CDistanceCondensedPrecomputed()
+        : CDistanceCondensedPrecomputed(NULL, 0) { }
+
+    /*! Marks the vector as backed by a memory-mapped file,
+     *  see CDistanceCompletePrecomputed::set_mapped()
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(dist, sizeof(T)*((n*(n-1))/2), GENIECLUST_ADVICE_RANDOM);
+    }
+
+    /*! Requests the contiguous part of the i-th row, i.e., the distances
+     *  to the points j>i, be read (if mapped); the remaining ones are
+     *  scattered (one per row of the upper triangle)
+     */
+    inline void prefetch(ssize_t i) const {
+        if (mapped && i < n-1)
+            Cmadvise(dist+(i*(2*n-i-1))/2, sizeof(T)*(n-i-1), GENIECLUST_ADVICE_WILLNEED);
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        if (i == j) return 0.0;
+        if (i > j) std::swap(i, j);
+        return dist[(i*(2*n-i-1))/2+j-i-1];
+    }
+
+    /*! Writes the distances from the i-th point to all the n points to out.
+     *
+     *  The distances to the points j>i are stored contiguously;
+     *  the ones to j<i are gathered with the stride decreasing by 1
+     *  (no index arithmetic other than a subtraction, monotone access).
+     */
+    void row(ssize_t i, T* out) const {
+        ssize_t idx = i-1;  // (j, i) for j=0
+        for (ssize_t j=0; j<i; ++j) {
+            out[j] = dist[idx];
+            idx += n-j-2;
+        }
+        out[i] = 0.0;
+        if (i < n-1) {
+            const T* upper = dist+(i*(2*n-i-1))/2;
+            std::copy(upper, upper+(n-i-1), out+i+1);
+        }
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+        if (k == n) {
+            // all the points, e.g., Cnn_from_distance()
+            row(i, __buf);
+            return __buf;
+        }
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w < n)
+            __buf[w] = pairwise(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+
+
+/*! (internal) Creates a copy of an n*d matrix X (converted to T)
+ *  with the features sorted w.r.t. decreasing variances,
+ *  see __bounded_distance().
+ */
+template<class T, class S>
+void __variance_ordered_copy(const S* X, ssize_t n, ssize_t d, std::vector<T>& Y)
+{
+    std::vector<double> mean(d, 0.0), var(d, 0.0);
+    for (ssize_t i=0; i<n; ++i)
+        for (ssize_t u=0; u<d; ++u)
+            mean[u] += (double)(T)X[i*d+u];
+    for (ssize_t u=0; u<d; ++u) mean[u] /= (double)n;
+    for (ssize_t i=0; i<n; ++i)
+        for (ssize_t u=0; u<d; ++u)
+            var[u] += square((double)(T)X[i*d+u]-mean[u]);
+
+    std::vector<ssize_t> order(d);
+    for (ssize_t u=0; u<d; ++u) order[u] = u;
+    std::stable_sort(order.begin(), order.end(),
+        [&var](ssize_t u, ssize_t v) { return var[u] > var[v]; });
+
+    Y.resize(n*d);
+    T* __Y = Y.data();
+    const ssize_t* __order = order.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t i=0; i<n; ++i)
+        for (ssize_t u=0; u<d; ++u)
+            __Y[i*d+u] = (T)X[i*d+__order[u]];
+}
+
+
+/*! (internal) Returns the squared Euclidean (MANHATTAN=false)
+ *  or the Manhattan (MANHATTAN=true) distance between x and y,
+ *  or a partial sum not less than bound as soon as it is reached
+ *  (early abandoning): the features are accumulated in blocks
+ *  of GENIECLUST_ABANDON_BLOCK (vectorised), and the bound is checked
+ *  after each one. If the features are sorted w.r.t. decreasing variances
+ *  (see __variance_ordered_copy()), then the largest contributions
+ *  are likely to come first.
+ */
+template<class T, bool MANHATTAN>
+inline T __bounded_distance(const T* x, const T* y, ssize_t d, T bound)
+{
+    T dist = 0.0;
+    ssize_t u = 0;
+    for (; u+GENIECLUST_ABANDON_BLOCK <= d; u += GENIECLUST_ABANDON_BLOCK) {
+        T block = 0.0;
+#ifdef _OPENMP
+        #pragma omp simd reduction(+:block)
+#endif
+        for (ssize_t v=u; v<u+GENIECLUST_ABANDON_BLOCK; ++v) {
+            if (MANHATTAN) block += fabs(x[v]-y[v]);
+            else           block += square(x[v]-y[v]);
+        }
+        dist += block;
+        if (dist >= bound) return dist;
+    }
+    for (; u<d; ++u) {
+        if (MANHATTAN) dist += fabs(x[u]-y[u]);
+        else           dist += square(x[u]-y[u]);
+    }
+    return dist;
+}
+
 
 
 /*! A class to compute the Euclidean distances from the i-th point
  *  to all given k points.
+ *
+ *  The data are stored as S (T by default; e.g., CFloat16 or CBFloat16
+ *  for T=float), the computations are performed in T.
+ *
+ *  If d >= GENIECLUST_EUCLIDEAN_DOT_MIN_D, the squared norms of all
+ *  the points are precomputed and the distances are determined
+ *  based on the dot products, several points at a time, see sqdist_many().
+ *
+ *  Optionally, a scalar-quantised copy of the data can be created,
+ *  see quantize(); it is used by the algorithms that only need
+ *  the exact distances if they are below some threshold,
+ *  e.g., Cmst_from_complete() and Cnn_from_distance().
+ *  Such algorithms can also use the early-abandoning variant,
+ *  see early_abandon().
+ *
+ *  The squared norms and the quantised codes of the query points
+ *  (see set_queries()) are computed separately.
  */
-template<class T>
+template<class T, class S=T>
 struct CDistanceEuclidean : public CDistance<T>  {
-    const T* X;
+    const S* X;
     ssize_t n;
     ssize_t d;
+    const S* Y;  // query points, see set_queries()
+    ssize_t m;
     bool squared;
+    bool use_dot;
+    bool use_quantized;
+    bool use_early_abandon;
+    bool mapped;
     std::vector<T> buf;
-    // std::vector<T> sqnorm;
+    std::vector<T> sqnorm;
+    CQuantizedEuclidean<T> quantized;
+    std::vector<T> Xv;  // features sorted w.r.t. decreasing variances
 
     /*!
      * @param X n*d c_contiguous array
@@ -117,62 +519,187 @@ struct CDistanceEuclidean : public CDistance<T>  {
      * @param d dimensionality
      * @param squared true for the squared Euclidean distance
      */
-    CDistanceEuclidean(const T* X, ssize_t n, ssize_t d, bool squared=false)
-            : buf(n)//, sqnorm(n)
+    CDistanceEuclidean(const S* X, ssize_t n, ssize_t d, bool squared=false)
+            : buf(n)
     {
         this->n = n;
         this->d = d;
         this->X = X;
+        this->Y = NULL;
+        this->m = 0;
         this->squared = squared;
+        this->use_dot = (d >= GENIECLUST_EUCLIDEAN_DOT_MIN_D);
+        this->use_quantized = false;
+        this->use_early_abandon = false;
+        this->mapped = false;
 
-//         T* __sqnorm = sqnorm.data();
-// #ifdef _OPENMP
-//         #pragma omp parallel for schedule(static)
-// #endif
-//         for (ssize_t i=0; i<n; ++i) {
-//             __sqnorm[i] = 0.0;
-//             for (ssize_t u=0; u<d; ++u) {
-//                 __sqnorm[i] += X[d*i+u]*X[d*i+u];
-//             }
-//         }
+        if (use_dot) {
+            sqnorm.resize(n);
+            compute_sqnorm(0, n);
+        }
     }
 
     CDistanceEuclidean()
         : CDistanceEuclidean(NULL, 0, 0) { }
 
-    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
-        T* __buf = buf.data();
-        // T* __sqnorm = sqnorm.data();
+    /*! Returns the i-th point (an indexed or a query one) */
+    inline const S* row(ssize_t i) const {
+        return (i < n)?(X+d*i):(Y+d*(i-n));
+    }
+
+    /*! Computes the squared norms of the from-th, ..., (to-1)-th point */
+    void compute_sqnorm(ssize_t from, ssize_t to) {
+        T* __sqnorm = sqnorm.data();
 #ifdef _OPENMP
         #pragma omp parallel for schedule(static)
 #endif
-        for (ssize_t j=0; j<k; ++j) {
-            ssize_t w = M[j];
-            // GENIECLUST_ASSERT(w>=0 && w < n)
-            __buf[w] = 0.0;
-
-//             const T* x = X+d*i;
-//             const T* y = X+d*w;
-//             for (ssize_t u=0; u<d; ++u) {
-//                 __buf[w] += (*x-*y)*(*x-*y);
-//                 ++x; ++y;
-//             }
-
-            // or we could use the BLAS snrm2() for increased numerical stability.
+        for (ssize_t i=from; i<to; ++i) {
+            const S* x = row(i);
+            __sqnorm[i] = 0.0;
             for (ssize_t u=0; u<d; ++u) {
-                __buf[w] += square(X[d*i+u]-X[d*w+u]);
+                __sqnorm[i] += square((T)x[u]);
             }
+        }
+    }
+
+    /*! See CDistance::set_queries() */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->Y = __as_S(Y, X);
+        this->m = m;
+        if (use_dot) {
+            sqnorm.resize(n+m);
+            compute_sqnorm(n, n+m);
+        }
+        if (use_quantized)
+            quantized.set_queries(this->Y, m);
+    }
+
+    /*! Marks the data as backed by a memory-mapped file: the points
+     *  are read sequentially in each iteration of Cmst_from_complete(),
+     *  hence aggressive read-ahead is requested; moreover, no in-memory
+     *  copies of the whole dataset are made therein.
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(X, sizeof(S)*n*d, GENIECLUST_ADVICE_SEQUENTIAL);
+    }
+
+    /*! Creates the 8-bit scalar-quantised copy of the data,
+     *  see CQuantizedEuclidean.
+     */
+    void quantize() {
+        quantized = CQuantizedEuclidean<T>(X, n, d);
+        if (m > 0) quantized.set_queries(Y, m);
+        use_quantized = true;
+    }
+
+    /*! Creates a copy of the data with the features sorted w.r.t.
+     *  decreasing variances, to be used with __bounded_distance().
+     */
+    void early_abandon() {
+        __variance_ordered_copy(X, n, d, Xv);
+        use_early_abandon = true;
+    }
+
+    /*! Returns a lower bound for sqdist(i, j) (requires use_quantized) */
+    inline T sqdist_lower_bound(ssize_t i, ssize_t j) const {
+        return quantized.lower_bound(i, j);
+    }
+
+    /*! Returns the squared Euclidean distance between
+     *  the i-th and the j-th point */
+    inline T sqdist(ssize_t i, ssize_t j) const {
+        // or we could use the BLAS snrm2() for increased numerical stability.
+        const S* x = row(i);
+        const S* y = row(j);
+        T dist = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            dist += square((T)x[u]-(T)y[u]);
+        }
+        return dist;
+    }
+
+    /*! Converts the dot product of the i-th and the j-th point
+     *  to their squared distance (requires use_dot).
+     *
+     *  Near-zero results (relative to the norms) are recomputed
+     *  directly so that, e.g., duplicates are at distance 0
+     *  and the ordering of the nearest points is not distorted
+     *  by the cancellation.
+     */
+    inline T sqdist_from_dot(ssize_t i, ssize_t j, T dot) const {
+        // did you know that (x-y)**2 = x**2 + y**2 - 2*x*y ?
+        T norms = sqnorm[i]+sqnorm[j];
+        T dist = norms-2.0*dot;
+        if (dist <= norms*(T)GENIECLUST_EUCLIDEAN_DOT_RECOMPUTE)
+            dist = sqdist(i, j);
+        return dist;
+    }
+
+    /*! Computes the squared distances from the i-th point
+     *  to the points M[0], ..., M[k-1]; out[M[j]] gets the result.
+     *
+     *  If use_dot, the dot products with 4 points are computed
+     *  at a time, see __dot_tile_1x4().
+     */
+    void sqdist_many(ssize_t i, const ssize_t* M, ssize_t k, T* out) const {
+        if (!use_dot) {
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(static)
+#endif
+            for (ssize_t j=0; j<k; ++j)
+                out[M[j]] = sqdist(i, M[j]);
+            return;
+        }
+
+        std::vector<T> xbuf;
+        const T* x = __as_T(row(i), xbuf, d);
+        ssize_t n_blocks = (k+3)/4;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t b=0; b<n_blocks; ++b) {
+            ssize_t j0 = 4*b;
+            ssize_t l = std::min((ssize_t)4, k-j0);
+            const S* y[4];
+            T dot[4];
+            for (ssize_t c=0; c<4; ++c)
+                y[c] = X+d*M[j0+std::min(c, l-1)];  // pad with the last point
 
+            __dot_tile_1x4(x, y, d, dot);
 
-            // // did you know that (x-y)**2 = x**2 + y**2 - 2*x*y ?
-            // const T* x = X+d*i;
-            // const T* y = X+d*w;
-            // for (ssize_t u=0; u<d; ++u) {
-            //     __buf[w] -= (*(x++))*(*(y++));
-            // }
-            // __buf[w] = 2.0*__buf[w]+__sqnorm[i]+__sqnorm[w];
+            for (ssize_t c=0; c<l; ++c)
+                out[M[j0+c]] = sqdist_from_dot(i, M[j0+c], dot[c]);
+        }
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        if (squared) return sqdist(i, j);
+        else return sqrt(sqdist(i, j));
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+        if (use_dot) {
+            sqdist_many(i, M, k, __buf);
+            if (!squared) {
+#ifdef _OPENMP
+                #pragma omp parallel for schedule(static)
+#endif
+                for (ssize_t j=0; j<k; ++j)
+                    __buf[M[j]] = sqrt(__buf[M[j]]);
+            }
+            return __buf;
+        }
 
-            if (!squared) __buf[w] = sqrt(__buf[w]);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w < n)
+            __buf[w] = pairwise(i, w);
         }
         return __buf;
     }
@@ -182,30 +709,78 @@ struct CDistanceEuclidean : public CDistance<T>  {
 
 /*! A class to compute the CDistanceManhattan distances from the i-th point
  *  to all given k points.
+ *
+ *  The data are stored as S, the computations are performed in T.
+ *  See also early_abandon().
  */
-template<class T>
+template<class T, class S=T>
 struct CDistanceManhattan : public CDistance<T>  {
-    const T* X;
+    const S* X;
     ssize_t n;
     ssize_t d;
+    const S* Y;  // query points, see set_queries()
+    ssize_t m;
+    bool use_early_abandon;
+    bool mapped;
     std::vector<T> buf;
+    std::vector<T> Xv;  // features sorted w.r.t. decreasing variances
 
     /*!
      * @param X n*d c_contiguous array
      * @param n number of points
      * @param d dimensionality
      */
-    CDistanceManhattan(const T* X, ssize_t n, ssize_t d)
+    CDistanceManhattan(const S* X, ssize_t n, ssize_t d)
             : buf(n)
     {
         this->n = n;
         this->d = d;
         this->X = X;
+        this->Y = NULL;
+        this->m = 0;
+        this->use_early_abandon = false;
+        this->mapped = false;
     }
 
     CDistanceManhattan()
         : CDistanceManhattan(NULL, 0, 0) { }
 
+    /*! Returns the i-th point (an indexed or a query one) */
+    inline const S* row(ssize_t i) const {
+        return (i < n)?(X+d*i):(Y+d*(i-n));
+    }
+
+    /*! See CDistance::set_queries() */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->Y = __as_S(Y, X);
+        this->m = m;
+    }
+
+    /*! See CDistanceEuclidean::early_abandon() */
+    void early_abandon() {
+        __variance_ordered_copy(X, n, d, Xv);
+        use_early_abandon = true;
+    }
+
+    /*! Marks the data as backed by a memory-mapped file,
+     *  see CDistanceEuclidean::set_mapped()
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(X, sizeof(S)*n*d, GENIECLUST_ADVICE_SEQUENTIAL);
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        const S* x = row(i);
+        const S* y = row(j);
+        T dist = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            dist += fabs((T)x[u]-(T)y[u]);
+        }
+        return dist;
+    }
+
     virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
         T* __buf = buf.data();
 #ifdef _OPENMP
@@ -214,11 +789,7 @@ struct CDistanceManhattan : public CDistance<T>  {
         for (ssize_t j=0; j<k; ++j) {
             ssize_t w = M[j];
             // GENIECLUST_ASSERT(w>=0 && w<n)
-            __buf[w] = 0.0;
-
-            for (ssize_t u=0; u<d; ++u) {
-                __buf[w] += fabs(X[d*i+u]-X[d*w+u]);
-            }
+            __buf[w] = pairwise(i, w);
         }
         return __buf;
     }
@@ -228,12 +799,17 @@ struct CDistanceManhattan : public CDistance<T>  {
 
 /*! A class to compute the cosine distances from the i-th point
  *  to all given k points.
+ *
+ *  The data are stored as S, the computations are performed in T.
  */
-template<class T>
+template<class T, class S=T>
 struct CDistanceCosine : public CDistance<T>  {
-    const T* X;
+    const S* X;
     ssize_t n;
     ssize_t d;
+    const S* Y;  // query points, see set_queries()
+    ssize_t m;
+    bool mapped;
     std::vector<T> buf;
     std::vector<T> norm;
 
@@ -242,46 +818,578 @@ struct CDistanceCosine : public CDistance<T>  {
      * @param n number of points
      * @param d dimensionality
      */
-    CDistanceCosine(const T* X, ssize_t n, ssize_t d)
+    CDistanceCosine(const S* X, ssize_t n, ssize_t d)
             : buf(n), norm(n)
     {
         this->n = n;
         this->d = d;
         this->X = X;
+        this->Y = NULL;
+        this->m = 0;
+        this->mapped = false;
+        compute_norm(0, n);
+    }
+
+    CDistanceCosine()
+        : CDistanceCosine(NULL, 0, 0) { }
+
+    /*! Returns the i-th point (an indexed or a query one) */
+    inline const S* row(ssize_t i) const {
+        return (i < n)?(X+d*i):(Y+d*(i-n));
+    }
 
+    /*! Computes the norms of the from-th, ..., (to-1)-th point */
+    void compute_norm(ssize_t from, ssize_t to) {
         T* __norm = norm.data();
 #ifdef _OPENMP
         #pragma omp parallel for schedule(static)
 #endif
-        for (ssize_t i=0; i<n; ++i) {
+        for (ssize_t i=from; i<to; ++i) {
+            const S* x = row(i);
             __norm[i] = 0.0;
             for (ssize_t u=0; u<d; ++u) {
-                __norm[i] += X[d*i+u]*X[d*i+u];
+                __norm[i] += square((T)x[u]);
             }
             __norm[i] = sqrt(__norm[i]);
         }
     }
 
-    CDistanceCosine()
-        : CDistanceCosine(NULL, 0, 0) { }
+    /*! See CDistance::set_queries() */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->Y = __as_S(Y, X);
+        this->m = m;
+        norm.resize(n+m);
+        compute_norm(n, n+m);
+    }
+
+    /*! Marks the data as backed by a memory-mapped file,
+     *  see CDistanceEuclidean::set_mapped()
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(X, sizeof(S)*n*d, GENIECLUST_ADVICE_SEQUENTIAL);
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        const S* x = row(i);
+        const S* y = row(j);
+        T dist = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            dist -= (T)x[u]*(T)y[u];
+        }
+        dist /= norm[i];
+        dist /= norm[j];
+        dist += 1.0;
+        return dist;
+    }
 
     virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
         T*  __buf = buf.data();
-        T* __norm = norm.data();
 #ifdef _OPENMP
         #pragma omp parallel for schedule(static)
 #endif
         for (ssize_t j=0; j<k; ++j) {
             ssize_t w = M[j];
             // GENIECLUST_ASSERT(w>=0&&w<n)
-            __buf[w] = 0.0;
+            __buf[w] = pairwise(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! A class to compute the Chebyshev (maximum, L_inf) distances
+ *  from the i-th point to all given k points.
+ */
+template<class T, class S=T>
+struct CDistanceChebyshev : public CDistance<T>  {
+    const S* X;
+    ssize_t n;
+    ssize_t d;
+    const S* Y;  // query points, see set_queries()
+    ssize_t m;
+    bool mapped;
+    std::vector<T> buf;
+
+    /*!
+     * @param X n*d c_contiguous array
+     * @param n number of points
+     * @param d dimensionality
+     */
+    CDistanceChebyshev(const S* X, ssize_t n, ssize_t d)
+            : buf(n)
+    {
+        this->n = n;
+        this->d = d;
+        this->X = X;
+        this->Y = NULL;
+        this->m = 0;
+        this->mapped = false;
+    }
+
+    CDistanceChebyshev()
+        : CDistanceChebyshev(NULL, 0, 0) { }
+
+    /*! Returns the i-th point (an indexed or a query one) */
+    inline const S* row(ssize_t i) const {
+        return (i < n)?(X+d*i):(Y+d*(i-n));
+    }
+
+    /*! See CDistance::set_queries() */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->Y = __as_S(Y, X);
+        this->m = m;
+    }
+
+    /*! Marks the data as backed by a memory-mapped file,
+     *  see CDistanceEuclidean::set_mapped()
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(X, sizeof(S)*n*d, GENIECLUST_ADVICE_SEQUENTIAL);
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        const S* x = row(i);
+        const S* y = row(j);
+        T dist = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            T e = fabs((T)x[u]-(T)y[u]);
+            if (e > dist) dist = e;
+        }
+        return dist;
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w<n)
+            __buf[w] = pairwise(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! A class to compute the Minkowski distances,
+ *  (sum |x_i-y_i|^p)^(1/p), p >= 1, from the i-th point to all given k points.
+ *
+ *  For p in {1, 2, 3, 4}, the powers are computed by multiplication,
+ *  in loops specialised at compile time.
+ */
+template<class T, class S=T>
+struct CDistanceMinkowski : public CDistance<T>  {
+    const S* X;
+    ssize_t n;
+    ssize_t d;
+    const S* Y;  // query points, see set_queries()
+    ssize_t m;
+    T p;
+    int p_int;   // p if p in {1, 2, 3, 4}, 0 otherwise
+    bool mapped;
+    std::vector<T> buf;
+
+    /*!
+     * @param X n*d c_contiguous array
+     * @param n number of points
+     * @param d dimensionality
+     * @param p the order of the norm, p >= 1 (finite)
+     */
+    CDistanceMinkowski(const S* X, ssize_t n, ssize_t d, T p)
+            : buf(n)
+    {
+        if (!(p >= 1.0) || std::isinf(p)) throw std::domain_error("p must be in [1, inf)");
+        this->n = n;
+        this->d = d;
+        this->X = X;
+        this->Y = NULL;
+        this->m = 0;
+        this->p = p;
+        this->p_int = (p == 1.0 || p == 2.0 || p == 3.0 || p == 4.0)?(int)p:0;
+        this->mapped = false;
+    }
+
+    CDistanceMinkowski()
+        : CDistanceMinkowski(NULL, 0, 0, 2.0) { }
+
+    /*! Returns the i-th point (an indexed or a query one) */
+    inline const S* row(ssize_t i) const {
+        return (i < n)?(X+d*i):(Y+d*(i-n));
+    }
+
+    /*! See CDistance::set_queries() */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->Y = __as_S(Y, X);
+        this->m = m;
+    }
+
+    /*! Marks the data as backed by a memory-mapped file,
+     *  see CDistanceEuclidean::set_mapped()
+     */
+    void set_mapped() {
+        mapped = true;
+        Cmadvise(X, sizeof(S)*n*d, GENIECLUST_ADVICE_SEQUENTIAL);
+    }
+
+    /*! Returns sum |x_i-y_i|^P for the i-th and the j-th point */
+    template<int P>
+    inline T sum_pow(ssize_t i, ssize_t j) const {
+        const S* x = row(i);
+        const S* y = row(j);
+        T dist = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            T e = fabs((T)x[u]-(T)y[u]);
+            if (P == 1)      dist += e;
+            else if (P == 2) dist += e*e;
+            else if (P == 3) dist += e*e*e;
+            else             dist += (e*e)*(e*e);
+        }
+        return dist;
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        switch (p_int) {
+            case 1: return sum_pow<1>(i, j);
+            case 2: return sqrt(sum_pow<2>(i, j));
+            case 3: return cbrt(sum_pow<3>(i, j));
+            case 4: return sqrt(sqrt(sum_pow<4>(i, j)));
+            default: {
+                const S* x = row(i);
+                const S* y = row(j);
+                T dist = 0.0;
+                for (ssize_t u=0; u<d; ++u)
+                    dist += pow((T)fabs((T)x[u]-(T)y[u]), p);
+                return pow(dist, (T)1.0/p);
+            }
+        }
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w<n)
+            __buf[w] = pairwise(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! A class to compute the great-circle (geodesic) distances
+ *  on the unit sphere between points given by their latitudes and
+ *  longitudes (in radians, in this order; like in sklearn's "haversine").
+ *
+ *  The points are converted to 3D unit vectors once; the geodesic
+ *  distance is then 2*asin(c/2), where c is the Euclidean (chord) distance,
+ *  which is computed without trigonometric functions, can be vectorised,
+ *  and, unlike the haversine formula based on the dot product,
+ *  does not suffer from cancellation for nearby points.
+ *  Multiply the results by the radius of the sphere (e.g., 6371.0088 km
+ *  for the Earth) to get the actual distances.
+ */
+template<class T>
+struct CDistanceHaversine : public CDistance<T>  {
+    std::vector<T> U;
+    ssize_t n;
+    std::vector<T> buf;
+
+    /*! Converts n (latitude, longitude) pairs to 3D unit vectors */
+    static void latlon_to_unit(const T* X, ssize_t n, T* U) {
+        for (ssize_t i=0; i<n; ++i) {
+            T cos_lat = cos(X[2*i+0]);
+            U[3*i+0] = cos_lat*cos(X[2*i+1]);
+            U[3*i+1] = cos_lat*sin(X[2*i+1]);
+            U[3*i+2] = sin(X[2*i+0]);
+        }
+    }
+
+    /*! Converts a chord length to the arc length (unit sphere) */
+    static inline T chord_to_arc(T c) {
+        c *= 0.5;
+        if (c > 1.0) c = 1.0;  // rounding errors
+        return 2.0*asin(c);
+    }
+
+    /*! Converts an arc length in [0, pi] to the chord length (unit sphere) */
+    static inline T arc_to_chord(T a) {
+        if (a > GENIECLUST_PI) a = GENIECLUST_PI;
+        return 2.0*sin(0.5*a);
+    }
+
+    /*!
+     * @param X n*2 c_contiguous array (latitudes and longitudes in radians)
+     * @param n number of points
+     */
+    CDistanceHaversine(const T* X, ssize_t n)
+            : U(3*n), n(n), buf(n)
+    {
+        latlon_to_unit(X, n, U.data());
+    }
+
+    CDistanceHaversine()
+        : CDistanceHaversine(NULL, 0) { }
+
+    /*! See CDistance::set_queries(); Y is an m*2 array
+     *  (latitudes and longitudes), which is converted to unit vectors
+     */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        U.resize(3*(n+m));
+        latlon_to_unit(Y, m, U.data()+3*n);
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        T dist = 0.0;
+        for (ssize_t u=0; u<3; ++u)
+            dist += square(U[3*i+u]-U[3*j+u]);
+        return chord_to_arc(sqrt(dist));
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w<n)
+            __buf[w] = pairwise(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! (internal) Owns a linearly transformed copy of the data;
+ *  a base class of CDistanceMahalanobis and CDistanceSEuclidean,
+ *  which must be initialised before CDistanceEuclidean.
+ *
+ *  The transformation is stored so that the query points
+ *  (see CDistance::set_queries()) can be transformed as well.
+ */
+template<class T>
+struct __CWhitenedData {
+    ssize_t d;
+    bool diagonal;
+    std::vector<T> L;   // d*d lower triangular matrix or d scaling factors
+    std::vector<T> Z;   // the transformed indexed points
+    std::vector<T> Zq;  // the transformed query points
 
+    /*!
+     * @param X n*d c_contiguous array
+     * @param n number of points
+     * @param d dimensionality
+     * @param L see cholesky() and inv_sqrt()
+     * @param diagonal whether L gives the diagonal of a matrix
+     */
+    __CWhitenedData(const T* X, ssize_t n, ssize_t d, std::vector<T>&& L,
+            bool diagonal)
+        : d(d), diagonal(diagonal), L(std::move(L))
+    {
+        transform(X, n, Z);
+    }
+
+    /*! Returns the lower triangular matrix L such that VI = L*L^T
+     *  (the Cholesky decomposition);
+     *  then (x-y)^T*VI*(x-y) = ||L^T*x-L^T*y||^2.
+     */
+    static std::vector<T> cholesky(const T* VI, ssize_t d)
+    {
+        std::vector<T> L(d*d, 0.0);
+        for (ssize_t j=0; j<d; ++j) {
+            T s = VI[j*d+j];
+            for (ssize_t k=0; k<j; ++k) s -= L[j*d+k]*L[j*d+k];
+            if (!(s > 0.0))
+                throw std::domain_error("VI is not positive definite");
+            L[j*d+j] = sqrt(s);
+            for (ssize_t i=j+1; i<d; ++i) {
+                T t = VI[i*d+j];
+                for (ssize_t k=0; k<j; ++k) t -= L[i*d+k]*L[j*d+k];
+                L[i*d+j] = t/L[j*d+j];
+            }
+        }
+        return L;
+    }
+
+    /*! Returns 1/sqrt(V[u]) for each u */
+    static std::vector<T> inv_sqrt(const T* V, ssize_t d)
+    {
+        std::vector<T> s(d);
+        for (ssize_t u=0; u<d; ++u) {
+            if (!(V[u] > 0.0)) throw std::domain_error("V must be positive");
+            s[u] = 1.0/sqrt(V[u]);
+        }
+        return s;
+    }
+
+    /*! Sets Z to X*L or, if diagonal, to X with each column
+     *  multiplied by the corresponding element of L
+     */
+    void transform(const T* X, ssize_t n, std::vector<T>& Z) const
+    {
+        Z.resize(n*d);
+        T* __Z = Z.data();
+        const T* __L = L.data();
+        if (diagonal) {
+            for (ssize_t i=0; i<n; ++i)
+                for (ssize_t u=0; u<d; ++u)
+                    __Z[i*d+u] = X[i*d+u]*__L[u];
+            return;
+        }
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t i=0; i<n; ++i) {
             for (ssize_t u=0; u<d; ++u) {
-                __buf[w] -= X[d*i+u]*X[d*w+u];
+                T z = 0.0;
+                for (ssize_t v=u; v<d; ++v)
+                    z += X[i*d+v]*__L[v*d+u];
+                __Z[i*d+u] = z;
+            }
+        }
+    }
+};
+
+
+
+/*! A class to compute the Mahalanobis distances,
+ *  sqrt((x-y)^T*VI*(x-y)), where VI is the inverse of the covariance matrix.
+ *
+ *  The data are whitened once (Cholesky decomposition of VI,
+ *  see __CWhitenedData::cholesky()); then, these are just
+ *  the Euclidean distances between the transformed points.
+ *  Hence, all the algorithms specialised for CDistanceEuclidean apply.
+ */
+template<class T>
+struct CDistanceMahalanobis : private __CWhitenedData<T>, public CDistanceEuclidean<T> {
+
+    /*!
+     * @param X n*d c_contiguous array
+     * @param n number of points
+     * @param d dimensionality
+     * @param VI d*d c_contiguous symmetric positive definite matrix
+     * @param squared true for the squared distance
+     */
+    CDistanceMahalanobis(const T* X, ssize_t n, ssize_t d, const T* VI,
+            bool squared=false)
+        : __CWhitenedData<T>(X, n, d, __CWhitenedData<T>::cholesky(VI, d), false),
+          CDistanceEuclidean<T>(this->Z.data(), n, d, squared)
+    { }
+
+    /*! See CDistance::set_queries(); the query points are transformed first */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->transform(Y, m, this->Zq);
+        CDistanceEuclidean<T>::set_queries(this->Zq.data(), m);
+    }
+};
+
+
+
+/*! A class to compute the standardised Euclidean distances,
+ *  sqrt(sum (x_i-y_i)^2/V_i), where V gives the variances of the features.
+ *
+ *  Like in CDistanceMahalanobis, the data are transformed once.
+ */
+template<class T>
+struct CDistanceSEuclidean : private __CWhitenedData<T>, public CDistanceEuclidean<T> {
+
+    /*!
+     * @param X n*d c_contiguous array
+     * @param n number of points
+     * @param d dimensionality
+     * @param V d positive values
+     * @param squared true for the squared distance
+     */
+    CDistanceSEuclidean(const T* X, ssize_t n, ssize_t d, const T* V,
+            bool squared=false)
+        : __CWhitenedData<T>(X, n, d, __CWhitenedData<T>::inv_sqrt(V, d), true),
+          CDistanceEuclidean<T>(this->Z.data(), n, d, squared)
+    { }
+
+    /*! See CDistance::set_queries(); the query points are transformed first */
+    virtual void set_queries(const T* Y, ssize_t m) {
+        this->transform(Y, m, this->Zq);
+        CDistanceEuclidean<T>::set_queries(this->Zq.data(), m);
+    }
+};
+
+
+
+/*! A class to compute the distances from the i-th point to all given
+ *  k points by means of a user-supplied native function (e.g.,
+ *  a numba @cfunc or a function from a shared library loaded via ctypes)
+ *
+ *      void fn(ssize_t i, const ssize_t* M, ssize_t k, T* out),
+ *
+ *  which sets out[j] = d(i, M[j]) for j = 0, ..., k-1.
+ *  This way, custom metrics can be used without precomputing
+ *  the whole distance matrix.
+ *
+ *  M is split into chunks of consecutive indices and fn is called
+ *  on each of them from within an OpenMP parallel region; hence, fn must be
+ *  thread-safe and must not rely on the caller holding the Python GIL.
+ */
+template<class T>
+struct CDistanceCallback : public CDistance<T>  {
+    typedef void (*callback_t)(ssize_t i, const ssize_t* M, ssize_t k, T* out);
+
+    callback_t fn;
+    ssize_t n;
+    ssize_t chunk_size;
+    std::vector<T> out;
+    std::vector<T> buf;
+
+    /*!
+     * @param fn callback function
+     * @param n number of points
+     * @param chunk_size maximal number of distances requested
+     *        in a single call to fn
+     */
+    CDistanceCallback(callback_t fn, ssize_t n, ssize_t chunk_size=256)
+            : fn(fn), n(n), chunk_size(chunk_size), out(n), buf(n)
+    {
+        if (n > 0 && !fn) throw std::domain_error("fn is NULL");
+        if (chunk_size <= 0) throw std::domain_error("chunk_size <= 0");
+    }
+
+    /*! fn given by its address, e.g., from Python */
+    CDistanceCallback(const void* fn, ssize_t n, ssize_t chunk_size=256)
+        : CDistanceCallback(reinterpret_cast<callback_t>(fn), n, chunk_size) { }
+
+    CDistanceCallback()
+        : CDistanceCallback((callback_t)NULL, 0) { }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __out = out.data();
+        T* __buf = buf.data();
+        ssize_t n_chunks = (k+chunk_size-1)/chunk_size;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for (ssize_t c=0; c<n_chunks; ++c) {
+            ssize_t lo = c*chunk_size;
+            ssize_t l = std::min(chunk_size, k-lo);
+            fn(i, M+lo, l, __out+lo);
+            for (ssize_t j=lo; j<lo+l; ++j) {
+                // GENIECLUST_ASSERT(M[j]>=0 && M[j]<n)
+                __buf[M[j]] = __out[j];
             }
-            __buf[w] /= __norm[i];
-            __buf[w] /= __norm[w];
-            __buf[w] += 1.0;
         }
         return __buf;
     }
@@ -323,6 +1431,7 @@ struct CDistanceMutualReachability : public CDistance<T>  {
         const T* d = (*d_pairwise)(i, M, k);
 
         // NO pragma omp parallel for -- should be fast, no need for OMP?
+        // (note that Cmst_from_complete() fuses this with the Prim step)
         for (ssize_t j=0; j<k; ++j)  { //
             // buf[w] = max{d[w],d_core[i],d_core[w]}
             ssize_t w = M[j];
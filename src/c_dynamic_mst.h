@@ -0,0 +1,890 @@
+/*  Minimum Spanning Trees of Dynamic Point Sets (Insertions and Deletions)
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+
+#ifndef __c_dynamic_mst_h
+#define __c_dynamic_mst_h
+
+#include "c_common.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include "c_link_cut_tree.h"
+#include "c_knn.h"
+#include "c_distance.h"
+#include "c_mst.h"
+
+
+
+/*! (internal) The positions of the existing points amongst all
+ *  the ones that have not been removed, in the order of their ids
+ *  (i.e., of insertion): a Fenwick (binary indexed) tree over
+ *  the 0/1 flags marking the existing points.
+ *
+ *  Each operation takes O(log n) time; this way, removing a point
+ *  does not require shifting the positions of the subsequent ones
+ *  explicitly.
+ *
+ *
+ *  References:
+ *  ----------
+ *
+ *  P.M. Fenwick, A new data structure for cumulative frequency tables,
+ *  Software: Practice and Experience 24(3) (1994) 327–336.
+ */
+class CAliveIndex {
+protected:
+    std::vector<ssize_t> tree;  //!< 1-based; tree[k] = sum of flags (k-(k&-k), k]
+    ssize_t n_alive;            //!< number of existing points
+
+    /*! Returns the number of existing points with ids < i */
+    ssize_t prefix(ssize_t i) const
+    {
+        ssize_t res = 0;
+        for (ssize_t k=i; k>0; k -= (k & -k))
+            res += tree[k];
+        return res;
+    }
+
+public:
+    CAliveIndex() : tree(1, 0), n_alive(0) { }
+
+
+    /*! Returns the number of existing points */
+    ssize_t size() const { return n_alive; }
+
+
+    /*! Adds an existing point, whose id is the number of points
+     *  added so far
+     */
+    void push_back()
+    {
+        ssize_t k = (ssize_t)tree.size();
+        tree.push_back(1+prefix(k-1)-prefix(k-(k & -k)));
+        ++n_alive;
+    }
+
+
+    /*! Marks the point with id i as removed */
+    void erase(ssize_t i)
+    {
+        for (ssize_t k=i+1; k<(ssize_t)tree.size(); k += (k & -k))
+            --tree[k];
+        --n_alive;
+    }
+
+
+    /*! Returns the id of the existing point at position r, 0 <= r < size() */
+    ssize_t select(ssize_t r) const
+    {
+        ssize_t n = (ssize_t)tree.size()-1;
+        ssize_t step = 1;
+        while (2*step <= n) step *= 2;
+
+        ssize_t k = 0;
+        for (; step > 0; step /= 2) {
+            if (k+step <= n && tree[k+step] <= r) {
+                k += step;
+                r -= tree[k];
+            }
+        }
+        return k;  // the (k+1)-th element, 1-based
+    }
+
+
+    /*! Forgets all the points */
+    void clear()
+    {
+        tree.assign(1, 0);
+        n_alive = 0;
+    }
+};
+
+
+
+/*! A Euclidean minimum spanning tree of a point set that can
+ *  be extended with new points and from which points can be removed
+ *  (in batches; e.g., a sliding window over a data stream).
+ *
+ *  An MST of a graph G extended with a new vertex v (and the edges
+ *  incident to v) is a subset of MST(G) plus the edges incident to v.
+ *  Hence, each new edge {u,v} can be processed by means of the cycle
+ *  property: if u and v are not yet connected, the edge is added to
+ *  the tree; otherwise, it replaces the heaviest edge on the path
+ *  between u and v (if the latter is heavier). The tree is stored in
+ *  a link-cut tree, so that each such update takes O(log n) amortised time.
+ *
+ *  For a batch of new points, the candidate edges are: the edges to
+ *  the n_neighbors nearest existing points (this guarantees the tree
+ *  stays connected), the edges to the n_neighbors nearest points
+ *  within the batch itself, and the edges to the existing points
+ *  for which a new point is closer than their current nearest neighbour
+ *  (reverse nearest neighbours; in high-dimensional spaces, there might
+ *  be many points whose nearest neighbour does not have them amongst its
+ *  nearest neighbours). The distance to the nearest neighbour
+ *  of each point is the weight of the lightest tree edge incident to it.
+ *  Other edges are assumed not to belong to the updated tree,
+ *  which is not always true. Hence, the result is
+ *  an approximate MST (the greater the n_neighbors, the better);
+ *  compare Cmst_from_nn(). Edges between the existing points never enter
+ *  the tree anew.
+ *
+ *  All the candidate edges are kept in a pool (at most
+ *  2*n_neighbors lightest ones per point are retained). Removing a point
+ *  splits the tree into pieces, which are reconnected by means of the pool
+ *  edges incident to the removed point's tree neighbours and
+ *  its other candidate neighbours (processed in the order of increasing
+ *  weights, by means of the cycle property again). If this is not enough,
+ *  the nearest neighbours of the disconnected tree neighbours
+ *  are searched for (with an increasing number of neighbours).
+ *  Overall, the cost is proportional to the number of inserted and
+ *  removed points, not to the number of all the points.
+ *
+ *  The nearest neighbours are found by means of a sequence of K-d trees
+ *  over disjoint subsets of points whose sizes decrease geometrically
+ *  (the logarithmic method by Bentley and Saxe): a new batch is merged
+ *  with all the trees not greater than itself and a new K-d tree is built.
+ *  Therefore, each point takes part in O(log n) rebuilds and
+ *  a query visits O(log n) trees. Removed points are marked as
+ *  such; a K-d tree is rebuilt once half of its points are removed.
+ *
+ *  The points are numbered 0, 1, ..., n-1 in the order of insertion;
+ *  removing a point shifts the indices of the subsequent ones.
+ *  Internally, the points are never renumbered until the number of
+ *  removed ones exceeds the number of the existing ones, in which case
+ *  the whole structure is compacted (in O(n log n) time).
+ *  The indices are translated to the internal ids in O(log n) time,
+ *  see CAliveIndex.
+ *
+ *  Internally, the edge weights are squared Euclidean distances
+ *  (this does not change the MST).
+ *
+ *
+ *  References:
+ *  ----------
+ *
+ *  J.L. Bentley, J.B. Saxe, Decomposable searching problems I:
+ *  Static-to-dynamic transformation, Journal of Algorithms 1(4) (1980)
+ *  301–358.
+ *
+ *  F. Chin, D. Houck, Algorithms for updating minimal spanning trees,
+ *  Journal of Computer and System Sciences 16(3) (1978) 333–344.
+ *
+ *  D.D. Sleator, R.E. Tarjan, A data structure for dynamic trees,
+ *  Journal of Computer and System Sciences 26(3) (1983) 362–391.
+ */
+template <class T>
+class CDynamicMST {
+protected:
+
+    /*! A K-d tree over a subset of points */
+    struct CDynamicMSTLevel {
+        CKDTree<T> tree;
+        std::vector<ssize_t> ids;  //!< the i-th indexed point is ids[i]
+    };
+
+    ssize_t n;                      //!< number of points, including the removed ones
+    ssize_t n_removed;              //!< number of removed points
+    ssize_t d;                      //!< dimensionality
+    ssize_t n_neighbors;            //!< number of candidate edges per new point
+    std::vector<T> X;               //!< n*d c_contiguous array, all the points
+    std::vector<bool> removed;      //!< removed[i] iff the i-th point is removed
+    CAliveIndex alive;              //!< positions of the existing points
+
+    CLinkCutTree<T> lct;            //!< the tree; edges are nodes, too
+    std::vector<ssize_t> vertex_node; //!< vertex_node[i] is the i-th point's node
+    std::vector<ssize_t> edge_u;    //!< edge_u[e], edge_v[e] are the endpoints
+    std::vector<ssize_t> edge_v;    //!<   of an edge node e, or -1 otherwise
+    std::vector<ssize_t> free_nodes;//!< edge nodes that can be reused
+    std::vector< std::vector<ssize_t> > incident; //!< edge nodes incident to each point
+    ssize_t n_edges;                //!< number of edges in the tree
+
+    std::vector<T> nn_radius;       //!< squared distance to the nearest neighbour
+    std::vector< std::vector< std::pair<ssize_t,T> > > pool; //!< candidate edges
+
+    std::vector<CDynamicMSTLevel> levels; //!< (more or less) decreasing sizes
+    std::vector<ssize_t> point_level; //!< index of the level indexing each point
+    std::vector<ssize_t> point_local; //!< point's index within its level
+
+
+    /*! Squared Euclidean distance between the i-th and the j-th point */
+    inline T sqdist(ssize_t i, ssize_t j) const
+    {
+        T dist = 0.0;
+        const T* x = X.data()+i*d;
+        const T* y = X.data()+j*d;
+        for (ssize_t u=0; u<d; ++u)
+            dist += square(x[u]-y[u]);
+        return dist;
+    }
+
+
+    /*! Sets the distance from the u-th point to its nearest neighbour */
+    void set_nn_radius(ssize_t u, T r)
+    {
+        nn_radius[u] = r;
+        if (point_level[u] >= 0)
+            levels[point_level[u]].tree.set_radius(point_local[u], r);
+    }
+
+
+    /*! Adds a new edge node linking the u-th and the v-th point,
+     *  which must belong to different trees */
+    void link_edge(ssize_t u, ssize_t v, T weight)
+    {
+        ssize_t e;
+        if (!free_nodes.empty()) {
+            e = free_nodes.back();
+            free_nodes.pop_back();
+            lct.set_weight(e, weight);
+        }
+        else {
+            e = lct.add_node(weight);
+            edge_u.resize(lct.get_n(), -1);
+            edge_v.resize(lct.get_n(), -1);
+        }
+        edge_u[e] = u;
+        edge_v[e] = v;
+        incident[u].push_back(e);
+        incident[v].push_back(e);
+        if (weight < nn_radius[u]) set_nn_radius(u, weight);
+        if (weight < nn_radius[v]) set_nn_radius(v, weight);
+        lct.link(e, vertex_node[u]);
+        lct.link(vertex_node[v], e);
+        ++n_edges;
+    }
+
+
+    /*! Removes an edge node e from the tree */
+    void cut_edge(ssize_t e)
+    {
+        ssize_t u = edge_u[e], v = edge_v[e];
+        GENIECLUST_ASSERT(u >= 0 && v >= 0);
+        lct.cut(e, vertex_node[u]);
+        lct.cut(e, vertex_node[v]);
+        for (ssize_t w : {u, v}) {
+            std::vector<ssize_t>& inc = incident[w];
+            inc.erase(std::find(inc.begin(), inc.end(), e));
+        }
+        edge_u[e] = -1;
+        edge_v[e] = -1;
+        free_nodes.push_back(e);
+        --n_edges;
+    }
+
+
+    /*! Updates the tree w.r.t. a new edge {u,v} (cycle property)
+     *
+     *  @return true if the edge has been added to the tree
+     */
+    bool add_edge(ssize_t u, ssize_t v, T weight)
+    {
+        if (u == v) return false;
+        ssize_t nu = vertex_node[u];
+        ssize_t nv = vertex_node[v];
+        if (lct.connected(nu, nv)) {
+            ssize_t e = lct.path_argmax(nu, nv);
+            if (!(lct.get_weight(e) > weight))
+                return false;
+            cut_edge(e);
+        }
+        link_edge(u, v, weight);
+        return true;
+    }
+
+
+    /*! Updates the tree w.r.t. a set of candidate edges, processed
+     *  in the order of increasing weights (not necessary,
+     *  but reduces the number of replacements); the edges are added
+     *  to the pool if to_pool is true */
+    void add_edges(std::vector< CMstTriple<T> >& cand, bool to_pool=true)
+    {
+        std::sort(cand.begin(), cand.end());  // nonincreasing weights
+        for (ssize_t i=(ssize_t)cand.size()-1; i>=0; --i) {
+            if (to_pool) add_candidate(cand[i].i1, cand[i].i2, cand[i].d);
+            add_edge(cand[i].i1, cand[i].i2, cand[i].d);
+        }
+    }
+
+
+    /*! Adds the edge {u,v} to the pool of candidate edges */
+    void add_candidate(ssize_t u, ssize_t v, T weight)
+    {
+        for (ssize_t w : {u, v}) {
+            pool[w].push_back(std::make_pair(u+v-w, weight));
+            if ((ssize_t)pool[w].size() > 4*n_neighbors)
+                prune_pool(w);
+        }
+    }
+
+
+    /*! Leaves at most 2*n_neighbors lightest unique edges
+     *  to the existing points in the u-th point's pool */
+    void prune_pool(ssize_t u)
+    {
+        std::vector< std::pair<ssize_t,T> >& p = pool[u];
+        std::sort(p.begin(), p.end());  // by index, then by weight
+        ssize_t k = 0;
+        for (ssize_t i=0; i<(ssize_t)p.size(); ++i) {
+            if (removed[p[i].first]) continue;
+            if (k > 0 && p[k-1].first == p[i].first) continue;
+            p[k++] = p[i];
+        }
+        p.resize(k);
+        if (k > 2*n_neighbors) {
+            std::nth_element(p.begin(), p.begin()+2*n_neighbors, p.end(),
+                [](const std::pair<ssize_t,T>& a, const std::pair<ssize_t,T>& b) {
+                    return a.second < b.second;
+                });
+            p.resize(2*n_neighbors);
+        }
+    }
+
+
+    /*! Adds a new isolated vertex */
+    void add_vertex()
+    {
+        vertex_node.push_back(lct.add_node(-INFTY));
+        edge_u.resize(lct.get_n(), -1);
+        edge_v.resize(lct.get_n(), -1);
+        incident.push_back(std::vector<ssize_t>());
+        nn_radius.push_back(INFTY);
+        pool.push_back(std::vector< std::pair<ssize_t,T> >());
+        removed.push_back(false);
+        point_level.push_back(-1);
+        point_local.push_back(-1);
+    }
+
+
+    /*! (Re)builds the l-th K-d tree so that it indexes given points */
+    void build_level(ssize_t l, std::vector<ssize_t>& ids)
+    {
+        ssize_t m = (ssize_t)ids.size();
+        std::vector<T> buf(m*d);
+        std::vector<T> radii(m);
+        for (ssize_t i=0; i<m; ++i) {
+            for (ssize_t u=0; u<d; ++u)
+                buf[i*d+u] = X[ids[i]*d+u];
+            radii[i] = nn_radius[ids[i]];
+            point_level[ids[i]] = l;
+            point_local[ids[i]] = i;
+        }
+
+        levels[l].tree = CKDTree<T>(buf.data(), m, d);
+        levels[l].tree.set_radii(radii.data());
+        levels[l].ids.swap(ids);
+    }
+
+
+    /*! Indexes new points, merging all the K-d trees that
+     *  are not greater than the new batch */
+    void add_level(std::vector<ssize_t> ids)
+    {
+        while (!levels.empty() && levels.back().ids.size() <= ids.size()) {
+            for (ssize_t i : levels.back().ids)
+                if (!removed[i]) ids.push_back(i);
+            levels.pop_back();
+        }
+
+        levels.push_back(CDynamicMSTLevel());
+        build_level((ssize_t)levels.size()-1, ids);
+    }
+
+
+    /*! Finds the k nearest neighbours of the m query points amongst
+     *  all the indexed points, see CKDTree::kneighbours()
+     */
+    void kneighbours(const T* Y, ssize_t m, ssize_t k,
+        T* nn_dist, ssize_t* nn_ind) const
+    {
+        for (ssize_t i=0; i<m*k; ++i) {
+            nn_dist[i] = INFTY;
+            nn_ind[i]  = -1;
+        }
+
+        std::vector<T> cur_dist;
+        std::vector<ssize_t> cur_ind;
+        for (const CDynamicMSTLevel& level : levels) {
+            ssize_t cur_k = std::min(k, level.tree.get_n()-level.tree.get_n_removed());
+            if (cur_k <= 0) continue;
+            cur_dist.resize(m*cur_k);
+            cur_ind.resize(m*cur_k);
+            level.tree.kneighbours(Y, m, cur_k, cur_dist.data(), cur_ind.data());
+
+            // merge the sorted lists
+            for (ssize_t i=0; i<m; ++i) {
+                for (ssize_t j=0; j<cur_k; ++j) {
+                    T dist = cur_dist[i*cur_k+j];
+                    if (dist >= nn_dist[i*k+k-1]) break;
+                    ssize_t l = k-1;
+                    while (l > 0 && dist < nn_dist[i*k+l-1]) {
+                        nn_dist[i*k+l] = nn_dist[i*k+l-1];
+                        nn_ind[i*k+l]  = nn_ind[i*k+l-1];
+                        --l;
+                    }
+                    nn_dist[i*k+l] = dist;
+                    nn_ind[i*k+l]  = level.ids[cur_ind[i*cur_k+j]];
+                }
+            }
+        }
+    }
+
+
+    /*! Connects the u-th point with some other piece of the forest
+     *  (if possible), by means of the edges to its nearest neighbours;
+     *  the number of neighbours is doubled until success */
+    void reconnect(ssize_t u, ssize_t v)
+    {
+        ssize_t n_alive = n-n_removed;
+        ssize_t k = n_neighbors;
+        std::vector<T> nn_dist;
+        std::vector<ssize_t> nn_ind;
+        std::vector< CMstTriple<T> > cand;
+        while (!lct.connected(vertex_node[u], vertex_node[v])) {
+            k = std::min(k, n_alive);  // u is amongst the neighbours
+            nn_dist.resize(k);
+            nn_ind.resize(k);
+            kneighbours(X.data()+u*d, 1, k, nn_dist.data(), nn_ind.data());
+            cand.clear();
+            for (ssize_t j=0; j<k; ++j) {
+                if (nn_ind[j] != u)
+                    cand.push_back(CMstTriple<T>(u, nn_ind[j], nn_dist[j]));
+            }
+            add_edges(cand);
+            if (k == n_alive) break;
+            k *= 2;
+        }
+    }
+
+
+    /*! Renumbers the points so that the removed ones are forgotten */
+    void compact()
+    {
+        ssize_t n_alive = n-n_removed;
+        std::vector<ssize_t> old_id;
+        old_id.reserve(n_alive);
+        std::vector<ssize_t> new_id(n, -1);
+        for (ssize_t i=0; i<n; ++i) {
+            if (removed[i]) continue;
+            new_id[i] = (ssize_t)old_id.size();
+            old_id.push_back(i);
+        }
+
+        std::vector<T> X_old;
+        X_old.swap(X);
+        X.resize(n_alive*d);
+        for (ssize_t i=0; i<n_alive; ++i) {
+            for (ssize_t u=0; u<d; ++u)
+                X[i*d+u] = X_old[old_id[i]*d+u];
+        }
+
+        std::vector< CMstTriple<T> > edges;
+        for (ssize_t e=0; e<(ssize_t)edge_u.size(); ++e) {
+            if (edge_u[e] >= 0)
+                edges.push_back(CMstTriple<T>(new_id[edge_u[e]],
+                    new_id[edge_v[e]], lct.get_weight(e)));
+        }
+
+        std::vector< std::vector< std::pair<ssize_t,T> > > pool_new(n_alive);
+        for (ssize_t i=0; i<n_alive; ++i) {
+            for (const std::pair<ssize_t,T>& c : pool[old_id[i]]) {
+                if (new_id[c.first] >= 0)
+                    pool_new[i].push_back(std::make_pair(new_id[c.first], c.second));
+            }
+        }
+
+        lct = CLinkCutTree<T>();
+        vertex_node.clear();
+        edge_u.clear();
+        edge_v.clear();
+        free_nodes.clear();
+        incident.clear();
+        nn_radius.clear();
+        pool.clear();
+        removed.clear();
+        point_level.clear();
+        point_local.clear();
+        levels.clear();
+        n_edges = 0;
+        alive.clear();
+        n = n_alive;
+        n_removed = 0;
+
+        std::vector<ssize_t> ids(n);
+        for (ssize_t i=0; i<n; ++i) {
+            add_vertex();
+            alive.push_back();
+            ids[i] = i;
+        }
+        pool.swap(pool_new);
+
+        for (const CMstTriple<T>& e : edges)
+            link_edge(e.i1, e.i2, e.d);
+
+        add_level(ids);
+    }
+
+
+public:
+    /*! Initialises the tree.
+     *
+     *  @param X n*d c_contiguous array; the points are copied
+     *  @param n number of points
+     *  @param d dimensionality
+     *  @param mst_ind optional (may be NULL) c_contiguous array of shape
+     *     (n-1,2) defining the edges of an existing Euclidean MST
+     *     of X, e.g., obtained by a call to Cmst_from_complete();
+     *     if NULL, it is computed here
+     *  @param n_neighbors number of candidate edges per new point
+     */
+    CDynamicMST(const T* X, ssize_t n, ssize_t d, const ssize_t* mst_ind=NULL,
+            ssize_t n_neighbors=16)
+        : X(X, X+n*d), lct()
+    {
+        if (n <= 0) throw std::domain_error("n <= 0");
+        if (d <= 0) throw std::domain_error("d <= 0");
+        if (n_neighbors <= 0) throw std::domain_error("n_neighbors <= 0");
+
+        this->n = n;
+        this->n_removed = 0;
+        this->d = d;
+        this->n_neighbors = n_neighbors;
+        this->n_edges = 0;
+
+        std::vector<ssize_t> ids(n);
+        for (ssize_t i=0; i<n; ++i) {
+            add_vertex();
+            alive.push_back();
+            ids[i] = i;
+        }
+
+        std::vector<ssize_t> mst_ind_buf;
+        if (!mst_ind && n > 1) {
+            mst_ind_buf.resize(2*(n-1));
+            std::vector<T> mst_dist_buf(n-1);
+            CDistanceEuclidean<T> dist(X, n, d, /*squared*/true);
+            Cmst_from_complete(&dist, n, mst_dist_buf.data(), mst_ind_buf.data());
+            mst_ind = mst_ind_buf.data();
+        }
+
+        for (ssize_t i=0; i<n-1; ++i) {
+            ssize_t u = mst_ind[2*i+0], v = mst_ind[2*i+1];
+            if (u < 0 || v < 0) continue;  // a spanning forest
+            if (u >= n || v >= n) throw std::domain_error("incorrect mst_ind");
+            if (!add_edge(u, v, sqdist(u, v)))
+                throw std::domain_error("mst_ind does not define a tree");
+        }
+
+        add_level(ids);
+
+        // the initial pool of candidate edges: the nearest neighbours
+        ssize_t k = std::min(n_neighbors, n-1);
+        if (k > 0) {
+            std::vector<T> nn_dist(n*k);
+            std::vector<ssize_t> nn_ind(n*k);
+            levels[0].tree.kneighbours(X, n, k, nn_dist.data(), nn_ind.data(),
+                /*skip_self*/true);
+            for (ssize_t i=0; i<n; ++i) {
+                for (ssize_t j=0; j<k; ++j)
+                    add_candidate(i, nn_ind[i*k+j], nn_dist[i*k+j]);
+            }
+        }
+    }
+
+    CDynamicMST() : n(0), n_removed(0), d(0), n_neighbors(16), n_edges(0) { }
+
+
+    /*! Returns the number of (existing) points. */
+    ssize_t get_n() const { return n-n_removed; }
+
+
+    /*! Returns the dimensionality of the points. */
+    ssize_t get_d() const { return d; }
+
+
+    /*! Returns the number of edges in the tree. */
+    ssize_t get_n_edges() const { return n_edges; }
+
+
+    /*! Copies the points to a given get_n()*d c_contiguous array. */
+    void get_data(T* out) const
+    {
+        for (ssize_t i=0; i<n; ++i) {
+            if (removed[i]) continue;
+            for (ssize_t u=0; u<d; ++u)
+                out[u] = X[i*d+u];
+            out += d;
+        }
+    }
+
+
+    /*! Adds new points, which will be given indices n, n+1, ..., n+m-1,
+     *  where n==get_n().
+     *
+     *  Run time: O(m k log n) amortised, where k==n_neighbors,
+     *  plus the nearest neighbour search.
+     *
+     *  @param Y m*d c_contiguous array with the new points
+     *  @param m number of new points
+     *
+     *  @return the index of the first new point
+     */
+    ssize_t insert(const T* Y, ssize_t m)
+    {
+        ssize_t first = n-n_removed;
+        if (m <= 0) return first;
+
+        ssize_t n_old = n;
+        std::vector< CMstTriple<T> > cand;
+
+        // candidate edges to the existing points
+        ssize_t k = std::min(n_neighbors, n-n_removed);
+        std::vector<T> nn_dist(m*k);
+        std::vector<ssize_t> nn_ind(m*k);
+        kneighbours(Y, m, k, nn_dist.data(), nn_ind.data());
+        for (ssize_t i=0; i<m; ++i) {
+            for (ssize_t j=0; j<k; ++j)
+                cand.push_back(CMstTriple<T>(n_old+i, nn_ind[i*k+j], nn_dist[i*k+j]));
+        }
+
+        // reverse nearest neighbours amongst the existing points
+        std::vector< std::vector<ssize_t> > rnn(m);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 64)
+#endif
+        for (ssize_t i=0; i<m; ++i) {
+            std::vector<ssize_t> buf;
+            for (const CDynamicMSTLevel& level : levels) {
+                buf.clear();
+                level.tree.find_reverse(Y+i*d, buf);
+                for (ssize_t j : buf)
+                    rnn[i].push_back(level.ids[j]);
+            }
+        }
+        for (ssize_t i=0; i<m; ++i) {
+            for (ssize_t j : rnn[i]) {
+                T dist = 0.0;
+                for (ssize_t u=0; u<d; ++u)
+                    dist += square(Y[i*d+u]-X[j*d+u]);
+                cand.push_back(CMstTriple<T>(n_old+i, j, dist));
+            }
+        }
+
+        // candidate edges within the batch
+        k = std::min(n_neighbors, m-1);
+        if (k > 0) {
+            CKDTree<T> tree(Y, m, d);
+            nn_dist.resize(m*k);
+            nn_ind.resize(m*k);
+            tree.kneighbours(Y, m, k, nn_dist.data(), nn_ind.data(), /*skip_self*/true);
+            for (ssize_t i=0; i<m; ++i) {
+                for (ssize_t j=0; j<k; ++j)
+                    cand.push_back(CMstTriple<T>(n_old+i, n_old+nn_ind[i*k+j], nn_dist[i*k+j]));
+            }
+        }
+
+        X.insert(X.end(), Y, Y+m*d);
+        std::vector<ssize_t> ids(m);
+        for (ssize_t i=0; i<m; ++i) {
+            add_vertex();
+            alive.push_back();
+            ids[i] = n_old+i;
+        }
+        n += m;
+
+        add_edges(cand);
+        add_level(ids);
+
+        return first;
+    }
+
+
+    /*! Removes given points; the subsequent ones are renumbered
+     *  (their indices are decreased accordingly).
+     *
+     *  Run time: O(m k log n) amortised, where k==n_neighbors,
+     *  unless the pool of candidate edges does not suffice to reconnect
+     *  the tree and more nearest neighbours must be searched for.
+     *
+     *  @param idx indices of the points to remove, in {0,...,get_n()-1}
+     *  @param m number of points to remove, m < get_n()
+     */
+    void remove(const ssize_t* idx, ssize_t m)
+    {
+        if (m <= 0) return;
+        ssize_t n_alive = n-n_removed;
+        if (m >= n_alive) throw std::domain_error("cannot remove all the points");
+
+        std::vector<ssize_t> ids(m);
+        for (ssize_t j=0; j<m; ++j) {
+            if (idx[j] < 0 || idx[j] >= n_alive)
+                throw std::domain_error("incorrect index");
+            ids[j] = alive.select(idx[j]);
+        }
+        std::sort(ids.begin(), ids.end());
+        if (std::adjacent_find(ids.begin(), ids.end()) != ids.end())
+            throw std::domain_error("duplicate indices");
+
+        for (ssize_t p : ids) {
+            removed[p] = true;
+            ++n_removed;
+            alive.erase(p);
+            levels[point_level[p]].tree.remove(point_local[p]);
+            point_level[p] = -1;
+        }
+
+        // cut the edges incident to the removed points
+        std::vector<ssize_t> affected;  // the tree neighbours
+        std::vector<ssize_t> vicinity;  // the tree and candidate neighbours
+        for (ssize_t p : ids) {
+            while (!incident[p].empty()) {
+                ssize_t e = incident[p].back();
+                ssize_t q = (edge_u[e] == p)?edge_v[e]:edge_u[e];
+                cut_edge(e);
+                if (!removed[q]) affected.push_back(q);
+            }
+            for (const std::pair<ssize_t,T>& c : pool[p]) {
+                if (!removed[c.first]) vicinity.push_back(c.first);
+            }
+            std::vector< std::pair<ssize_t,T> >().swap(pool[p]);
+        }
+        std::sort(affected.begin(), affected.end());
+        affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+        vicinity.insert(vicinity.end(), affected.begin(), affected.end());
+        std::sort(vicinity.begin(), vicinity.end());
+        vicinity.erase(std::unique(vicinity.begin(), vicinity.end()), vicinity.end());
+
+        // the nearest neighbours of the affected points might have changed
+        for (ssize_t q : affected) {
+            T r = INFTY;
+            for (ssize_t e : incident[q])
+                r = std::min(r, lct.get_weight(e));
+            set_nn_radius(q, r);
+        }
+
+        // reconnect the pieces using the pool of candidate edges
+        std::vector< CMstTriple<T> > cand;
+        for (ssize_t u : vicinity) {
+            for (const std::pair<ssize_t,T>& c : pool[u]) {
+                if (!removed[c.first])
+                    cand.push_back(CMstTriple<T>(u, c.first, c.second));
+            }
+        }
+        add_edges(cand, /*to_pool*/false);
+
+        // the pool might be outdated: refresh the affected points'
+        // nearest neighbours
+        ssize_t k = std::min(n_neighbors+1, n-n_removed);
+        std::vector<T> Y(affected.size()*d);
+        for (ssize_t i=0; i<(ssize_t)affected.size(); ++i) {
+            for (ssize_t u=0; u<d; ++u)
+                Y[i*d+u] = X[affected[i]*d+u];
+        }
+        std::vector<T> nn_dist(affected.size()*k);
+        std::vector<ssize_t> nn_ind(affected.size()*k);
+        kneighbours(Y.data(), (ssize_t)affected.size(), k, nn_dist.data(), nn_ind.data());
+        cand.clear();
+        for (ssize_t i=0; i<(ssize_t)affected.size(); ++i) {
+            for (ssize_t j=0; j<k; ++j) {
+                if (nn_ind[i*k+j] != affected[i])
+                    cand.push_back(CMstTriple<T>(affected[i], nn_ind[i*k+j], nn_dist[i*k+j]));
+            }
+        }
+        add_edges(cand);
+
+        // make sure the tree is connected
+        for (ssize_t q : affected)
+            reconnect(q, affected[0]);
+
+        // rebuild the K-d trees with too many removed points
+        for (ssize_t l=0; l<(ssize_t)levels.size(); ++l) {
+            if (2*levels[l].tree.get_n_removed() > levels[l].tree.get_n()) {
+                std::vector<ssize_t> level_ids;
+                for (ssize_t i : levels[l].ids)
+                    if (!removed[i]) level_ids.push_back(i);
+                build_level(l, level_ids);
+            }
+        }
+
+        if (n_removed > n-n_removed)
+            compact();
+    }
+
+
+    /*! Exports the tree (or forest), w.r.t. the current point numbering.
+     *
+     *  @param mst_dist [out] vector of length get_n()-1, gives weights of the
+     *        MST edges in nondecreasing order (Euclidean distances);
+     *        if the graph is not connected (in the case where
+     *        the tree was initialised with a spanning forest), the
+     *        last weights are set to INFTY
+     *  @param mst_ind [out] vector of length 2*(get_n()-1), representing
+     *        a c_contiguous array of shape (get_n()-1,2), defining the edges
+     *        corresponding to mst_d, with mst_i[j,0] < mst_i[j,1] for all j;
+     *        -1 for the missing edges
+     */
+    void get_mst(T* mst_dist, ssize_t* mst_ind) const
+    {
+        ssize_t n_alive = n-n_removed;
+        std::vector<ssize_t> pos(n, -1);
+        for (ssize_t i=0, r=0; i<n; ++i) {
+            if (!removed[i]) pos[i] = r++;
+        }
+
+        std::vector< CMstTriple<T> > res;
+        res.reserve(n_edges);
+        for (ssize_t e=0; e<(ssize_t)edge_u.size(); ++e) {
+            if (edge_u[e] < 0) continue;
+            res.push_back(CMstTriple<T>(pos[edge_u[e]], pos[edge_v[e]],
+                std::sqrt(lct.get_weight(e)), true));
+        }
+        GENIECLUST_ASSERT((ssize_t)res.size() == n_edges && n_edges <= n_alive-1);
+
+        std::sort(res.begin(), res.end());  // nonincreasing weights
+
+        for (ssize_t i=0; i<n_edges; ++i) {
+            mst_dist[i]    = res[n_edges-i-1].d;
+            mst_ind[2*i+0] = res[n_edges-i-1].i1;
+            mst_ind[2*i+1] = res[n_edges-i-1].i2;
+        }
+        for (ssize_t i=n_edges; i<n_alive-1; ++i) {
+            mst_dist[i]    = INFTY;
+            mst_ind[2*i+0] = -1;
+            mst_ind[2*i+1] = -1;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*  Half-precision (IEEE 754 binary16 and bfloat16) Storage Types
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_half_h
+#define __c_half_h
+
+#include "c_common.h"
+#include <cstdint>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+
+
+/*! Converts an IEEE 754 half-precision (binary16) number,
+ *  given by its bit pattern, to a float.
+ *
+ *  The F16C instruction is used if available (e.g., -mf16c).
+ */
+inline float __float16_to_float(uint16_t h)
+{
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    // exponent and mantissa bits moved to their float positions;
+    // multiplying by 2**(127-15) fixes the exponent bias
+    // (also for subnormals, which become normalised floats)
+    uint32_t o = (uint32_t)(h & 0x7fff) << 13;
+    float f;
+    memcpy(&f, &o, sizeof(float));
+    f *= 5.192296858534828e+33f;  // 2**112
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(float));
+    // Inf or NaN (branchless, so that conversion loops vectorise):
+    // the exponent becomes 2**(31-15); set all its bits
+    bits |= (uint32_t)(-(int32_t)((o & 0x0f800000) == 0x0f800000)) & 0x7f800000;
+    bits |= (uint32_t)(h & 0x8000) << 16;  // sign
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+#endif
+}
+
+
+/*! Converts a bfloat16 number (the upper 16 bits of a float),
+ *  given by its bit pattern, to a float.
+ */
+inline float __bfloat16_to_float(uint16_t h)
+{
+    uint32_t bits = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
+
+
+/*! An IEEE 754 half-precision number (e.g., numpy.float16);
+ *  a storage-only type: it can be converted to float, and this is all.
+ */
+struct CFloat16 {
+    uint16_t bits;
+    inline operator float() const { return __float16_to_float(bits); }
+};
+
+
+/*! A bfloat16 number (8 exponent and 7 mantissa bits);
+ *  a storage-only type: it can be converted to float, and this is all.
+ */
+struct CBFloat16 {
+    uint16_t bits;
+    inline operator float() const { return __bfloat16_to_float(bits); }
+};
+
+
+#endif
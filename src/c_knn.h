@@ -0,0 +1,977 @@
+/*  Nearest Neighbour Search (K-d Trees and Brute Force)
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_knn_h
+#define __c_knn_h
+
+#include "c_common.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "c_distance.h"
+#include "c_sparse.h"
+#include "c_binary.h"
+#include "c_argfuns.h"
+#include "c_disjoint_sets.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! Comparer used to split the points along a given dimension
+ *  when building a K-d tree.
+ */
+template<class T>
+struct __kdtree_comparer {
+    const T* X;
+    ssize_t d;
+    ssize_t dim;
+    __kdtree_comparer(const T* X, ssize_t d, ssize_t dim) {
+        this->X = X;
+        this->d = d;
+        this->dim = dim;
+    }
+    bool operator()(ssize_t i, ssize_t j) const {
+        return X[i*d+dim] < X[j*d+dim];
+    }
+};
+
+
+
+/*! A K-d tree for finding nearest neighbours with respect to
+ *  the squared Euclidean distance.
+ *
+ *  The indexed points are copied and stored in the order in which
+ *  they appear in the tree's leaves, so that the points in each leaf
+ *  occupy a contiguous memory block.
+ *
+ *  Optionally, each indexed point x can be equipped with its "core"
+ *  distance, d_core(x). In such a case, the neighbours of a query point y
+ *  are determined w.r.t. max(d(x, y), d_core(x)), i.e., the mutual
+ *  reachability distance (Campello et al., 2015) without the (constant)
+ *  d_core(y) term. This is what we need when assigning new points
+ *  to clusters determined by the Genie algorithm applied on
+ *  the MST w.r.t. the mutual reachability distance.
+ *
+ *  Works well in low-dimensional spaces.
+ *
+ *  References:
+ *  ----------
+ *
+ *  J.L. Bentley, Multidimensional binary search trees used for associative
+ *  searching, Communications of the ACM 18(9) (1975) 509–517.
+ */
+template <class T>
+class CKDTree {
+protected:
+
+    /*! A node in the K-d tree; points data[idx_from:idx_to, :] */
+    struct CKDTreeNode {
+        ssize_t idx_from;  //!< index of the first point in the node
+        ssize_t idx_to;    //!< one past the index of the last point
+        ssize_t left;      //!< index of the left child; -1 for a leaf
+        ssize_t right;     //!< index of the right child; -1 for a leaf
+    };
+
+    ssize_t n;                  //!< number of indexed points
+    ssize_t d;                  //!< dimensionality
+    ssize_t max_leaf_size;      //!< maximal number of points in a leaf
+    std::vector<T> data;        //!< n*d c_contiguous array, points in leaf order
+    std::vector<ssize_t> perm;  //!< data[i,:] is the perm[i]-th input point
+    std::vector<T> d_core;      //!< squared core distances (in leaf order) or empty
+    std::vector<CKDTreeNode> nodes; //!< nodes[0] is the root
+    std::vector<T> bbox;        //!< bounding boxes: 2*d values per node (mins, maxs)
+    std::vector<ssize_t> iperm; //!< perm[iperm[j]] == j
+    std::vector<bool> removed;  //!< removed points (in leaf order), see remove()
+    ssize_t n_removed;          //!< number of removed points
+    std::vector<T> radius;      //!< squared radii (in leaf order) or empty, see set_radii()
+    std::vector<T> node_radius; //!< max squared radius in each node
+
+
+    /*! Recursively builds the subtree for perm[idx_from:idx_to],
+     *  splits w.r.t. the median of the dimension of the largest spread.
+     *
+     *  @return index of the created node
+     */
+    ssize_t build(const T* X, ssize_t idx_from, ssize_t idx_to)
+    {
+        ssize_t id = (ssize_t)nodes.size();
+        CKDTreeNode node;
+        node.idx_from = idx_from;
+        node.idx_to   = idx_to;
+        node.left     = -1;
+        node.right    = -1;
+        nodes.push_back(node);
+
+        bbox.resize(bbox.size()+2*d);
+        T* bbox_min = bbox.data()+2*d*id;
+        T* bbox_max = bbox_min+d;
+        for (ssize_t u=0; u<d; ++u) {
+            bbox_min[u] = bbox_max[u] = X[perm[idx_from]*d+u];
+        }
+        for (ssize_t i=idx_from+1; i<idx_to; ++i) {
+            for (ssize_t u=0; u<d; ++u) {
+                T x = X[perm[i]*d+u];
+                if (x < bbox_min[u]) bbox_min[u] = x;
+                else if (x > bbox_max[u]) bbox_max[u] = x;
+            }
+        }
+
+        if (idx_to-idx_from <= max_leaf_size)
+            return id;
+
+        ssize_t dim = 0;
+        for (ssize_t u=1; u<d; ++u) {
+            if (bbox_max[u]-bbox_min[u] > bbox_max[dim]-bbox_min[dim])
+                dim = u;
+        }
+        if (!(bbox_max[dim] > bbox_min[dim]))
+            return id;  // all points are identical
+
+        ssize_t idx_mid = idx_from+(idx_to-idx_from)/2;
+        std::nth_element(perm.data()+idx_from, perm.data()+idx_mid,
+            perm.data()+idx_to, __kdtree_comparer<T>(X, d, dim));
+
+        ssize_t left  = build(X, idx_from, idx_mid);
+        ssize_t right = build(X, idx_mid,  idx_to);
+        nodes[id].left  = left;  // note that nodes might have been reallocated
+        nodes[id].right = right;
+        return id;
+    }
+
+
+    /*! Squared Euclidean distance between y and the bounding box
+     *  of a given node */
+    inline T bbox_sqdist(ssize_t id, const T* y) const
+    {
+        const T* bbox_min = bbox.data()+2*d*id;
+        const T* bbox_max = bbox_min+d;
+        T dist = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            if (y[u] < bbox_min[u])      dist += square(bbox_min[u]-y[u]);
+            else if (y[u] > bbox_max[u]) dist += square(y[u]-bbox_max[u]);
+        }
+        return dist;
+    }
+
+
+    /*! Recursively finds the k nearest neighbours of y in a given subtree;
+     *  nn_dist and nn_ind are sorted w.r.t. increasing distances */
+    void find_knn(ssize_t id, const T* y, ssize_t k,
+        T* nn_dist, ssize_t* nn_ind, ssize_t skip) const
+    {
+        const CKDTreeNode& node = nodes[id];
+        if (node.left < 0) {
+            for (ssize_t i=node.idx_from; i<node.idx_to; ++i) {
+                if (perm[i] == skip || (n_removed > 0 && removed[i])) continue;
+
+                const T* x = data.data()+i*d;
+                T dist = 0.0;
+                for (ssize_t u=0; u<d; ++u)
+                    dist += square(x[u]-y[u]);
+                if (!d_core.empty() && d_core[i] > dist)
+                    dist = d_core[i];
+
+                if (dist >= nn_dist[k-1]) continue;
+
+                // insertion sort
+                ssize_t j = k-1;
+                while (j > 0 && dist < nn_dist[j-1]) {
+                    nn_dist[j] = nn_dist[j-1];
+                    nn_ind[j]  = nn_ind[j-1];
+                    --j;
+                }
+                nn_dist[j] = dist;
+                nn_ind[j]  = perm[i];
+            }
+            return;
+        }
+
+        T dist_left  = bbox_sqdist(node.left,  y);
+        T dist_right = bbox_sqdist(node.right, y);
+        if (dist_left <= dist_right) {
+            if (dist_left  < nn_dist[k-1]) find_knn(node.left,  y, k, nn_dist, nn_ind, skip);
+            if (dist_right < nn_dist[k-1]) find_knn(node.right, y, k, nn_dist, nn_ind, skip);
+        }
+        else {
+            if (dist_right < nn_dist[k-1]) find_knn(node.right, y, k, nn_dist, nn_ind, skip);
+            if (dist_left  < nn_dist[k-1]) find_knn(node.left,  y, k, nn_dist, nn_ind, skip);
+        }
+    }
+
+
+    /*! Recursively finds the point nearest to y (the i-th point,
+     *  in leaf order) amongst the points in other components,
+     *  see mst(); nodes with all the points in the component comp
+     *  are skipped */
+    void find_nn_other(ssize_t id, const T* y, T d_core_y, ssize_t comp,
+        const ssize_t* point_comp, const ssize_t* node_comp,
+        T& best_dist, ssize_t& best_j) const
+    {
+        const CKDTreeNode& node = nodes[id];
+        if (node_comp[id] == comp) return;
+
+        if (node.left < 0) {
+            for (ssize_t j=node.idx_from; j<node.idx_to; ++j) {
+                if (point_comp[j] == comp) continue;
+
+                const T* x = data.data()+j*d;
+                T dist = 0.0;
+                for (ssize_t u=0; u<d; ++u)
+                    dist += square(x[u]-y[u]);
+                if (!d_core.empty()) {
+                    if (d_core[j] > dist) dist = d_core[j];
+                    if (d_core_y  > dist) dist = d_core_y;
+                }
+
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best_j = j;
+                }
+            }
+            return;
+        }
+
+        T dist_left  = std::max(bbox_sqdist(node.left,  y), d_core_y);
+        T dist_right = std::max(bbox_sqdist(node.right, y), d_core_y);
+        if (dist_left <= dist_right) {
+            if (dist_left  < best_dist) find_nn_other(node.left,  y, d_core_y, comp, point_comp, node_comp, best_dist, best_j);
+            if (dist_right < best_dist) find_nn_other(node.right, y, d_core_y, comp, point_comp, node_comp, best_dist, best_j);
+        }
+        else {
+            if (dist_right < best_dist) find_nn_other(node.right, y, d_core_y, comp, point_comp, node_comp, best_dist, best_j);
+            if (dist_left  < best_dist) find_nn_other(node.left,  y, d_core_y, comp, point_comp, node_comp, best_dist, best_j);
+        }
+    }
+
+
+    /*! Recursively finds the indexed points x such that d(x, y) < r(x),
+     *  see find_reverse() */
+    void find_reverse(ssize_t id, const T* y, std::vector<ssize_t>& out) const
+    {
+        const CKDTreeNode& node = nodes[id];
+        if (!(bbox_sqdist(id, y) < node_radius[id])) return;
+
+        if (node.left >= 0) {
+            find_reverse(node.left,  y, out);
+            find_reverse(node.right, y, out);
+            return;
+        }
+
+        for (ssize_t i=node.idx_from; i<node.idx_to; ++i) {
+            const T* x = data.data()+i*d;
+            T dist = 0.0;
+            for (ssize_t u=0; u<d; ++u)
+                dist += square(x[u]-y[u]);
+            if (dist < radius[i]) out.push_back(perm[i]);  // removed: -INFTY
+        }
+    }
+
+
+    /*! Recomputes the maximal radius in a given node
+     *  (assuming its children are up to date) */
+    inline void update_node_radius(ssize_t id)
+    {
+        const CKDTreeNode& node = nodes[id];
+        if (node.left >= 0) {
+            node_radius[id] = std::max(node_radius[node.left],
+                                       node_radius[node.right]);
+        }
+        else {
+            node_radius[id] = -INFTY;
+            for (ssize_t i=node.idx_from; i<node.idx_to; ++i)
+                node_radius[id] = std::max(node_radius[id], radius[i]);
+        }
+    }
+
+
+    /*! Recomputes the maximal radii in the nodes on the path from the root
+     *  to the leaf containing the i-th point (in leaf order) */
+    void update_path_radius(ssize_t i)
+    {
+        std::vector<ssize_t> path;
+        ssize_t id = 0;
+        path.push_back(id);
+        while (nodes[id].left >= 0) {
+            if (i < nodes[nodes[id].left].idx_to) id = nodes[id].left;
+            else                                  id = nodes[id].right;
+            path.push_back(id);
+        }
+        for (ssize_t j=(ssize_t)path.size()-1; j>=0; --j)
+            update_node_radius(path[j]);
+    }
+
+
+public:
+    /*! Builds the K-d tree.
+     *
+     *  @param X n*d c_contiguous array; the points are copied
+     *  @param n number of points
+     *  @param d dimensionality
+     *  @param d_core optional (may be NULL) vector of length n with
+     *     the core distances of the points (not squared)
+     *  @param max_leaf_size maximal number of points in a leaf
+     */
+    CKDTree(const T* X, ssize_t n, ssize_t d, const T* d_core=NULL,
+            ssize_t max_leaf_size=32)
+        : data(n*d), perm(n), iperm(n)
+    {
+        this->n = n;
+        this->d = d;
+        this->max_leaf_size = max_leaf_size;
+        this->n_removed = 0;
+
+        if (n <= 0) return;
+        if (d <= 0) throw std::domain_error("d <= 0");
+        if (max_leaf_size <= 0) throw std::domain_error("max_leaf_size <= 0");
+
+        for (ssize_t i=0; i<n; ++i) perm[i] = i;
+        build(X, 0, n);
+
+        for (ssize_t i=0; i<n; ++i) {
+            iperm[perm[i]] = i;
+            for (ssize_t u=0; u<d; ++u)
+                data[i*d+u] = X[perm[i]*d+u];
+        }
+
+        if (d_core) {
+            this->d_core.resize(n);
+            for (ssize_t i=0; i<n; ++i)
+                this->d_core[i] = square(d_core[perm[i]]);
+        }
+    }
+
+    CKDTree() : CKDTree(NULL, 0, 0) { }
+
+
+    /*! Returns the number of indexed points. */
+    ssize_t get_n() const { return n; }
+
+
+    /*! Returns the dimensionality of the indexed points. */
+    ssize_t get_d() const { return d; }
+
+
+    /*! Returns the number of removed points. */
+    ssize_t get_n_removed() const { return n_removed; }
+
+
+    /*! Marks the j-th point as removed: it will not be reported
+     *  by kneighbours() nor find_reverse() anymore.
+     *
+     *  Note that the bounding boxes are not shrunk.
+     *
+     *  @param j index of a point (in the original numbering)
+     */
+    void remove(ssize_t j)
+    {
+        if (j < 0 || j >= n) throw std::domain_error("incorrect index");
+        ssize_t i = iperm[j];
+        if (removed.empty()) removed.resize(n, false);
+        if (removed[i]) return;
+        removed[i] = true;
+        ++n_removed;
+        if (!radius.empty()) {
+            radius[i] = -INFTY;
+            update_path_radius(i);
+        }
+    }
+
+
+    /*! Sets the radii of the indexed points, see find_reverse().
+     *
+     *  @param radii vector of length n, squared radii of the indexed
+     *     points (in the original numbering)
+     */
+    void set_radii(const T* radii)
+    {
+        if (n <= 0) return;
+        radius.resize(n);
+        for (ssize_t i=0; i<n; ++i) {
+            if (n_removed > 0 && removed[i]) radius[i] = -INFTY;
+            else radius[i] = radii[perm[i]];
+        }
+        node_radius.resize(nodes.size());
+        for (ssize_t id=(ssize_t)nodes.size()-1; id>=0; --id) {
+            // children have greater indices than their parents
+            update_node_radius(id);
+        }
+    }
+
+
+    /*! Changes the radius of the j-th point, see find_reverse().
+     *
+     *  Run time: O(log n + max_leaf_size).
+     *
+     *  @param j index of a point (in the original numbering)
+     *  @param r new squared radius
+     */
+    void set_radius(ssize_t j, T r)
+    {
+        if (j < 0 || j >= n) throw std::domain_error("incorrect index");
+        if (radius.empty()) throw std::domain_error("call set_radii() first");
+        ssize_t i = iperm[j];
+        if (n_removed > 0 && removed[i]) return;
+        if (radius[i] == r) return;
+        radius[i] = r;
+        update_path_radius(i);
+    }
+
+
+    /*! Finds all the indexed points x such that d(x, y)^2 < r(x),
+     *  i.e., the reverse neighbours of y given the radii r,
+     *  see set_radii().
+     *
+     *  @param y query point
+     *  @param out [out] the indices of the reverse neighbours
+     *     (in the original numbering) are appended here
+     */
+    void find_reverse(const T* y, std::vector<ssize_t>& out) const
+    {
+        if (n <= 0) return;
+        if (radius.empty()) throw std::domain_error("call set_radii() first");
+        find_reverse(0, y, out);
+    }
+
+
+    /*! Finds the k nearest neighbours of each of the m query points.
+     *
+     *  If core distances were provided,
+     *  max(d(x, y), d_core(x)) is used as the distance between
+     *  an indexed point x and a query point y.
+     *
+     *  @param Y m*d c_contiguous array with the query points
+     *  @param m number of query points
+     *  @param k number of nearest neighbours to find, k <= n-get_n_removed()
+     *  @param nn_dist [out] c_contiguous array of shape (m,k);
+     *     squared distances to the nearest neighbours, sorted nondecreasingly
+     *  @param nn_ind [out] c_contiguous array of shape (m,k);
+     *     indices of the nearest neighbours (in the original numbering)
+     *  @param skip_self if true, then Y is assumed to be the same as the
+     *     indexed dataset (m==n) and the i-th point is not considered
+     *     a neighbour of itself
+     */
+    void kneighbours(const T* Y, ssize_t m, ssize_t k,
+        T* nn_dist, ssize_t* nn_ind, bool skip_self=false) const
+    {
+        if (k <= 0) throw std::domain_error("k <= 0");
+        if (k > n-n_removed-(ssize_t)skip_self) throw std::domain_error("k is too large");
+        if (skip_self && m != n) throw std::domain_error("m != n");
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 64)
+#endif
+        for (ssize_t i=0; i<m; ++i) {
+            for (ssize_t j=0; j<k; ++j) {
+                nn_dist[i*k+j] = INFTY;
+                nn_ind[i*k+j]  = -1;
+            }
+            find_knn(0, Y+i*d, k, nn_dist+i*k, nn_ind+i*k, skip_self?i:-1);
+        }
+    }
+
+
+    /*! Determines a minimum spanning tree of the indexed points
+     *  w.r.t. the squared Euclidean distance (or the mutual reachability
+     *  distance, if core distances were provided) by means of
+     *  Borůvka's algorithm.
+     *
+     *  In each iteration, the nearest neighbour of each point amongst
+     *  the points in other connected components is determined
+     *  (nodes whose points all belong to the same component as the query
+     *  point are not visited; the neighbours found in the previous
+     *  iterations are reused if they are still in other components);
+     *  then, the shortest edge leaving each component is added to the tree.
+     *  The number of components at least halves in each iteration,
+     *  hence, in low-dimensional spaces, the run time is
+     *  O(n log^2 n) in practice.
+     *
+     *  Removed points (see remove()) are not supported.
+     *
+     *  References:
+     *  ----------
+     *
+     *  O. Borůvka, O jistém problému minimálním,
+     *  Práce Moravské Přírodovědecké Společnosti 3 (1926) 37–58.
+     *
+     *  W.B. March, P. Ram, A.G. Gray, Fast Euclidean minimum spanning tree:
+     *  Algorithm, analysis, and applications, Proc. KDD'10, 2010, 603–612.
+     *
+     *  @param mst_dist [out] vector of length n-1, the (squared) weights
+     *     of the MST edges in nondecreasing order
+     *  @param mst_ind [out] c_contiguous array of shape (n-1,2)
+     *     defining the edges corresponding to mst_dist (in the original
+     *     numbering), with mst_ind[j,0] < mst_ind[j,1]; ties are sorted
+     *     w.r.t. the 1st and then the 2nd index
+     */
+    void mst(T* mst_dist, ssize_t* mst_ind) const
+    {
+        if (n <= 0) throw std::domain_error("n <= 0");
+        if (n_removed > 0) throw std::domain_error("removed points are not supported");
+
+        struct Edge {
+            T d;
+            ssize_t i1, i2;
+            bool operator<(const Edge& other) const {
+                if (d != other.d) return d < other.d;
+                if (i1 != other.i1) return i1 < other.i1;
+                return i2 < other.i2;
+            }
+        };
+
+        CDisjointSets ds(n);  // in leaf order
+        std::vector<ssize_t> point_comp(n);
+        std::vector<ssize_t> node_comp(nodes.size());
+        std::vector<T> nn_dist(n, INFTY);
+        std::vector<ssize_t> nn_ind(n, -1);
+        std::vector<ssize_t> comp_best(n);
+        std::vector<Edge> edges;
+        edges.reserve(n-1);
+
+        while (ds.get_k() > 1) {
+            for (ssize_t i=0; i<n; ++i)
+                point_comp[i] = ds.find(i);
+
+            for (ssize_t id=(ssize_t)nodes.size()-1; id>=0; --id) {
+                // children have greater indices than their parents
+                const CKDTreeNode& node = nodes[id];
+                if (node.left >= 0) {
+                    node_comp[id] = (node_comp[node.left] == node_comp[node.right])?
+                        node_comp[node.left]:-1;
+                }
+                else {
+                    node_comp[id] = point_comp[node.idx_from];
+                    for (ssize_t i=node.idx_from+1; i<node.idx_to; ++i) {
+                        if (point_comp[i] != node_comp[id]) {
+                            node_comp[id] = -1;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            const ssize_t* __point_comp = point_comp.data();
+            const ssize_t* __node_comp  = node_comp.data();
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(dynamic, 64)
+#endif
+            for (ssize_t i=0; i<n; ++i) {
+                // still in another component? then it is still the nearest
+                if (nn_ind[i] >= 0 && __point_comp[nn_ind[i]] != __point_comp[i])
+                    continue;
+                T best_dist = INFTY;
+                ssize_t best_j = -1;
+                find_nn_other(0, data.data()+i*d,
+                    d_core.empty()?(T)0.0:d_core[i], __point_comp[i],
+                    __point_comp, __node_comp, best_dist, best_j);
+                nn_dist[i] = best_dist;
+                nn_ind[i]  = best_j;
+            }
+
+            // the shortest edge leaving each component
+            for (ssize_t i=0; i<n; ++i)
+                comp_best[i] = -1;
+            for (ssize_t i=0; i<n; ++i) {
+                ssize_t c = point_comp[i];
+                if (comp_best[c] < 0 || nn_dist[i] < nn_dist[comp_best[c]])
+                    comp_best[c] = i;
+            }
+
+            std::vector<Edge> cand;
+            for (ssize_t c=0; c<n; ++c) {
+                ssize_t i = comp_best[c];
+                if (i < 0) continue;
+                ssize_t u = perm[i], v = perm[nn_ind[i]];
+                cand.push_back(Edge{nn_dist[i], std::min(u, v), std::max(u, v)});
+            }
+            std::sort(cand.begin(), cand.end());
+            for (const Edge& e : cand) {
+                // the same edge might have been chosen by both components
+                ssize_t u = iperm[e.i1], v = iperm[e.i2];
+                if (ds.find(u) == ds.find(v)) continue;
+                ds.merge(u, v);
+                edges.push_back(e);
+            }
+        }
+
+        GENIECLUST_ASSERT((ssize_t)edges.size() == n-1);
+        std::sort(edges.begin(), edges.end());
+        for (ssize_t j=0; j<n-1; ++j) {
+            mst_dist[j]      = edges[j].d;
+            mst_ind[2*j+0]   = edges[j].i1;
+            mst_ind[2*j+1]   = edges[j].i2;
+        }
+    }
+};
+
+
+
+/*! (internal) Cnn_from_distance() for the Euclidean distance
+ *  in high-dimensional spaces (dist->use_dot is true).
+ *
+ *  The dot products between blocks of 4 query points and 4 indexed
+ *  points are computed at a time, see __dot_tile_4x4().
+ *  The squared distances are compared with the squared core distances;
+ *  the square roots are only taken on the results (unless dist->squared).
+ */
+template <class T, class S>
+void __Cnn_from_euclidean_dot(const CDistanceEuclidean<T, S>* dist, ssize_t n,
+    ssize_t m, const T* d_core, T* nn_dist, ssize_t* nn_ind)
+{
+    const ssize_t R = 4, C = 4;
+    const S* X = dist->X;
+    ssize_t d = dist->d;
+    ssize_t n_blocks = (n+C-1)/C;
+
+    std::vector<T> d_core_squared;
+    if (d_core && !dist->squared) {
+        d_core_squared.resize(n);
+        for (ssize_t j=0; j<n; ++j) d_core_squared[j] = square(d_core[j]);
+        d_core = d_core_squared.data();
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (ssize_t i0=0; i0<m; i0+=R) {
+        ssize_t r_max = std::min(R, m-i0);
+        const S* x[R];
+        T bestdist[R];
+        ssize_t bestj[R];
+        for (ssize_t r=0; r<R; ++r) {
+            x[r] = dist->row(n+i0+std::min(r, r_max-1));  // pad with the last point
+            bestdist[r] = INFTY;
+            bestj[r] = 0;
+        }
+
+        for (ssize_t b=0; b<n_blocks; ++b) {
+            ssize_t j0 = b*C;
+            ssize_t c_max = std::min(C, n-j0);
+            const S* y[C];
+            T dot[R*C];
+            for (ssize_t c=0; c<C; ++c)
+                y[c] = X+d*(j0+std::min(c, c_max-1));
+
+            __dot_tile_4x4(x, y, d, dot);
+
+            for (ssize_t r=0; r<r_max; ++r) {
+                for (ssize_t c=0; c<c_max; ++c) {
+                    T curdist = dist->sqdist_from_dot(n+i0+r, j0+c, dot[r*C+c]);
+                    if (d_core && d_core[j0+c] > curdist)
+                        curdist = d_core[j0+c];
+                    if (curdist < bestdist[r]) {
+                        bestdist[r] = curdist;
+                        bestj[r] = j0+c;
+                    }
+                }
+            }
+        }
+
+        for (ssize_t r=0; r<r_max; ++r) {
+            nn_dist[i0+r] = (dist->squared)?bestdist[r]:sqrt(bestdist[r]);
+            nn_ind[i0+r]  = bestj[r];
+        }
+    }
+}
+
+
+
+/*! (internal) Cnn_from_distance() for the Euclidean distance
+ *  with a scalar-quantised copy of the data (dist->use_quantized is true).
+ *
+ *  The exact (squared) distance is only computed if its lower bound
+ *  (see CQuantizedEuclidean) is smaller than the distance to the current
+ *  nearest neighbour; the results are the same as with the exact distances.
+ */
+template <class T, class S>
+void __Cnn_from_euclidean_quantized(const CDistanceEuclidean<T, S>* dist,
+    ssize_t n, ssize_t m, const T* d_core, T* nn_dist, ssize_t* nn_ind)
+{
+    std::vector<T> d_core_squared;
+    if (d_core && !dist->squared) {
+        d_core_squared.resize(n);
+        for (ssize_t j=0; j<n; ++j) d_core_squared[j] = square(d_core[j]);
+        d_core = d_core_squared.data();
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (ssize_t i=0; i<m; ++i) {
+        ssize_t bestj = 0;
+        T bestdist = INFTY;
+        for (ssize_t j=0; j<n; ++j) {
+            T mindist = (d_core)?d_core[j]:0.0;
+            if (!(mindist < bestdist)) continue;
+
+            T lb = dist->sqdist_lower_bound(n+i, j);
+            if (!(lb < bestdist)) continue;
+
+            T curdist = dist->sqdist(n+i, j);
+            if (mindist > curdist) curdist = mindist;
+            if (curdist < bestdist) {
+                bestdist = curdist;
+                bestj = j;
+            }
+        }
+
+        nn_dist[i] = (dist->squared)?bestdist:sqrt(bestdist);
+        nn_ind[i]  = bestj;
+    }
+}
+
+
+
+/*! (internal) Cnn_from_distance() for the distances whose
+ *  DIST::pairwise(i, j) is thread-safe; the query points are processed
+ *  in parallel.
+ */
+template <class T, class DIST>
+void __Cnn_from_pairwise(const DIST* dist, ssize_t n, ssize_t m,
+    const T* d_core, T* nn_dist, ssize_t* nn_ind)
+{
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (ssize_t i=0; i<m; ++i) {
+        ssize_t bestj = 0;
+        T bestdist = INFTY;
+        for (ssize_t j=0; j<n; ++j) {
+            if (d_core && !(d_core[j] < bestdist)) continue;
+            T curdist = dist->pairwise(n+i, j);
+            if (d_core && d_core[j] > curdist) curdist = d_core[j];
+            if (curdist < bestdist) {
+                bestdist = curdist;
+                bestj = j;
+            }
+        }
+
+        nn_dist[i] = bestdist;
+        nn_ind[i]  = bestj;
+    }
+}
+
+
+
+/*! (internal) Calls __Cnn_from_pairwise() if dist is of type DIST;
+ *  returns false otherwise
+ */
+template <class DIST, class T>
+bool __Cnn_from_pairwise_if(CDistance<T>* dist, ssize_t n, ssize_t m,
+    const T* d_core, T* nn_dist, ssize_t* nn_ind)
+{
+    const DIST* d = dynamic_cast<const DIST*>(dist);
+    if (!d) return false;
+    __Cnn_from_pairwise(d, n, m, d_core, nn_dist, nn_ind);
+    return true;
+}
+
+
+
+/*! Determines the nearest neighbours of m query points
+ *  amongst n indexed points, where the distances between the points
+ *  are computed (by brute force) by a CDistance object.
+ *
+ *  The indexed points are numbered 0, 1, ..., n-1 and the query ones
+ *  n, n+1, ..., n+m-1. Hence, the query points must be given
+ *  via CDistance::set_queries() (or the like), or the distance object
+ *  must be defined over n+m points, e.g., a stacked data matrix.
+ *  This way, any supported metric can be used.
+ *
+ *  If d_core is given, then max(d(x, y), d_core(x)) is used as
+ *  the distance between an indexed point x and a query point y.
+ *
+ *  For the Euclidean distance in high-dimensional spaces,
+ *  query-by-indexed point tiles of dot products are computed.
+ *  If CDistanceEuclidean::quantize() was called, the lower bounds
+ *  of the distances are used to avoid most of the exact computations.
+ *  For the other distances provided by this library, the query points
+ *  are processed in parallel, see __Cnn_from_pairwise(); otherwise
+ *  (e.g., for the callbacks), the distances from each query point
+ *  are computed in parallel.
+ *
+ *  @param dist a callable CDistance object over n+m points
+ *  @param n number of indexed points
+ *  @param m number of query points
+ *  @param d_core optional (may be NULL) vector of length n with
+ *     the core distances of the indexed points
+ *  @param nn_dist [out] vector of length m, nn_dist[i] is the distance
+ *     between the (n+i)-th point and its nearest neighbour
+ *  @param nn_ind [out] vector of length m, nn_ind[i] is the index
+ *     (in {0, ..., n-1}) of the nearest neighbour of the (n+i)-th point
+ */
+template <class T>
+void Cnn_from_distance(CDistance<T>* dist, ssize_t n, ssize_t m,
+    const T* d_core, T* nn_dist, ssize_t* nn_ind)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+
+    CDistanceEuclidean<T>* d_euclid = dynamic_cast< CDistanceEuclidean<T>* >(dist);
+    if (d_euclid && d_euclid->use_quantized) {
+        __Cnn_from_euclidean_quantized(d_euclid, n, m, d_core, nn_dist, nn_ind);
+        return;
+    }
+    else if (d_euclid && d_euclid->use_dot) {
+        __Cnn_from_euclidean_dot(d_euclid, n, m, d_core, nn_dist, nn_ind);
+        return;
+    }
+
+    if (
+        __Cnn_from_pairwise_if< CDistanceEuclidean<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceManhattan<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceCosine<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceChebyshev<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceMinkowski<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceHaversine<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceSparseEuclidean<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceSparseManhattan<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceSparseCosine<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceHamming<T> >(dist, n, m, d_core, nn_dist, nn_ind) ||
+        __Cnn_from_pairwise_if< CDistanceJaccardBits<T> >(dist, n, m, d_core, nn_dist, nn_ind)
+    ) return;
+
+    std::vector<ssize_t> M(n);
+    for (ssize_t j=0; j<n; ++j) M[j] = j;
+
+    for (ssize_t i=0; i<m; ++i) {
+        // pragma omp parallel for inside::
+        const T* dist_from_i = (*dist)(n+i, M.data(), n);
+
+        ssize_t bestj = 0;
+        T bestdist = INFTY;
+        for (ssize_t j=0; j<n; ++j) {
+            T curdist = dist_from_i[j];
+            if (d_core && d_core[j] > curdist) curdist = d_core[j];
+            if (curdist < bestdist) {
+                bestdist = curdist;
+                bestj = j;
+            }
+        }
+
+        nn_dist[i] = bestdist;
+        nn_ind[i]  = bestj;
+    }
+}
+
+
+
+/*! Determines the k nearest neighbours of each of the n points,
+ *  where the distances between the points are computed
+ *  (by brute force) by a CDistance object.
+ *
+ *  This way, any supported metric can be used, e.g., to compute
+ *  the core distances for the mutual reachability distance.
+ *
+ *  @param dist a callable CDistance object over n points
+ *  @param n number of points
+ *  @param k number of nearest neighbours, 1 <= k < n
+ *  @param nn_dist [out] c_contiguous array of shape (n,k),
+ *     nn_dist[i,:] gives the distances to the k nearest neighbours
+ *     of the i-th point, in nondecreasing order
+ *  @param nn_ind [out] c_contiguous array of shape (n,k),
+ *     nn_ind[i,:] gives the indices of the neighbours (ties are resolved
+ *     in favour of the points with smaller indices)
+ */
+template <class T>
+void Cknn_from_distance(CDistance<T>* dist, ssize_t n, ssize_t k,
+    T* nn_dist, ssize_t* nn_ind)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    if (k <= 0 || k >= n) throw std::domain_error("k not in [1, n-1]");
+
+    std::vector<ssize_t> M(n-1);
+    std::vector<T> dist_i(n-1);
+    for (ssize_t i=0; i<n; ++i) {
+        // M = {0, ..., n-1} \ {i}
+        for (ssize_t j=0; j<i; ++j) M[j] = j;
+        for (ssize_t j=i+1; j<n; ++j) M[j-1] = j;
+
+        // pragma omp parallel for inside::
+        const T* dist_from_i = (*dist)(i, M.data(), n-1);
+        for (ssize_t j=0; j<n-1; ++j) dist_i[j] = dist_from_i[M[j]];
+
+        ssize_t* ind_i = nn_ind+i*k;
+        Cargkmin(dist_i.data(), n-1, k-1, ind_i);
+        for (ssize_t u=0; u<k; ++u) {
+            nn_dist[i*k+u] = dist_i[ind_i[u]];
+            ind_i[u] = M[ind_i[u]];
+        }
+    }
+}
+
+
+/*! Determines a minimum spanning tree w.r.t. the great-circle distance
+ *  (or the mutual reachability distance based thereon) between points
+ *  on the unit sphere, see CDistanceHaversine.
+ *
+ *  The geodesic distance is an increasing function of the chord
+ *  (3D Euclidean) distance between the corresponding unit vectors,
+ *  therefore both yield the same MSTs. Hence, the Euclidean MST of
+ *  the unit vectors is determined by means of a K-d tree
+ *  (see CKDTree::mst(); O(n log^2 n) time in practice instead of O(n^2))
+ *  and the chord lengths are converted to the arc lengths afterwards.
+ *
+ *  @param X n*2 c_contiguous array (latitudes and longitudes in radians)
+ *  @param n number of points
+ *  @param d_core optional (may be NULL) vector of length n with
+ *     the core distances (arc lengths)
+ *  @param mst_dist [out] vector of length n-1, see Cmst_from_complete()
+ *  @param mst_ind [out] vector of length 2*(n-1), see Cmst_from_complete()
+ */
+template <class T>
+void Cmst_from_haversine(const T* X, ssize_t n, const T* d_core,
+    T* mst_dist, ssize_t* mst_ind)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+
+    std::vector<T> U(3*n);
+    CDistanceHaversine<T>::latlon_to_unit(X, n, U.data());
+
+    std::vector<T> d_core_chord;
+    if (d_core) {
+        d_core_chord.resize(n);
+        for (ssize_t i=0; i<n; ++i)
+            d_core_chord[i] = CDistanceHaversine<T>::arc_to_chord(d_core[i]);
+    }
+
+    CKDTree<T> tree(U.data(), n, 3, d_core?d_core_chord.data():NULL);
+    tree.mst(mst_dist, mst_ind);
+
+    for (ssize_t j=0; j<n-1; ++j)
+        mst_dist[j] = CDistanceHaversine<T>::chord_to_arc(sqrt(mst_dist[j]));
+}
+
+
+#endif
@@ -0,0 +1,307 @@
+/*  Link-Cut Trees (Dynamic Trees) with Path-Maximum Queries
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_link_cut_tree_h
+#define __c_link_cut_tree_h
+
+#include "c_common.h"
+#include <algorithm>
+#include <vector>
+
+
+
+/*! Link-Cut Trees (Sleator, Tarjan, 1983)
+ *
+ *  Represents a forest of rooted trees over the nodes {0,1,...,n-1},
+ *  where new nodes can be added at any time. Each node has an associated
+ *  weight. Supports the following operations in O(log n)
+ *  amortised time: linking two trees by an edge, cutting an edge,
+ *  checking if two nodes belong to the same tree, and finding a node
+ *  of the maximal weight on the path between two nodes.
+ *
+ *  In order to represent a weighted undirected graph (say, a minimum
+ *  spanning forest), each edge {u,v} should be modelled as a separate node e,
+ *  linked to both u and v, with the vertex nodes having the weight
+ *  of -INFTY. This way, the path-maximum query gives the heaviest edge
+ *  on the path between two vertices, which is what we need for the
+ *  cycle property-based MST updates.
+ *
+ *  Each tree is stored as a set of preferred paths, each kept
+ *  in a splay tree keyed by depth; the path-parent pointers
+ *  are stored in the parent fields of the splay trees' roots.
+ *
+ *  References:
+ *  ----------
+ *
+ *  D.D. Sleator, R.E. Tarjan, A data structure for dynamic trees,
+ *  Journal of Computer and System Sciences 26(3) (1983) 362–391.
+ */
+template <class T>
+class CLinkCutTree {
+
+protected:
+
+    struct CLinkCutTreeNode {
+        ssize_t left;    //!< left child in the splay tree, -1 if none
+        ssize_t right;   //!< right child in the splay tree, -1 if none
+        ssize_t parent;  //!< splay tree parent or path-parent, -1 if none
+        bool flip;       //!< are the children (recursively) to be swapped?
+        T weight;        //!< node weight
+        ssize_t argmax;  //!< node of the maximal weight in the splay subtree
+    };
+
+    std::vector<CLinkCutTreeNode> nodes;
+
+
+    /*! Is x the root of its splay tree? */
+    inline bool is_splay_root(ssize_t x) const {
+        ssize_t p = nodes[x].parent;
+        return p < 0 || (nodes[p].left != x && nodes[p].right != x);
+    }
+
+
+    /*! Pushes the pending reversal down to x's children */
+    inline void push(ssize_t x) {
+        if (!nodes[x].flip) return;
+        std::swap(nodes[x].left, nodes[x].right);
+        if (nodes[x].left  >= 0) nodes[nodes[x].left].flip  = !nodes[nodes[x].left].flip;
+        if (nodes[x].right >= 0) nodes[nodes[x].right].flip = !nodes[nodes[x].right].flip;
+        nodes[x].flip = false;
+    }
+
+
+    /*! Recomputes x's aggregate (argmax) based on its children */
+    inline void update(ssize_t x) {
+        ssize_t a = x;
+        ssize_t l = nodes[x].left;
+        ssize_t r = nodes[x].right;
+        if (l >= 0 && nodes[nodes[l].argmax].weight > nodes[a].weight)
+            a = nodes[l].argmax;
+        if (r >= 0 && nodes[nodes[r].argmax].weight > nodes[a].weight)
+            a = nodes[r].argmax;
+        nodes[x].argmax = a;
+    }
+
+
+    /*! Rotates x over its splay tree parent */
+    void rotate(ssize_t x) {
+        ssize_t y = nodes[x].parent;
+        ssize_t z = nodes[y].parent;
+
+        if (!is_splay_root(y)) {
+            if (nodes[z].left == y) nodes[z].left  = x;
+            else                    nodes[z].right = x;
+        }
+        nodes[x].parent = z;  // a splay tree parent or a path-parent
+
+        if (nodes[y].left == x) {
+            nodes[y].left = nodes[x].right;
+            if (nodes[y].left >= 0) nodes[nodes[y].left].parent = y;
+            nodes[x].right = y;
+        }
+        else {
+            nodes[y].right = nodes[x].left;
+            if (nodes[y].right >= 0) nodes[nodes[y].right].parent = y;
+            nodes[x].left = y;
+        }
+        nodes[y].parent = x;
+
+        update(y);
+        update(x);
+    }
+
+
+    /*! Makes x the root of its splay tree */
+    void splay(ssize_t x) {
+        // push the pending reversals from the splay tree root down to x
+        path_buf.clear();
+        ssize_t y = x;
+        path_buf.push_back(y);
+        while (!is_splay_root(y)) {
+            y = nodes[y].parent;
+            path_buf.push_back(y);
+        }
+        for (ssize_t i=(ssize_t)path_buf.size()-1; i>=0; --i)
+            push(path_buf[i]);
+
+        while (!is_splay_root(x)) {
+            y = nodes[x].parent;
+            if (!is_splay_root(y)) {
+                ssize_t z = nodes[y].parent;
+                if ((nodes[z].left == y) == (nodes[y].left == x))
+                    rotate(y);  // zig-zig
+                else
+                    rotate(x);  // zig-zag
+            }
+            rotate(x);
+        }
+    }
+
+
+    /*! Makes the path from x to the root of its tree preferred;
+     *  x becomes the root of its splay tree */
+    void access(ssize_t x) {
+        ssize_t last = -1;
+        for (ssize_t y=x; y>=0; y=nodes[y].parent) {
+            splay(y);
+            nodes[y].right = last;
+            update(y);
+            last = y;
+        }
+        splay(x);
+    }
+
+
+    /*! Makes x the root of its tree */
+    void make_root(ssize_t x) {
+        access(x);
+        nodes[x].flip = !nodes[x].flip;
+        push(x);
+    }
+
+
+    std::vector<ssize_t> path_buf; //!< working buffer for splay()
+
+
+public:
+    /*! Constructs an empty forest.
+     */
+    CLinkCutTree() { }
+
+
+    /*! Returns the number of nodes.
+     */
+    ssize_t get_n() const { return (ssize_t)nodes.size(); }
+
+
+    /*! Adds a new isolated node.
+     *
+     *  @param weight node weight
+     *
+     *  @return the index of the new node
+     */
+    ssize_t add_node(T weight) {
+        CLinkCutTreeNode node;
+        node.left   = -1;
+        node.right  = -1;
+        node.parent = -1;
+        node.flip   = false;
+        node.weight = weight;
+        node.argmax = (ssize_t)nodes.size();
+        nodes.push_back(node);
+        return node.argmax;
+    }
+
+
+    /*! Changes the weight of an isolated node (e.g., before it is reused).
+     *
+     *  @param x node index
+     *  @param weight new weight
+     */
+    void set_weight(ssize_t x, T weight) {
+        GENIECLUST_ASSERT(x >= 0 && x < get_n());
+        access(x);
+        nodes[x].weight = weight;
+        update(x);
+    }
+
+
+    /*! Returns the weight of a given node.
+     */
+    T get_weight(ssize_t x) const {
+        GENIECLUST_ASSERT(x >= 0 && x < get_n());
+        return nodes[x].weight;
+    }
+
+
+    /*! Finds the root of the tree containing x.
+     */
+    ssize_t find_root(ssize_t x) {
+        GENIECLUST_ASSERT(x >= 0 && x < get_n());
+        access(x);
+        push(x);
+        while (nodes[x].left >= 0) {
+            x = nodes[x].left;
+            push(x);
+        }
+        splay(x);
+        return x;
+    }
+
+
+    /*! Checks whether x and y belong to the same tree.
+     */
+    bool connected(ssize_t x, ssize_t y) {
+        if (x == y) return true;
+        return find_root(x) == find_root(y);
+    }
+
+
+    /*! Links two trees by adding the edge {x,y}.
+     *
+     *  x and y must belong to different trees (this is not checked).
+     */
+    void link(ssize_t x, ssize_t y) {
+        GENIECLUST_ASSERT(x >= 0 && x < get_n() && y >= 0 && y < get_n());
+        make_root(x);
+        nodes[x].parent = y;
+    }
+
+
+    /*! Removes the edge {x,y}, which must exist.
+     */
+    void cut(ssize_t x, ssize_t y) {
+        GENIECLUST_ASSERT(x >= 0 && x < get_n() && y >= 0 && y < get_n());
+        make_root(x);
+        access(y);
+        // now the preferred path is x -- y, y is the splay root
+        GENIECLUST_ASSERT(nodes[y].left == x && nodes[x].right < 0);
+        nodes[y].left   = -1;
+        nodes[x].parent = -1;
+        update(y);
+    }
+
+
+    /*! Finds the node of the maximal weight on the path between x and y.
+     *
+     *  x and y must belong to the same tree.
+     */
+    ssize_t path_argmax(ssize_t x, ssize_t y) {
+        GENIECLUST_ASSERT(x >= 0 && x < get_n() && y >= 0 && y < get_n());
+        make_root(x);
+        access(y);
+        return nodes[y].argmax;
+    }
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*  Manhattan minimum spanning trees in the plane
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_manhattan_mst_h
+#define __c_manhattan_mst_h
+
+#include "c_common.h"
+#include "c_mst.h"
+#include "c_delaunay.h"
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! (internal) Returns a+b < c+d, computed exactly
+ *  (the floating-point sums are compared first, then their rounding errors).
+ */
+inline bool __sum_less(double a, double b, double c, double d)
+{
+    double s1, e1, s2, e2;
+    __CExpansion::two_sum(a, b, s1, e1);
+    __CExpansion::two_sum(c, d, s2, e2);
+    return s1 < s2 || (s1 == s2 && e1 < e2);
+}
+
+
+/*! Determines a set of at most 4n edges of a graph whose minimum spanning
+ *  trees are the MSTs of a set of points in the plane w.r.t.
+ *  the Manhattan (L1) distance: for each point and each of the 8 octants
+ *  around it, only the edge to the nearest point in that octant is needed
+ *  (Guibas, Stolfi; Zhou, Shenoy, Nicholls).
+ *
+ *  Each pair of opposite octants is processed by means of a single sweep
+ *  over the points sorted w.r.t. x+y, with an ordered map keeping
+ *  the points whose nearest neighbour in the current octant
+ *  has not been found yet (keyed by their y coordinates); the remaining
+ *  octants are handled by reflecting the coordinates. O(n log n) time.
+ *
+ *  The comparisons are exact, hence so is the result (for any inputs,
+ *  including duplicated and collinear points).
+ *
+ *  @param X n*2 c_contiguous array
+ *  @param n number of points
+ *  @param edges [out] consecutive pairs of vertices (i < j)
+ */
+template <class T>
+void Cmanhattan_mst_edges(const T* X, ssize_t n, std::vector<ssize_t>& edges)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    edges.clear();
+
+    std::vector<double> x(n), y(n);
+    for (ssize_t i=0; i<n; ++i) {
+        x[i] = (double)X[2*i+0];
+        y[i] = (double)X[2*i+1];
+    }
+
+    std::vector<ssize_t> o(n);
+    for (ssize_t k=0; k<4; ++k) {
+        for (ssize_t i=0; i<n; ++i) o[i] = i;
+        std::sort(o.begin(), o.end(), [&x, &y](ssize_t i, ssize_t j) {
+            // x[i]+y[i] < x[j]+y[j], ties resolved by the indices
+            if (__sum_less(x[i], y[i], x[j], y[j])) return true;
+            if (__sum_less(x[j], y[j], x[i], y[i])) return false;
+            return i < j;
+        });
+
+        std::map<double, ssize_t> sweep;  // -y -> point
+        for (ssize_t i: o) {
+            // the active points j with y[j] <= y[i] and
+            // x[i]-x[j] >= y[i]-y[j] have i as their nearest neighbour
+            // in the current octant
+            auto it = sweep.lower_bound(-y[i]);
+            while (it != sweep.end()) {
+                ssize_t j = it->second;
+                if (__sum_less(x[i], y[j], y[i], x[j]))  // y[i]-y[j] > x[i]-x[j]
+                    break;
+                edges.push_back(std::min(i, j));
+                edges.push_back(std::max(i, j));
+                it = sweep.erase(it);
+            }
+            sweep[-y[i]] = i;
+        }
+
+        // the next pair of octants
+        for (ssize_t i=0; i<n; ++i) {
+            if (k & 1) x[i] = -x[i];
+            else std::swap(x[i], y[i]);
+        }
+    }
+}
+
+
+
+/*! Determines a minimum spanning tree of a set of points in the plane
+ *  w.r.t. the Manhattan (L1) distance: Kruskal's algorithm
+ *  (see Cmst_from_edges()) is applied on the O(n) candidate edges
+ *  given by Cmanhattan_mst_edges().
+ *
+ *  Overall, the run time is O(n log n), compared with O(n^2)
+ *  in Cmst_from_complete().
+ *
+ *  @param X n*2 c_contiguous array
+ *  @param n number of points
+ *  @param mst_dist [out] vector of length n-1, see Cmst_from_complete()
+ *  @param mst_ind [out] vector of length 2*(n-1), see Cmst_from_complete()
+ *  @return the number of the candidate edges
+ */
+template <class T>
+ssize_t Cmst_from_manhattan_2d(const T* X, ssize_t n, T* mst_dist, ssize_t* mst_ind)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    if (n == 1) return 0;
+
+    std::vector<ssize_t> edges;
+    Cmanhattan_mst_edges(X, n, edges);
+    ssize_t m = (ssize_t)edges.size()/2;
+
+    std::vector<T> dist(m);
+    const ssize_t* __edges = edges.data();
+    T* __dist = dist.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t j=0; j<m; ++j) {
+        const T* x = X+2*__edges[2*j+0];
+        const T* y = X+2*__edges[2*j+1];
+        __dist[j] = (T)(fabs((double)x[0]-(double)y[0])+fabs((double)x[1]-(double)y[1]));
+    }
+
+    ssize_t ret = Cmst_from_edges(dist.data(), edges.data(), m, n, mst_dist, mst_ind);
+    GENIECLUST_ASSERT(ret == n-1);
+
+    return m;
+}
+
+
+#endif
@@ -0,0 +1,330 @@
+/*  MinHash Signatures and Locality-Sensitive Hashing for Set Data
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_minhash_h
+#define __c_minhash_h
+
+#include "c_common.h"
+#include "c_distance.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! The SplitMix64 generator: returns the next pseudorandom number
+ *  and updates the state.
+ */
+inline uint64_t __splitmix64(uint64_t& state)
+{
+    uint64_t z = (state += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+
+/*! A bijective mixing function (the SplitMix64 finaliser);
+ *  spreads the bits of consecutive integers (e.g., token IDs).
+ */
+inline uint64_t __mix64(uint64_t x)
+{
+    return __splitmix64(x);
+}
+
+
+
+/*! Computes the MinHash signatures of n sets of tokens.
+ *
+ *  The h hash functions are of the multiply-add-shift type,
+ *  h_u(x) = (a_u*x + b_u) >> 32 (mod 2^64), with a_u odd;
+ *  the tokens are mixed first, see __mix64().
+ *  The loop over the hash functions is vectorisable and the sets
+ *  are processed in parallel.
+ *
+ *  The probability that the minima of h_u over two sets
+ *  are equal is (approximately) their Jaccard similarity,
+ *  see CDistanceMinHash.
+ *
+ *  References:
+ *  ==========
+ *
+ *  [1] A.Z. Broder, On the resemblance and containment of documents,
+ *  In: Proc. Compression and Complexity of Sequences, 1997, pp. 21-29.
+ *  doi:10.1109/SEQUEN.1997.666900
+ *
+ *  @param tokens c_contiguous array of integer tokens, the i-th set
+ *     is given by tokens[indptr[i]], ..., tokens[indptr[i+1]-1]
+ *     (repetitions are allowed)
+ *  @param indptr c_contiguous array of length n+1
+ *  @param n number of sets
+ *  @param h number of hash functions (signature length)
+ *  @param seed seed for the hash functions' parameters
+ *  @param sig [out] c_contiguous array of shape (n,h);
+ *     an empty set has all elements equal to UINT32_MAX
+ */
+inline void Cminhash(const ssize_t* tokens, const ssize_t* indptr, ssize_t n,
+    ssize_t h, uint64_t seed, uint32_t* sig)
+{
+    if (n < 0)  throw std::domain_error("n < 0");
+    if (h <= 0) throw std::domain_error("h <= 0");
+
+    std::vector<uint64_t> a(h), b(h);
+    uint64_t state = seed;
+    for (ssize_t u=0; u<h; ++u) {
+        a[u] = __splitmix64(state) | UINT64_C(1);
+        b[u] = __splitmix64(state);
+    }
+    const uint64_t* __a = a.data();
+    const uint64_t* __b = b.data();
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (ssize_t i=0; i<n; ++i) {
+        uint32_t* s = sig+i*h;
+        for (ssize_t u=0; u<h; ++u) s[u] = UINT32_MAX;
+
+        for (ssize_t t=indptr[i]; t<indptr[i+1]; ++t) {
+            uint64_t x = __mix64((uint64_t)tokens[t]);
+#ifdef _OPENMP
+            #pragma omp simd
+#endif
+            for (ssize_t u=0; u<h; ++u) {
+                uint32_t v = (uint32_t)((__a[u]*x + __b[u]) >> 32);
+                s[u] = (v < s[u])?v:s[u];
+            }
+        }
+    }
+}
+
+
+
+/*! A class to compute the estimated Jaccard distances between sets
+ *  based on their MinHash signatures of length h (see Cminhash()),
+ *  i.e., the proportions of disagreeing signature elements.
+ *
+ *  The standard error of the estimate is at most 0.5/sqrt(h).
+ */
+template<class T>
+struct CDistanceMinHash : public CDistance<T>  {
+    const uint32_t* S;
+    ssize_t n;
+    ssize_t h;
+    std::vector<T> buf;
+
+    /*!
+     * @param S n*h c_contiguous array of signatures
+     * @param n number of sets
+     * @param h signature length
+     */
+    CDistanceMinHash(const uint32_t* S, ssize_t n, ssize_t h)
+        : S(S), n(n), h(h), buf(n)
+    {
+        if (n > 0 && h <= 0) throw std::domain_error("h <= 0");
+    }
+
+    CDistanceMinHash()
+        : CDistanceMinHash(NULL, 0, 0) { }
+
+    /*! Returns the distance between the i-th and the j-th set */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        const uint32_t* x = S+i*h;
+        const uint32_t* y = S+j*h;
+        ssize_t same = 0;
+#ifdef _OPENMP
+        #pragma omp simd reduction(+:same)
+#endif
+        for (ssize_t u=0; u<h; ++u)
+            same += (x[u] == y[u]);
+        return (T)(h-same)/(T)h;
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w<n)
+            __buf[w] = pairwise(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! (internal) Inserts (d, j) into a row of a nearest neighbour list
+ *  of length k, sorted w.r.t. (nn_dist, nn_ind), unless it is already there
+ *  or is not amongst the k best.
+ */
+template<class T>
+inline void __minhash_knn_insert(T* nn_dist, ssize_t* nn_ind, ssize_t k,
+    T d, ssize_t j)
+{
+    if (d > nn_dist[k-1] || (d == nn_dist[k-1] && j >= nn_ind[k-1]))
+        return;
+
+    for (ssize_t u=0; u<k; ++u)
+        if (nn_ind[u] == j) return;  // already there
+
+    ssize_t u = k-1;
+    while (u > 0 && (d < nn_dist[u-1] || (d == nn_dist[u-1] && j < nn_ind[u-1]))) {
+        nn_dist[u] = nn_dist[u-1];
+        nn_ind[u]  = nn_ind[u-1];
+        --u;
+    }
+    nn_dist[u] = d;
+    nn_ind[u]  = j;
+}
+
+
+
+/*! Determines the approximate k nearest neighbours of each set
+ *  w.r.t. the estimated Jaccard distance (see CDistanceMinHash)
+ *  by means of locality-sensitive hashing (LSH) based on
+ *  the MinHash signatures.
+ *
+ *  The signatures are split into b bands of r=floor(h/b) elements.
+ *  Two sets are candidate neighbours if all the elements in at least
+ *  one band agree, which happens with probability 1-(1-s^r)^b,
+ *  where s is their Jaccard similarity. Only the candidates' distances
+ *  are computed, therefore no n*n matrix is needed.
+ *
+ *  Within each band, the sets are sorted w.r.t. the band's hash value;
+ *  the sets in a bucket (run of equal values) of size greater than
+ *  max_bucket_size (e.g., many near-duplicates) are only compared to
+ *  the max_bucket_size/2 preceding and following ones.
+ *
+ *  The output can be fed to Cmst_from_nn(). If fewer than k candidates
+ *  were found, the i-th row is padded with (INFTY, i), which Cmst_from_nn()
+ *  skips as a self-loop.
+ *
+ *  References:
+ *  ==========
+ *
+ *  [1] J. Leskovec, A. Rajaraman, J.D. Ullman, Mining of Massive Datasets,
+ *  Cambridge University Press, 2014, Chapter 3.
+ *
+ *  @param S n*h c_contiguous array of signatures, see Cminhash()
+ *  @param n number of sets
+ *  @param h signature length
+ *  @param b number of bands, 1 <= b <= h
+ *  @param k number of nearest neighbours to find, 1 <= k < n
+ *  @param max_bucket_size see above
+ *  @param nn_dist [out] c_contiguous array of shape (n,k),
+ *     rows sorted nondecreasingly
+ *  @param nn_ind [out] c_contiguous array of shape (n,k)
+ */
+template<class T>
+void Cminhash_lsh_knn(const uint32_t* S, ssize_t n, ssize_t h, ssize_t b,
+    ssize_t k, ssize_t max_bucket_size, T* nn_dist, ssize_t* nn_ind)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    if (b <= 0 || b > h) throw std::domain_error("b not in [1, h]");
+    if (k <= 0 || k >= n) throw std::domain_error("k not in [1, n-1]");
+    if (max_bucket_size < 2) throw std::domain_error("max_bucket_size < 2");
+
+    ssize_t r = h/b;
+    ssize_t w = max_bucket_size/2;
+    CDistanceMinHash<T> dist(S, n, h);
+
+    for (ssize_t i=0; i<n; ++i) {
+        for (ssize_t u=0; u<k; ++u) {
+            nn_dist[i*k+u] = INFTY;
+            nn_ind[i*k+u]  = i;
+        }
+    }
+
+    std::vector<uint64_t> key(n);
+    std::vector<ssize_t> order(n);  // the sets sorted w.r.t. (key, index)
+    std::vector<ssize_t> lo(n);     // the bucket of order[p] is order[lo[p]:hi[p]]
+    std::vector<ssize_t> hi(n);
+    for (ssize_t band=0; band<b; ++band) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t i=0; i<n; ++i) {
+            const uint32_t* s = S+i*h+band*r;
+            uint64_t z = (uint64_t)band;
+            for (ssize_t u=0; u<r; ++u)
+                z = __mix64(z ^ (uint64_t)s[u]);
+            key[i] = z;
+            order[i] = i;
+        }
+
+        std::sort(order.begin(), order.end(), [&key](ssize_t i, ssize_t j) {
+            return key[i] < key[j] || (key[i] == key[j] && i < j);
+        });
+
+        for (ssize_t p=0; p<n; ) {
+            ssize_t q = p+1;
+            while (q < n && key[order[q]] == key[order[p]]) ++q;
+            for (ssize_t t=p; t<q; ++t) {
+                lo[t] = p;
+                hi[t] = q;
+            }
+            p = q;
+        }
+
+        // each thread only modifies the rows of its own points;
+        // the points are visited bucket by bucket (the signatures
+        // of the candidates are likely to be in the cache)
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 256)
+#endif
+        for (ssize_t p=0; p<n; ++p) {
+            ssize_t i = order[p];
+            ssize_t from = lo[p], to = hi[p];
+            if (to-from > max_bucket_size) {
+                from = std::max(from, p-w);
+                to   = std::min(to, p+w+1);
+            }
+            for (ssize_t t=from; t<to; ++t) {
+                ssize_t j = order[t];
+                if (j == i) continue;
+                __minhash_knn_insert(nn_dist+i*k, nn_ind+i*k, k,
+                    dist.pairwise(i, j), j);
+            }
+        }
+    }
+}
+
+
+#endif
@@ -0,0 +1,97 @@
+/*  Access Pattern Hints for Memory-Mapped Data
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_mmap_h
+#define __c_mmap_h
+
+#include "c_common.h"
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+
+/*! Access pattern hints, see Cmadvise() */
+#define GENIECLUST_ADVICE_NORMAL     0
+#define GENIECLUST_ADVICE_SEQUENTIAL 1
+#define GENIECLUST_ADVICE_RANDOM     2
+#define GENIECLUST_ADVICE_WILLNEED   3
+
+
+/*! Tells the operating system how a memory range is going to be accessed,
+ *  which matters if it is backed by a memory-mapped file (e.g., a numpy.memmap)
+ *  that does not fit in RAM: data can be read ahead, in large blocks,
+ *  and the pages already processed can be evicted first.
+ *
+ *  The range is extended to the page boundaries. This is only a hint:
+ *  it does not affect the results and errors are ignored;
+ *  a no-op on systems without posix_madvise().
+ *
+ *  @param addr start of the range
+ *  @param size length of the range in bytes
+ *  @param advice one of GENIECLUST_ADVICE_NORMAL,
+ *      GENIECLUST_ADVICE_SEQUENTIAL (read ahead aggressively),
+ *      GENIECLUST_ADVICE_RANDOM (no read-ahead), or
+ *      GENIECLUST_ADVICE_WILLNEED (start reading the range now)
+ */
+inline void Cmadvise(const void* addr, size_t size, int advice)
+{
+#if defined(POSIX_MADV_NORMAL) && defined(_SC_PAGESIZE)
+    if (!addr || size == 0) return;
+
+    static const long _page_size = sysconf(_SC_PAGESIZE);
+    if (_page_size <= 0) return;
+    uintptr_t page_size = (uintptr_t)_page_size;
+
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end   = start+size;
+    start -= start%page_size;
+
+    int posix_advice;
+    switch (advice) {
+        case GENIECLUST_ADVICE_SEQUENTIAL: posix_advice = POSIX_MADV_SEQUENTIAL; break;
+        case GENIECLUST_ADVICE_RANDOM:     posix_advice = POSIX_MADV_RANDOM;     break;
+        case GENIECLUST_ADVICE_WILLNEED:   posix_advice = POSIX_MADV_WILLNEED;   break;
+        default:                           posix_advice = POSIX_MADV_NORMAL;
+    }
+
+    (void)posix_madvise((void*)start, (size_t)(end-start), posix_advice);
+#else
+    (void)addr; (void)size; (void)advice;
+#endif
+}
+
+
+#endif
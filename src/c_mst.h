@@ -45,6 +45,9 @@
 #include "c_argfuns.h"
 #include "c_disjoint_sets.h"
 #include "c_distance.h"
+#include "c_sparse.h"
+#include "c_binary.h"
+#include "c_minhash.h"
 
 
 
@@ -200,6 +203,950 @@ ssize_t Cmst_from_nn(const T* dist, const ssize_t* ind,
 
 
 
+/*! (internal) Sorts the edges w.r.t. increasing weights (and then
+ *  the indices): the chunks are sorted in parallel and then merged
+ *  pairwise (each round in parallel).
+ */
+template <class T>
+void __Cmst_sort_edges(std::vector< CMstTriple<T> >& edges)
+{
+    auto cmp = [](const CMstTriple<T>& a, const CMstTriple<T>& b) {
+        return b < a;  // CMstTriple::operator< orders w.r.t. decreasing weights
+    };
+
+    ssize_t m = (ssize_t)edges.size();
+#ifdef _OPENMP
+    ssize_t n_chunks = omp_get_max_threads();
+#else
+    ssize_t n_chunks = 1;
+#endif
+    if (n_chunks <= 1 || m < 65536) {
+        std::sort(edges.begin(), edges.end(), cmp);
+        return;
+    }
+
+    std::vector<ssize_t> b(n_chunks+1);
+    for (ssize_t k=0; k<=n_chunks; ++k) b[k] = m*k/n_chunks;
+
+    CMstTriple<T>* src = edges.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (ssize_t k=0; k<n_chunks; ++k)
+        std::sort(src+b[k], src+b[k+1], cmp);
+
+    std::vector< CMstTriple<T> > tmp(m);
+    CMstTriple<T>* dst = tmp.data();
+    for (ssize_t width=1; width<n_chunks; width*=2) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 1)
+#endif
+        for (ssize_t k=0; k<n_chunks; k+=2*width) {
+            ssize_t lo  = b[k];
+            ssize_t mid = b[std::min(k+width, n_chunks)];
+            ssize_t hi  = b[std::min(k+2*width, n_chunks)];
+            std::merge(src+lo, src+mid, src+mid, src+hi, dst+lo, cmp);
+        }
+        std::swap(src, dst);
+    }
+    if (src != edges.data()) edges.swap(tmp);
+}
+
+
+/*! (internal) Kruskal's algorithm on the edges sorted
+ *  by __Cmst_sort_edges(), see Cmst_from_edges()
+ */
+template <class T>
+ssize_t __Cmst_kruskal(const std::vector< CMstTriple<T> >& edges, ssize_t n,
+    T* mst_dist, ssize_t* mst_ind, ssize_t* comp)
+{
+    ssize_t m = (ssize_t)edges.size();
+    ssize_t mst_edge_cur = 0;
+    CDisjointSets ds(n);
+    for (ssize_t j=0; j<m && mst_edge_cur < n-1; ++j) {
+        ssize_t u = edges[j].i1, v = edges[j].i2;
+        if (ds.find(u) == ds.find(v))
+            continue;
+
+        mst_ind[2*mst_edge_cur+0] = u;
+        mst_ind[2*mst_edge_cur+1] = v;
+        mst_dist[mst_edge_cur]    = edges[j].d;
+        ds.merge(u, v);
+        mst_edge_cur++;
+    }
+
+    ssize_t ret = mst_edge_cur;
+    while (mst_edge_cur < n-1) {
+        // the input graph is not connected (we have a forest)
+        mst_ind[2*mst_edge_cur+0] = -1;
+        mst_ind[2*mst_edge_cur+1] = -1;
+        mst_dist[mst_edge_cur]    = INFTY;
+        mst_edge_cur++;
+    }
+
+    if (comp) {
+        // the connected components, numbered in the order of appearance
+        std::vector<ssize_t> root_comp(n, -1);
+        ssize_t c = 0;
+        for (ssize_t i=0; i<n; ++i) {
+            ssize_t r = ds.find(i);
+            if (root_comp[r] < 0) root_comp[r] = c++;
+            comp[i] = root_comp[r];
+        }
+    }
+
+    return ret;
+}
+
+
+/*! Computes a minimum spanning forest of an undirected graph given
+ *  by a list of m weighted edges using Kruskal's algorithm,
+ *  and orders its edges w.r.t. increasing weights (and then the indices).
+ *
+ *  Duplicated edges and self-loops are allowed (and ignored).
+ *
+ * @param dist a vector of length m, dist[j] gives the weight of the j-th edge
+ * @param ind a c_contiguous matrix of size m*2, {ind[j,0], ind[j,1]}
+ *        defines the j-th edge
+ * @param m number of edges
+ * @param n number of nodes
+ * @param mst_dist [out] vector of length n-1, see Cmst_from_nn()
+ * @param mst_ind [out] matrix of size (n-1)*2, see Cmst_from_nn()
+ * @param comp [out] NULL or a vector of length n; comp[i] will give
+ *        the id of the connected component (0, 1, ...) of the i-th node
+ *
+ * @return number of edges in the minimal spanning forest
+ *        (n minus the number of connected components)
+ */
+template <class T>
+ssize_t Cmst_from_edges(const T* dist, const ssize_t* ind, ssize_t m, ssize_t n,
+    T* mst_dist, ssize_t* mst_ind, ssize_t* comp=NULL)
+{
+    if (n <= 0)   throw std::domain_error("n <= 0");
+    if (m < 0)    throw std::domain_error("m < 0");
+
+    for (ssize_t j=0; j<m; ++j) {
+        if (ind[2*j+0] < 0 || ind[2*j+0] >= n || ind[2*j+1] < 0 || ind[2*j+1] >= n)
+            throw std::domain_error("ind[j,:] not in [0, n)");
+    }
+
+    std::vector< CMstTriple<T> > edges(m);
+    CMstTriple<T>* __edges = edges.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t j=0; j<m; ++j)
+        __edges[j] = CMstTriple<T>(ind[2*j+0], ind[2*j+1], dist[j], true);
+
+    __Cmst_sort_edges(edges);
+    return __Cmst_kruskal(edges, n, mst_dist, mst_ind, comp);
+}
+
+
+/*! Computes a minimum spanning forest of an undirected graph given
+ *  by a sparse matrix in the compressed sparse row (CSR) format,
+ *  see Cmst_from_edges(). Unlike in Cmst_from_nn(), the nodes
+ *  may have arbitrary degrees.
+ *
+ *  Each edge may be given once or twice (e.g., the whole symmetric
+ *  matrix); self-loops are ignored.
+ *
+ * @param data a vector of length nnz=indptr[n], the edge weights
+ * @param indices a vector of length nnz; {i, indices[p]} is an edge
+ *        with weight data[p] for all indptr[i] <= p < indptr[i+1]
+ * @param indptr a vector of length n+1
+ * @param n number of nodes
+ * @param mst_dist [out] vector of length n-1, see Cmst_from_nn()
+ * @param mst_ind [out] matrix of size (n-1)*2, see Cmst_from_nn()
+ * @param comp [out] NULL or a vector of length n, see Cmst_from_edges()
+ *
+ * @return number of edges in the minimal spanning forest
+ */
+template <class T>
+ssize_t Cmst_from_graph(const T* data, const ssize_t* indices,
+    const ssize_t* indptr, ssize_t n,
+    T* mst_dist, ssize_t* mst_ind, ssize_t* comp=NULL)
+{
+    if (n <= 0)   throw std::domain_error("n <= 0");
+    if (indptr[0] != 0) throw std::domain_error("indptr[0] != 0");
+    for (ssize_t i=0; i<n; ++i) {
+        if (indptr[i+1] < indptr[i])
+            throw std::domain_error("indptr is not nondecreasing");
+    }
+    ssize_t m = indptr[n];
+    for (ssize_t p=0; p<m; ++p) {
+        if (indices[p] < 0 || indices[p] >= n)
+            throw std::domain_error("indices not in [0, n)");
+    }
+
+    std::vector< CMstTriple<T> > edges(m);
+    CMstTriple<T>* __edges = edges.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1024)
+#endif
+    for (ssize_t i=0; i<n; ++i) {
+        for (ssize_t p=indptr[i]; p<indptr[i+1]; ++p)
+            __edges[p] = CMstTriple<T>(i, indices[p], data[p], true);
+    }
+
+    __Cmst_sort_edges(edges);
+    return __Cmst_kruskal(edges, n, mst_dist, mst_ind, comp);
+}
+
+
+
+
+
+/*! (internal) Adapters giving the distance between two points
+ *  to __Cmst_from_complete_fused().
+ *
+ *  prepare(i, M, k) is called once before the distances from
+ *  the i-th point to the points in M[0], ..., M[k-1] are requested
+ *  via operator()(i, M[j]).
+ *
+ *  If has_lower_bound, then lower_bound(i, j) <= operator()(i, j)
+ *  is computed first; the exact distance is only requested if
+ *  the bound does not exclude the j-th point from becoming
+ *  the i-th point's nearest tree neighbour.
+ *
+ *  If squared, then operator()(i, j) gives the square of the actual
+ *  distance (which matters for the triangle inequality,
+ *  see __CMstPivotBoundedDistance).
+ *
+ *  If batched, then prepare(i, M, k) computes all the distances
+ *  in bulk; then, M only lists the points whose distances are
+ *  actually needed.
+ *
+ *  If has_bounded, then bounded(i, j, bound) is used instead of
+ *  operator()(i, j): it may return any value not less than bound
+ *  if the actual distance is not less than bound (early abandoning).
+ */
+template <class T>
+struct __CMstDistanceAdapter {
+    static const bool has_lower_bound = false;
+    static const bool has_bounded = false;
+    static const bool squared = false;
+    static const bool batched = false;
+    inline T lower_bound(ssize_t /*i*/, ssize_t /*j*/) const { return 0.0; }
+};
+
+
+template <class T, class DIST>
+struct __CMstPairwiseDistance : public __CMstDistanceAdapter<T> {
+    const DIST* dist;
+    __CMstPairwiseDistance(const DIST* dist) : dist(dist) { }
+    inline void prepare(ssize_t /*i*/, const ssize_t* /*M*/, ssize_t /*k*/) { }
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return dist->pairwise(i, j);
+    }
+};
+
+
+template <class T, class S=T>
+struct __CMstSquaredEuclideanDistance : public __CMstDistanceAdapter<T> {
+    static const bool squared = true;
+    const CDistanceEuclidean<T, S>* dist;
+    __CMstSquaredEuclideanDistance(const CDistanceEuclidean<T, S>* dist) : dist(dist) { }
+    inline void prepare(ssize_t /*i*/, const ssize_t* /*M*/, ssize_t /*k*/) { }
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return dist->sqdist(i, j);
+    }
+};
+
+
+template <class T, class S=T>
+struct __CMstSquaredEuclideanDistanceDot : public __CMstDistanceAdapter<T> {
+    static const bool squared = true;
+    const CDistanceEuclidean<T, S>* dist;
+    std::vector<T> buf;
+    __CMstSquaredEuclideanDistanceDot(const CDistanceEuclidean<T, S>* dist)
+        : dist(dist), buf(dist->n) { }
+    inline void prepare(ssize_t i, const ssize_t* M, ssize_t k) {
+        // pragma omp parallel for inside::
+        dist->sqdist_many(i, M, k, buf.data());
+    }
+    inline T operator()(ssize_t /*i*/, ssize_t j) const {
+        return buf[j];
+    }
+};
+
+
+template <class T, class DIST>
+struct __CMstPrecomputedDistance : public __CMstDistanceAdapter<T> {
+    const DIST* dist;
+    __CMstPrecomputedDistance(const DIST* dist) : dist(dist) { }
+    inline void prepare(ssize_t i, const ssize_t* /*M*/, ssize_t /*k*/) {
+        // the i-th row will be needed (memory-mapped data)
+        dist->prefetch(i);
+    }
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return dist->pairwise(i, j);
+    }
+};
+
+
+template <class T, class DIST>
+struct __CMstSparseDistance : public __CMstDistanceAdapter<T> {
+    DIST* dist;
+    __CMstSparseDistance(DIST* dist) : dist(dist) { }
+    inline void prepare(ssize_t i, const ssize_t* /*M*/, ssize_t /*k*/) {
+        // dot products with the i-th row in O(nnz) time
+        dist->X.scatter(i);
+    }
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return dist->from_scattered(i, j);
+    }
+};
+
+
+template <class T, class S=T>
+struct __CMstQuantizedSquaredEuclideanDistance : public __CMstDistanceAdapter<T> {
+    static const bool squared = true;
+    static const bool has_lower_bound = true;
+    const CDistanceEuclidean<T, S>* dist;
+    __CMstQuantizedSquaredEuclideanDistance(const CDistanceEuclidean<T, S>* dist) : dist(dist) { }
+    inline void prepare(ssize_t /*i*/, const ssize_t* /*M*/, ssize_t /*k*/) { }
+    inline T lower_bound(ssize_t i, ssize_t j) const {
+        return dist->sqdist_lower_bound(i, j);
+    }
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return dist->sqdist(i, j);
+    }
+};
+
+
+/*! (internal) Early-abandoning squared Euclidean (MANHATTAN=false)
+ *  or Manhattan (MANHATTAN=true) distances; the features are accumulated
+ *  in the order of decreasing variances, and the computations stop
+ *  as soon as the partial sum reaches the distance between
+ *  the point and its current nearest tree neighbour,
+ *  see __bounded_distance().
+ */
+template <class T, class DIST, bool MANHATTAN>
+struct __CMstEarlyAbandoningDistance : public __CMstDistanceAdapter<T> {
+    static const bool has_bounded = true;
+    static const bool squared = !MANHATTAN;
+    const DIST* dist;
+    __CMstEarlyAbandoningDistance(const DIST* dist) : dist(dist) { }
+    inline void prepare(ssize_t /*i*/, const ssize_t* /*M*/, ssize_t /*k*/) { }
+    inline T bounded(ssize_t i, ssize_t j, T bound) const {
+        return __bounded_distance<T, MANHATTAN>(
+            dist->Xv.data()+i*dist->d, dist->Xv.data()+j*dist->d, dist->d, bound);
+    }
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return bounded(i, j, INFTY);
+    }
+};
+
+
+template <class T>
+struct __CMstBufferedDistance : public __CMstDistanceAdapter<T> {
+    static const bool batched = true;
+    CDistance<T>* dist;
+    const T* buf;
+    __CMstBufferedDistance(CDistance<T>* dist) : dist(dist), buf(NULL) { }
+    inline void prepare(ssize_t i, const ssize_t* M, ssize_t k) {
+        // pragma omp parallel for inside::
+        buf = (*dist)(i, M, k);
+    }
+    inline T operator()(ssize_t /*i*/, ssize_t j) const {
+        return buf[j];
+    }
+};
+
+
+
+/*! (internal) Distances from all the points to a few pivots,
+ *  see __CMstPivotBoundedDistance.
+ */
+template <class T>
+struct __CMstPivots {
+    ssize_t k;              // the number of pivots
+    std::vector<T> P;       // P[j*k+u] - distance between the j-th point and the u-th pivot
+    std::vector<ssize_t> pivots;
+
+    __CMstPivots(ssize_t k) : k(k) { }
+
+    /*! Selects the pivots by means of the farthest-first traversal
+     *  (starting at the 0-th point) and computes the (actual, not squared)
+     *  distances between them and all the n points
+     *  (k passes over the data).
+     */
+    template <class DIST>
+    void compute(DIST& dist, ssize_t n) {
+        if (k > n) k = n;
+        P.resize(n*k);
+        pivots.resize(k);
+        std::vector<ssize_t> M(n);
+        std::vector<T> mind(n, INFTY);
+        for (ssize_t j=0; j<n; ++j) M[j] = j;
+
+        ssize_t p = 0;
+        for (ssize_t u=0; u<k; ++u) {
+            pivots[u] = p;
+            dist.prepare(p, M.data(), n);
+            T* __P = P.data();
+            T* __mind = mind.data();
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(static)
+#endif
+            for (ssize_t j=0; j<n; ++j) {
+                T d = dist(p, j);
+                if (DIST::squared) d = sqrt(d);
+                __P[j*k+u] = d;
+                if (d < __mind[j]) __mind[j] = d;
+            }
+
+            // the next pivot: the point farthest from the current ones
+            for (ssize_t j=0; j<n; ++j)
+                if (mind[j] > mind[p] && std::isfinite(mind[j])) p = j;
+        }
+    }
+};
+
+
+/*! (internal) An adapter wrapping another one (BASE) that additionally
+ *  provides lower bounds based on the triangle inequality:
+ *  d(i, j) >= |d(i, p)-d(j, p)| for every pivot p.
+ *
+ *  Hence, the distance between the most recently added vertex and
+ *  a point w is only computed if the bound is less than the distance
+ *  between w and its nearest tree neighbour (and the core distances);
+ *  on clustered data, most evaluations are avoided. This is valid
+ *  for metrics only (and the mutual reachability distances based thereon,
+ *  as they are not smaller than the underlying distances).
+ */
+template <class T, class BASE>
+struct __CMstPivotBoundedDistance : public __CMstDistanceAdapter<T> {
+    static const bool has_lower_bound = true;
+    static const bool has_bounded = BASE::has_bounded;
+    static const bool squared = BASE::squared;
+    static const bool batched = BASE::batched;
+    BASE& base;
+    const __CMstPivots<T>& pivots;
+    T shrink;  // guards against the rounding errors
+
+    __CMstPivotBoundedDistance(BASE& base, const __CMstPivots<T>& pivots)
+        : base(base), pivots(pivots),
+          shrink(1.0-64*std::numeric_limits<T>::epsilon()) { }
+
+    inline void prepare(ssize_t i, const ssize_t* M, ssize_t k) {
+        base.prepare(i, M, k);
+    }
+
+    inline T lower_bound(ssize_t i, ssize_t j) const {
+        ssize_t k = pivots.k;
+        const T* pi = pivots.P.data()+i*k;
+        const T* pj = pivots.P.data()+j*k;
+        T lb = 0.0;
+        for (ssize_t u=0; u<k; ++u) {
+            T d = fabs(pi[u]-pj[u]);
+            if (d > lb) lb = d;
+        }
+        lb *= shrink;
+        if (squared) lb *= lb;
+        if (BASE::has_lower_bound) {
+            T lb2 = base.lower_bound(i, j);
+            if (lb2 > lb) lb = lb2;
+        }
+        return lb;
+    }
+
+    inline T bounded(ssize_t i, ssize_t j, T bound) const {
+        return base.bounded(i, j, bound);
+    }
+
+    inline T operator()(ssize_t i, ssize_t j) const {
+        return base(i, j);
+    }
+};
+
+
+
+/*! (internal) Calls dist.bounded(i, j, bound) if DIST::has_bounded
+ *  and dist(i, j) otherwise.
+ */
+template <bool HAS_BOUNDED>
+struct __CMstDistanceEval {
+    template <class T, class DIST>
+    static inline T get(const DIST& dist, ssize_t i, ssize_t j, T /*bound*/) {
+        return dist(i, j);
+    }
+};
+
+template <>
+struct __CMstDistanceEval<true> {
+    template <class T, class DIST>
+    static inline T get(const DIST& dist, ssize_t i, ssize_t j, T bound) {
+        return dist.bounded(i, j, bound);
+    }
+};
+
+
+
+/*! (internal) Whether the distance between lastj and w must be computed
+ *  in __Cmst_from_complete_fused(): the mutual reachability distance
+ *  is at least d_core_max = max{d_core[lastj], d_core[w]}, and the distance
+ *  is at least its lower bound (if available); no need to compute it
+ *  if this exceeds Dnn_w.
+ */
+template <class T, class DIST>
+inline bool __Cmst_dist_needed(const DIST& dist, ssize_t lastj, ssize_t w,
+    T d_core_max, T Dnn_w)
+{
+    T mindist = d_core_max;
+    if (DIST::has_lower_bound && mindist < Dnn_w) {
+        T lb = dist.lower_bound(lastj, w);
+        if (lb > mindist) mindist = lb;
+    }
+    return mindist < Dnn_w;
+}
+
+
+
+/*! (internal) The Jarník (Prim) algorithm, see Cmst_from_complete().
+ *
+ *  Each iteration is a single (parallel) pass over the points not yet
+ *  in the tree which computes their distances to the most recently added
+ *  vertex, applies the mutual reachability correction
+ *  (if d_core is not NULL), updates Dnn and Fnn, removes the most recently
+ *  added vertex from the list M (preserving the order) and finds the
+ *  next vertex to add. Ties are resolved in favour of the earliest
+ *  point in M, regardless of the number of threads used.
+ *
+ *  @param dist an adapter, see __CMstPairwiseDistance
+ *  @param d_core core distances (n-ary array) or NULL
+ *  @param n number of points
+ *  @param res [out] array of n-1 edges, in the order of their inclusion
+ *  @return the number of exact distance evaluations
+ */
+template <class T, class DIST>
+ssize_t __Cmst_from_complete_fused(DIST& dist, const T* d_core, ssize_t n,
+    CMstTriple<T>* res)
+{
+    ssize_t n_computed = 0;  // the number of calls to dist(i, j)
+
+    std::vector<T>  Dnn(n, INFTY);
+    std::vector<ssize_t> Fnn(n);
+    std::vector<ssize_t> M(n), M_next(n);
+    std::vector<ssize_t> M_eval((DIST::batched)?n:0);
+    std::vector<char> needed((DIST::batched)?n:0);
+
+    for (ssize_t i=0; i<n; ++i) M[i] = i;
+
+#ifdef _OPENMP
+    ssize_t n_threads = omp_get_max_threads();
+#else
+    ssize_t n_threads = 1;
+#endif
+    std::vector<ssize_t> best_pos(n_threads);
+
+    ssize_t lastj = 0, lastpos = 0;
+    for (ssize_t i=0; i<n-1; ++i) {
+        // M[0], ... M[n-i-1] - lastj (at position lastpos) and the points
+        // not yet in the MST, in the increasing order (better memory access
+        // patterns than with swap-removals, especially if X is ordered along
+        // a space-filling curve, see Cmorton_order());
+        // M_next gets the same sequence without lastj
+        ssize_t m = n-i-1;
+
+        const ssize_t* __M = M.data();
+        ssize_t* __M_next = M_next.data();
+        T* __Dnn = Dnn.data();
+        ssize_t* __Fnn = Fnn.data();
+        char* __needed = needed.data();
+        T d_core_lastj = (d_core)?d_core[lastj]:0.0;
+
+        if (DIST::batched) {
+            // the distances are computed in bulk: request only
+            // the ones that are not excluded by the core distances
+            // or the lower bounds
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(static) num_threads(n_threads)
+#endif
+            for (ssize_t j=0; j<m; ++j) {
+                ssize_t w = __M[j+(j>=lastpos)];
+                T d_core_max = (d_core)?std::max(d_core_lastj, d_core[w]):0.0;
+                __needed[j] = __Cmst_dist_needed(dist, lastj, w, d_core_max, __Dnn[w]);
+            }
+
+            ssize_t k = 0;
+            for (ssize_t j=0; j<m; ++j)
+                if (needed[j]) M_eval[k++] = M[j+(j>=lastpos)];
+            dist.prepare(lastj, M_eval.data(), k);
+        }
+        else
+            dist.prepare(lastj, M.data(), m+1);
+        std::fill(best_pos.begin(), best_pos.end(), -1);
+
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(n_threads) reduction(+:n_computed)
+#endif
+        {
+#ifdef _OPENMP
+            ssize_t t = omp_get_thread_num();
+#else
+            ssize_t t = 0;
+#endif
+            ssize_t bestpos = -1;
+#ifdef _OPENMP
+            #pragma omp for schedule(static)
+#endif
+            for (ssize_t j=0; j<m; ++j) {
+                ssize_t w = __M[j+(j>=lastpos)];
+                __M_next[j] = w;
+
+                T d_core_max = 0.0;
+                if (d_core) {
+                    d_core_max = d_core_lastj;
+                    if (d_core[w] > d_core_max) d_core_max = d_core[w];
+                }
+
+                if ((DIST::batched)?__needed[j]:
+                        __Cmst_dist_needed(dist, lastj, w, d_core_max, __Dnn[w])) {
+                    // curdist = max{curdist, d_core[lastj], d_core[w]}
+                    T curdist = __CMstDistanceEval<DIST::has_bounded>::get(
+                        dist, lastj, w, __Dnn[w]);
+                    ++n_computed;
+                    if (d_core_max > curdist) curdist = d_core_max;
+                    if (curdist < __Dnn[w]) {
+                        __Dnn[w] = curdist;
+                        __Fnn[w] = lastj;
+                    }
+                }
+                if (bestpos < 0 || __Dnn[w] < __Dnn[__M_next[bestpos]])
+                    bestpos = j;
+            }
+            best_pos[t] = bestpos;
+        }
+
+        // static scheduling: each thread processed a contiguous chunk
+        ssize_t bestpos = -1;
+        for (ssize_t t=0; t<n_threads; ++t) {
+            ssize_t p = best_pos[t];
+            if (p < 0) continue;
+            if (bestpos < 0 || Dnn[M_next[p]] < Dnn[M_next[bestpos]] ||
+                    (Dnn[M_next[p]] == Dnn[M_next[bestpos]] && p < bestpos))
+                bestpos = p;
+        }
+        GENIECLUST_ASSERT(bestpos >= 0);
+        ssize_t bestj = M_next[bestpos];
+
+        // and an edge to MST: (smaller index first)
+        res[i] = CMstTriple<T>(Fnn[bestj], bestj, Dnn[bestj], true);
+
+        M.swap(M_next);
+        lastj = bestj;          // next time, start from bestj
+        lastpos = bestpos;
+    }
+
+    return n_computed;
+}
+
+
+
+/*! (internal) Calls __Cmst_from_complete_fused(), possibly with
+ *  the distances' lower bounds based on n_pivots pivots,
+ *  see __CMstPivotBoundedDistance.
+ *
+ *  @return the number of exact distance evaluations
+ *  (including the ones needed to determine the pivots)
+ */
+template <class T, class DIST>
+ssize_t __Cmst_from_complete_prim(DIST& dist, const T* d_core, ssize_t n,
+    CMstTriple<T>* res, ssize_t n_pivots)
+{
+    if (n_pivots <= 0 || n <= 2)
+        return __Cmst_from_complete_fused(dist, d_core, n, res);
+
+    __CMstPivots<T> pivots(n_pivots);
+    pivots.compute(dist, n);
+    __CMstPivotBoundedDistance<T, DIST> adapter(dist, pivots);
+    return __Cmst_from_complete_fused(adapter, d_core, n, res)+n*pivots.k;
+}
+
+
+
+/*! (internal) A variant of __Cmst_from_complete_fused() for the squared
+ *  Euclidean (MANHATTAN=false) and the Manhattan (MANHATTAN=true)
+ *  distances in low, fixed dimensionality D.
+ *
+ *  The points not yet in the tree are kept in a structure-of-arrays
+ *  (column-major) copy of X, in the increasing order of their indices,
+ *  so that the distances from the most recently added vertex to a block
+ *  of consecutive candidates are computed feature by feature,
+ *  vectorising across the points (and not across the D features).
+ *  Vertices added to the tree become tombstones (infinite coordinates)
+ *  and the copy is compacted (preserving the order) once more than 1/8
+ *  of it consists of them. The results are identical to those of
+ *  __Cmst_from_complete_fused() (for finite distances).
+ *
+ *  @param X a c_contiguous array of shape (n, D), stored as S (the copy is in T)
+ *  @param d_core core distances (n-ary array) or NULL
+ *  @param n number of points
+ *  @param res [out] array of n-1 edges, in the order of their inclusion
+ */
+template <class T, class S, ssize_t D, bool MANHATTAN>
+void __Cmst_from_complete_soa(const S* X, const T* d_core, ssize_t n,
+    CMstTriple<T>* res)
+{
+    const ssize_t block_size = 64;
+
+    ssize_t m = n;  // the number of positions in use (including tombstones)
+    std::vector<T> Y(D*n);  // Y[u*n+j] - u-th feature of the j-th point
+    std::vector<ssize_t> ids(n);
+    std::vector<T> Dnn(n, INFTY);
+    std::vector<ssize_t> Fnn(n);
+    std::vector<T> core((d_core)?n:0);
+
+    for (ssize_t j=0; j<n; ++j) {
+        ids[j] = j;
+        for (ssize_t u=0; u<D; ++u) Y[u*n+j] = (T)X[j*D+u];
+        if (d_core) core[j] = d_core[j];
+    }
+
+#ifdef _OPENMP
+    ssize_t n_threads = omp_get_max_threads();
+#else
+    ssize_t n_threads = 1;
+#endif
+    std::vector<ssize_t> best_pos(n_threads);
+
+    ssize_t lastj = 0, lastpos = 0, n_removed = 0;
+    for (ssize_t i=0; i<n-1; ++i) {
+        T x[D];
+        for (ssize_t u=0; u<D; ++u) x[u] = Y[u*n+lastpos];
+        T d_core_lastj = (d_core)?d_core[lastj]:0.0;
+
+        // mark lastj as a tombstone: its distances to any point are
+        // infinite (or NaN), so its Dnn (also infinite) will never change
+        // and it will never be selected below
+        ids[lastpos] = -1;
+        Dnn[lastpos] = INFTY;
+        for (ssize_t u=0; u<D; ++u) Y[u*n+lastpos] = INFTY;
+        ++n_removed;
+
+        if (8*n_removed > m) {
+            ssize_t k = 0;
+            for (ssize_t j=0; j<m; ++j) {
+                if (ids[j] < 0) continue;
+                for (ssize_t u=0; u<D; ++u) Y[u*n+k] = Y[u*n+j];
+                ids[k] = ids[j];
+                Dnn[k] = Dnn[j];
+                Fnn[k] = Fnn[j];
+                if (d_core) core[k] = core[j];
+                ++k;
+            }
+            GENIECLUST_ASSERT(k == n-i-1);
+            m = k;
+            n_removed = 0;
+        }
+
+        const T* __Y = Y.data();
+        const T* __core = core.data();
+        T* __Dnn = Dnn.data();
+        ssize_t* __Fnn = Fnn.data();
+        ssize_t n_blocks = (m+block_size-1)/block_size;
+        std::fill(best_pos.begin(), best_pos.end(), -1);
+
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(n_threads)
+#endif
+        {
+#ifdef _OPENMP
+            ssize_t t = omp_get_thread_num();
+#else
+            ssize_t t = 0;
+#endif
+            ssize_t bestpos = -1;
+            T bestdist = INFTY;
+            T buf[block_size];
+#ifdef _OPENMP
+            #pragma omp for schedule(static)
+#endif
+            for (ssize_t b=0; b<n_blocks; ++b) {
+                ssize_t lo = b*block_size;
+                ssize_t l = std::min(block_size, m-lo);
+
+                // the distances from lastj to the points in the block:
+                for (ssize_t j=0; j<l; ++j) buf[j] = 0.0;
+                for (ssize_t u=0; u<D; ++u) {
+                    const T* y = __Y+u*n+lo;
+                    T x_u = x[u];
+                    if (MANHATTAN)
+                        for (ssize_t j=0; j<l; ++j) buf[j] += fabs(y[j]-x_u);
+                    else
+                        for (ssize_t j=0; j<l; ++j) buf[j] += square(y[j]-x_u);
+                }
+
+                if (d_core) {
+                    // buf[j] = max{buf[j], d_core[lastj], d_core[w]}
+                    const T* c = __core+lo;
+                    for (ssize_t j=0; j<l; ++j) {
+                        T curdist = buf[j];
+                        curdist = (d_core_lastj > curdist)?d_core_lastj:curdist;
+                        curdist = (c[j] > curdist)?c[j]:curdist;
+                        buf[j] = curdist;
+                    }
+                }
+
+                T* dnn = __Dnn+lo;
+                ssize_t* fnn = __Fnn+lo;
+                for (ssize_t j=0; j<l; ++j) {
+                    T curdnn = dnn[j];
+                    if (buf[j] < curdnn) {
+                        curdnn = buf[j];
+                        dnn[j] = curdnn;
+                        fnn[j] = lastj;
+                    }
+                    if (curdnn < bestdist) {
+                        bestdist = curdnn;
+                        bestpos = lo+j;
+                    }
+                }
+            }
+            best_pos[t] = bestpos;
+        }
+
+        // static scheduling: each thread processed a contiguous chunk
+        ssize_t bestpos = -1;
+        for (ssize_t t=0; t<n_threads; ++t) {
+            ssize_t p = best_pos[t];
+            if (p < 0) continue;
+            if (bestpos < 0 || Dnn[p] < Dnn[bestpos] ||
+                    (Dnn[p] == Dnn[bestpos] && p < bestpos))
+                bestpos = p;
+        }
+
+        if (bestpos < 0) {
+            // all the remaining points are at infinite distances
+            for (bestpos=0; ids[bestpos] < 0; ++bestpos) ;
+            Fnn[bestpos] = lastj;
+        }
+        ssize_t bestj = ids[bestpos];
+
+        // and an edge to MST: (smaller index first)
+        res[i] = CMstTriple<T>(Fnn[bestpos], bestj, Dnn[bestpos], true);
+
+        lastj = bestj;          // next time, start from bestj
+        lastpos = bestpos;
+    }
+}
+
+
+
+/*! (internal) Calls __Cmst_from_complete_soa() whenever d is one of
+ *  the dimensionalities for which a specialised kernel is available
+ *  (and no pivots are requested)
+ *  and __Cmst_from_complete_prim() with the GENERIC adapter otherwise.
+ */
+template <class T, class S, bool MANHATTAN, class GENERIC, class DIST>
+void __Cmst_from_complete_dispatch_d(const DIST* dist, const T* d_core,
+    ssize_t n, CMstTriple<T>* res, ssize_t n_pivots, ssize_t& n_computed)
+{
+    // all the distances are computed by the specialised kernels
+    n_computed = n*(n-1)/2;
+
+    // memory-mapped data might not fit in RAM: no structure-of-arrays copy
+    switch ((dist->mapped || n_pivots > 0)?0:dist->d) {
+        case 2: __Cmst_from_complete_soa<T, S, 2, MANHATTAN>(dist->X, d_core, n, res); break;
+        case 3: __Cmst_from_complete_soa<T, S, 3, MANHATTAN>(dist->X, d_core, n, res); break;
+        case 4: __Cmst_from_complete_soa<T, S, 4, MANHATTAN>(dist->X, d_core, n, res); break;
+        case 8: __Cmst_from_complete_soa<T, S, 8, MANHATTAN>(dist->X, d_core, n, res); break;
+        default: {
+            GENERIC adapter(dist);
+            n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, n_pivots);
+        }
+    }
+}
+
+
+
+/*! (internal) Runs the Prim algorithm if d_pairwise is a CDistanceEuclidean,
+ *  CDistanceManhattan, or CDistanceCosine object with data stored as S.
+ *
+ *  @param d_pairwise distance
+ *  @param d_core core distances or NULL
+ *  @param n number of points
+ *  @param res [out] array of n-1 edges, in the order of their inclusion
+ *  @param d_core_squared [out] working storage
+ *  @param take_sqrt [out] whether the square roots of the edge weights
+ *      must be taken
+ *  @param n_pivots see __Cmst_from_complete_prim()
+ *  @param n_computed [out] the number of exact distance evaluations
+ *  @return false if d_pairwise is not of any of the above types
+ */
+template <class T, class S>
+bool __Cmst_from_complete_vector(CDistance<T>* d_pairwise, const T* d_core,
+    ssize_t n, CMstTriple<T>* res, std::vector<T>& d_core_squared, bool& take_sqrt,
+    ssize_t n_pivots, ssize_t& n_computed)
+{
+    if (CDistanceEuclidean<T, S>* d_euclid =
+            dynamic_cast< CDistanceEuclidean<T, S>* >(d_pairwise)) {
+        if (!d_euclid->squared) {
+            // max{sqrt(a), b} == sqrt(max{a, b**2}) for b >= 0
+            take_sqrt = true;
+            if (d_core) {
+                d_core_squared.resize(n);
+                for (ssize_t i=0; i<n; ++i)
+                    d_core_squared[i] = square(d_core[i]);
+                d_core = d_core_squared.data();
+            }
+        }
+        if (d_euclid->use_quantized) {
+            // lower bounds based on the 8-bit codes first
+            __CMstQuantizedSquaredEuclideanDistance<T, S> adapter(d_euclid);
+            n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, n_pivots);
+        }
+        else if (d_euclid->use_early_abandon) {
+            __CMstEarlyAbandoningDistance<T, CDistanceEuclidean<T, S>, false> adapter(d_euclid);
+            n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, n_pivots);
+        }
+        else if (d_euclid->use_dot) {
+            // high-dimensional spaces: dot products, 4 points at a time;
+            // prepare() determines all the distances from lastj anyway,
+            // so the pivots would not save any work
+            __CMstSquaredEuclideanDistanceDot<T, S> adapter(d_euclid);
+            n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, 0);
+        }
+        else {
+            __Cmst_from_complete_dispatch_d<T, S, false,
+                __CMstSquaredEuclideanDistance<T, S> >(d_euclid, d_core, n, res, n_pivots, n_computed);
+        }
+    }
+    else if (CDistanceManhattan<T, S>* d_manhattan =
+            dynamic_cast< CDistanceManhattan<T, S>* >(d_pairwise)) {
+        if (d_manhattan->use_early_abandon) {
+            __CMstEarlyAbandoningDistance<T, CDistanceManhattan<T, S>, true> adapter(d_manhattan);
+            n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, n_pivots);
+        }
+        else {
+            __Cmst_from_complete_dispatch_d<T, S, true,
+                __CMstPairwiseDistance< T, CDistanceManhattan<T, S> > >(d_manhattan, d_core, n, res, n_pivots, n_computed);
+        }
+    }
+    else if (CDistanceCosine<T, S>* d_cosine =
+            dynamic_cast< CDistanceCosine<T, S>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceCosine<T, S> > adapter(d_cosine);
+        n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, 0);  // not a metric
+    }
+    else if (CDistanceChebyshev<T, S>* d_chebyshev =
+            dynamic_cast< CDistanceChebyshev<T, S>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceChebyshev<T, S> > adapter(d_chebyshev);
+        n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, n_pivots);
+    }
+    else if (CDistanceMinkowski<T, S>* d_minkowski =
+            dynamic_cast< CDistanceMinkowski<T, S>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceMinkowski<T, S> > adapter(d_minkowski);
+        n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res, n_pivots);
+    }
+    else
+        return false;
+
+    return true;
+}
+
+
 
 /*! A Jarník (Prim/Dijkstra)-like algorithm for determining
  *  a(*) minimum spanning tree (MST) of a complete undirected graph
@@ -207,6 +1154,42 @@ ssize_t Cmst_from_nn(const T* dist, const ssize_t* ind,
  *
  *  However, the distances can be computed on the fly, so that O(n) memory is used.
  *
+ *  For the built-in distances (and the mutual reachability distances
+ *  based thereon), a specialised kernel is used: in each iteration,
+ *  the distances, the core distance correction, the update of
+ *  the nearest tree neighbours and the selection of the next vertex
+ *  are performed in a single pass; no intermediate n-ary buffers are used.
+ *  The squared Euclidean distances are used internally in the Euclidean case
+ *  (the square root is only taken on the resulting MST edge weights).
+ *  For the Euclidean and Manhattan distances and d in {2, 3, 4, 8},
+ *  kernels with the number of features fixed at compile time are used;
+ *  they operate on a structure-of-arrays copy of the input data.
+ *  In high-dimensional spaces, the Euclidean distances are computed
+ *  based on the dot products, see CDistanceEuclidean::sqdist_many().
+ *  The above also applies to the distances over data stored
+ *  in half precision (CFloat16, CBFloat16).
+ *  The Mahalanobis and standardised Euclidean distances are
+ *  the Euclidean ones between the transformed points, see __CWhitenedData.
+ *  For the distances between the rows of sparse (CSR) matrices,
+ *  the most recently added vertex is scattered to a dense vector first,
+ *  see CCsrMatrix::scatter().
+ *  For bit-packed binary data (CDistanceHamming, CDistanceJaccardBits),
+ *  the distances are computed by means of popcounts.
+ *  For set data, CDistanceMinHash compares the MinHash signatures;
+ *  see also Cminhash_lsh_knn() for an approximate, subquadratic alternative.
+ *  If CDistanceEuclidean::quantize() was called, the exact distances
+ *  are only computed for the pairs of points whose lower bounds
+ *  based on the 8-bit codes do not exceed the current distances
+ *  to the nearest tree neighbours; this does not change the MST.
+ *  Similarly, if n_pivots > 0, then the lower bounds based on the triangle
+ *  inequality and the distances to n_pivots pivots are used, see
+ *  __CMstPivotBoundedDistance (valid for metrics only; the distances
+ *  are then never computed by the structure-of-arrays kernels).
+ *  The pivots are ignored for the cosine distances and whenever
+ *  the Euclidean ones are computed based on the dot products.
+ *  For precomputed distances and CDistanceCallback, it is the caller's
+ *  responsibility to request the pivots only if they define a metric.
+ *
  *  (*) Note that there might be multiple minimum trees spanning a given graph.
  *
  *
@@ -237,47 +1220,91 @@ ssize_t Cmst_from_nn(const T* dist, const ssize_t* ind,
  * @param mst_i [out] vector of length 2*(n-1), representing
  *        a c_contiguous array of shape (n-1,2), defining the edges
  *        corresponding to mst_d, with mst_i[j,0] < mst_i[j,1] for all j
+ * @param n_pivots number of pivots for pruning the distance evaluations,
+ *        0 to disable; the distances must fulfil the triangle inequality
+ * @param n_computed [out] if not NULL, the number of distances
+ *        actually computed (out of n*(n-1)/2 pairs) will be stored here
  */
 template <class T>
 void Cmst_from_complete(CDistance<T>* dist, ssize_t n,
-    T* mst_dist, ssize_t* mst_ind)
+    T* mst_dist, ssize_t* mst_ind,
+    ssize_t n_pivots=0, ssize_t* n_computed=NULL)
 {
-    std::vector<T>  Dnn(n, INFTY);
-    std::vector<ssize_t> Fnn(n);
-    std::vector<ssize_t> M(n);
+    ssize_t __n_computed = 0;
     std::vector< CMstTriple<T> > res(n-1);
 
-    for (ssize_t i=0; i<n; ++i) M[i] = i;
-
-    ssize_t lastj = 0, bestj, bestjpos;
-    for (ssize_t i=0; i<n-1; ++i) {
-        // M[1], ... M[n-i-1] - points not yet in the MST
-
-        // compute the distances from lastj (on the fly)
-        // dist_from_lastj[j] == d(lastj, j)
-        // pragma omp parallel for inside::
-        const T* dist_from_lastj = (*dist)(lastj, M.data()+1, n-i-1);
-
-        bestjpos = bestj = 0;
-        for (ssize_t j=1; j<n-i; ++j) {
-            // T curdist = dist[n*lastj+M_j]; // d(lastj, M_j)
-            ssize_t M_j = M[j];
-            T curdist = dist_from_lastj[M_j];
-            if (curdist < Dnn[M_j]) {
-                Dnn[M_j] = curdist;
-                Fnn[M_j] = lastj;
-            }
-            if (Dnn[M_j] < Dnn[bestj]) {        // D[0] == INFTY
-                bestj = M_j;
-                bestjpos = j;
-            }
-        }
+    const T* d_core = NULL;
+    CDistance<T>* d_pairwise = dist;
+    CDistanceMutualReachability<T>* d_mutreach =
+        dynamic_cast< CDistanceMutualReachability<T>* >(dist);
+    if (d_mutreach) {
+        d_core = d_mutreach->d_core;
+        d_pairwise = d_mutreach->d_pairwise;
+    }
 
-        M[bestjpos] = M[n-i-1]; // never ever visit bestj again
-        lastj = bestj;          // next time, start from bestj
+    bool take_sqrt = false;
+    std::vector<T> d_core_squared;
 
-        // and an edge to MST: (smaller index first)
-        res[i] = CMstTriple<T>(Fnn[bestj], bestj, Dnn[bestj], true);
+    if (__Cmst_from_complete_vector<T, T>(d_pairwise, d_core, n,
+            res.data(), d_core_squared, take_sqrt, n_pivots, __n_computed)) { }
+    else if (__Cmst_from_complete_vector<T, CFloat16>(d_pairwise, d_core, n,
+            res.data(), d_core_squared, take_sqrt, n_pivots, __n_computed)) { }
+    else if (__Cmst_from_complete_vector<T, CBFloat16>(d_pairwise, d_core, n,
+            res.data(), d_core_squared, take_sqrt, n_pivots, __n_computed)) { }
+    else if (CDistanceCompletePrecomputed<T>* d_precomputed =
+            dynamic_cast< CDistanceCompletePrecomputed<T>* >(d_pairwise)) {
+        // n_pivots > 0 only if the caller guarantees this is a metric
+        __CMstPrecomputedDistance< T, CDistanceCompletePrecomputed<T> > adapter(d_precomputed);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceSparseEuclidean<T>* d_sparse_euclid =
+            dynamic_cast< CDistanceSparseEuclidean<T>* >(d_pairwise)) {
+        __CMstSparseDistance< T, CDistanceSparseEuclidean<T> > adapter(d_sparse_euclid);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceSparseCosine<T>* d_sparse_cosine =
+            dynamic_cast< CDistanceSparseCosine<T>* >(d_pairwise)) {
+        __CMstSparseDistance< T, CDistanceSparseCosine<T> > adapter(d_sparse_cosine);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), 0);  // not a metric
+    }
+    else if (CDistanceSparseManhattan<T>* d_sparse_manhattan =
+            dynamic_cast< CDistanceSparseManhattan<T>* >(d_pairwise)) {
+        __CMstSparseDistance< T, CDistanceSparseManhattan<T> > adapter(d_sparse_manhattan);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceHamming<T>* d_hamming =
+            dynamic_cast< CDistanceHamming<T>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceHamming<T> > adapter(d_hamming);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceJaccardBits<T>* d_jaccard =
+            dynamic_cast< CDistanceJaccardBits<T>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceJaccardBits<T> > adapter(d_jaccard);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceMinHash<T>* d_minhash =
+            dynamic_cast< CDistanceMinHash<T>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceMinHash<T> > adapter(d_minhash);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceHaversine<T>* d_haversine =
+            dynamic_cast< CDistanceHaversine<T>* >(d_pairwise)) {
+        __CMstPairwiseDistance< T, CDistanceHaversine<T> > adapter(d_haversine);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else if (CDistanceCondensedPrecomputed<T>* d_condensed =
+            dynamic_cast< CDistanceCondensedPrecomputed<T>* >(d_pairwise)) {
+        // M is sorted, hence the distances to the points preceding lastj
+        // are read at increasing addresses and the remaining ones
+        // are contiguous
+        __CMstPrecomputedDistance< T, CDistanceCondensedPrecomputed<T> > adapter(d_condensed);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
+    }
+    else {
+        // any other CDistance (e.g., CDistanceCallback): compute
+        // the distances from lastj to all the points in M first
+        __CMstBufferedDistance<T> adapter(d_pairwise);
+        __n_computed = __Cmst_from_complete_prim(adapter, d_core, n, res.data(), n_pivots);
     }
 
     // sort the resulting MST edges in nondecreasing order w.r.t. d
@@ -288,6 +1315,13 @@ void Cmst_from_complete(CDistance<T>* dist, ssize_t n,
         mst_ind[2*i+0] = res[n-i-2].i1; // i1 < i2
         mst_ind[2*i+1] = res[n-i-2].i2;
     }
+
+    if (take_sqrt) {
+        for (ssize_t i=0; i<n-1; ++i)
+            mst_dist[i] = sqrt(mst_dist[i]);
+    }
+
+    if (n_computed) *n_computed = __n_computed;
 }
 
 #endif
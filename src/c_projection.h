@@ -0,0 +1,146 @@
+/*  Random projections for dimensionality reduction
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_projection_h
+#define __c_projection_h
+
+#include "c_common.h"
+#include "c_minhash.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! Projects the points onto a random k-dimensional subspace by means
+ *  of a very sparse random projection (P. Li, T.J. Hastie, K.W. Church,
+ *  Very sparse random projections, KDD 2006), Y = XR/sqrt(k),
+ *  where the elements of the d*k matrix R are independent and equal
+ *  to sqrt(s) and -sqrt(s) with probability 1/(2s) each, and 0 otherwise,
+ *  with s = sqrt(d).
+ *
+ *  By the Johnson–Lindenstrauss lemma, all the pairwise Euclidean
+ *  distances are preserved up to a factor of 1+-eps with high
+ *  probability if k is of the order of log(n)/eps^2 (regardless of d).
+ *
+ *  Only about k*sqrt(d) elements of R are nonzero; hence, the run time
+ *  is O(n*k*sqrt(d)) (parallelised over the points).
+ *
+ *  @param X n*d c_contiguous array
+ *  @param n number of points
+ *  @param d dimensionality
+ *  @param k target dimensionality
+ *  @param seed random seed
+ *  @param Y [out] n*k c_contiguous array
+ */
+template <class T>
+void Crandom_projection(const T* X, ssize_t n, ssize_t d, ssize_t k,
+    uint64_t seed, T* Y)
+{
+    if (n <= 0) throw std::domain_error("n <= 0");
+    if (d <= 0) throw std::domain_error("d <= 0");
+    if (k <= 0) throw std::domain_error("k <= 0");
+
+    // the nonzero elements of R, column by column
+    double s = sqrt((double)d);
+    std::vector<ssize_t> R_ptr(k+1, 0);
+    std::vector<ssize_t> R_feat;
+    std::vector<T> R_val;
+    T scale = (T)sqrt(s/(double)k);
+    uint64_t state = seed;
+    for (ssize_t j=0; j<k; ++j) {
+        for (ssize_t u=0; u<d; ++u) {
+            double r = (double)(__splitmix64(state) >> 11)/9007199254740992.0;  // [0, 1), i.e., *2^-53
+            if (r < 0.5/s) {
+                R_feat.push_back(u);
+                R_val.push_back(scale);
+            }
+            else if (r < 1.0/s) {
+                R_feat.push_back(u);
+                R_val.push_back(-scale);
+            }
+        }
+        R_ptr[j+1] = (ssize_t)R_feat.size();
+    }
+
+    const ssize_t* __R_ptr = R_ptr.data();
+    const ssize_t* __R_feat = R_feat.data();
+    const T* __R_val = R_val.data();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t i=0; i<n; ++i) {
+        const T* x = X+i*d;
+        T* y = Y+i*k;
+        for (ssize_t j=0; j<k; ++j) {
+            T v = 0.0;
+            for (ssize_t p=__R_ptr[j]; p<__R_ptr[j+1]; ++p)
+                v += __R_val[p]*x[__R_feat[p]];
+            y[j] = v;
+        }
+    }
+}
+
+
+/*! Computes the Euclidean distances between the given pairs of points,
+ *  e.g., in order to re-weight the edges of a spanning tree determined
+ *  in a reduced space (see Crandom_projection()); O(m*d) time.
+ *
+ *  @param X n*d c_contiguous array
+ *  @param d dimensionality
+ *  @param ind m*2 c_contiguous array; {ind[j,0], ind[j,1]} is the j-th pair
+ *  @param m number of pairs
+ *  @param dist [out] array of length m
+ */
+template <class T>
+void Ceuclidean_at(const T* X, ssize_t d, const ssize_t* ind, ssize_t m, T* dist)
+{
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t j=0; j<m; ++j) {
+        const T* x = X+ind[2*j+0]*d;
+        const T* y = X+ind[2*j+1]*d;
+        T v = 0.0;
+        for (ssize_t u=0; u<d; ++u)
+            v += (x[u]-y[u])*(x[u]-y[u]);
+        dist[j] = sqrt(v);
+    }
+}
+
+
+#endif
@@ -0,0 +1,195 @@
+/*  Scalar Quantisation of Data Matrices
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_quantize_h
+#define __c_quantize_h
+
+#include "c_common.h"
+#include <cstdint>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! Returns sum((x[u]-y[u])**2) for two vectors of 8-bit codes.
+ *
+ *  The inner loop only uses 32-bit integer arithmetic
+ *  (so that it can be vectorised, e.g., with pmaddwd or vpdpwssd;
+ *  an explicit simd reduction is requested if OpenMP is enabled);
+ *  the partial sums are flushed to a 64-bit accumulator
+ *  before they can overflow.
+ */
+inline uint64_t __sqdist_u8(const uint8_t* x, const uint8_t* y, ssize_t d)
+{
+    const ssize_t block = 65536;  // 255**2 * 65536 < 2**32
+    uint64_t dist = 0;
+    for (ssize_t u0=0; u0<d; u0+=block) {
+        ssize_t u1 = std::min(d, u0+block);
+        uint32_t s = 0;
+#ifdef _OPENMP
+        #pragma omp simd reduction(+:s)
+#endif
+        for (ssize_t u=u0; u<u1; ++u) {
+            int32_t t = (int32_t)x[u]-(int32_t)y[u];
+            s += (uint32_t)(t*t);
+        }
+        dist += s;
+    }
+    return dist;
+}
+
+
+/*! A scalar-quantised copy of a data matrix, used to compute
+ *  lower bounds for the squared Euclidean distances between the points.
+ *
+ *  Each x[u] is represented by q[u] in {0, ..., 255}, where
+ *  x[u] ~ offset[u] + scale*q[u]; the offsets are feature-wise
+ *  and the scale is common to all the features, so that
+ *  ||x^-y^|| = scale*sqrt(sum((q[u]-r[u])**2)) can be computed
+ *  in integer arithmetic. The norms of the quantisation errors,
+ *  ||x-x^||, are stored as well. By the triangle inequality,
+ *  ||x-y|| >= ||x^-y^|| - ||x-x^|| - ||y-y^||, see lower_bound().
+ *
+ *  The codes take 4 (8) times less memory than the float (double)
+ *  data; the lower bounds allow for discarding most of the candidate
+ *  points without accessing the original data.
+ *
+ *  Query points can be encoded (with the same offsets and scale)
+ *  as well, see set_queries(); they are numbered n, n+1, ... then.
+ */
+template<class T>
+struct CQuantizedEuclidean {
+    ssize_t n;
+    ssize_t d;
+    std::vector<uint8_t> Q;
+    std::vector<T> resid;
+    std::vector<T> offset;
+    T scale;
+    T margin;
+
+    CQuantizedEuclidean() : n(0), d(0), scale(1.0), margin(1.0) { }
+
+    /*!
+     * @param X n*d c_contiguous array (of elements convertible to T)
+     * @param n number of points
+     * @param d dimensionality
+     */
+    template<class S>
+    CQuantizedEuclidean(const S* X, ssize_t n, ssize_t d)
+        : n(n), d(d), Q(n*d), resid(n), offset(d, INFTY)
+    {
+        std::vector<T> range(d, -INFTY);
+        for (ssize_t i=0; i<n; ++i) {
+            for (ssize_t u=0; u<d; ++u) {
+                T x = (T)X[i*d+u];
+                if (x < offset[u]) offset[u] = x;
+                if (x > range[u])  range[u]  = x;
+            }
+        }
+
+        scale = 0.0;
+        for (ssize_t u=0; u<d; ++u) {
+            range[u] -= offset[u];
+            if (range[u] > scale) scale = range[u];
+        }
+        scale /= 255.0;
+        if (!(scale > 0.0 && scale < INFTY)) scale = 1.0;
+
+        // guards against the rounding errors in lower_bound()
+        // and in the exact distances, which are sums of d terms
+        T eps = std::numeric_limits<T>::epsilon();
+        margin = std::max((T)0.5, (T)1.0-(T)(2*d+16)*eps);
+
+        encode(X, 0, n);
+    }
+
+    /*! Encodes the points X[0,:], ..., X[to-from-1,:] as the from-th, ...,
+     *  (to-1)-th one; the codes falling outside of [0, 255] (query points)
+     *  are clipped, which is accounted for in the residuals.
+     */
+    template<class S>
+    void encode(const S* X, ssize_t from, ssize_t to) {
+        uint8_t* __Q = Q.data();
+        T* __resid = resid.data();
+        const T* __offset = offset.data();
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t i=from; i<to; ++i) {
+            double r = 0.0;
+            for (ssize_t u=0; u<d; ++u) {
+                T x = (T)X[(i-from)*d+u];
+                double q = std::round(((double)x-(double)__offset[u])/(double)scale);
+                q = std::min(255.0, std::max(0.0, q));
+                __Q[i*d+u] = (uint8_t)q;
+                double e = (double)x-((double)__offset[u]+(double)scale*q);
+                r += e*e;
+            }
+            // round upwards
+            __resid[i] = (T)(sqrt(r)*(1.0+1e-12));
+            if ((double)__resid[i] < sqrt(r))
+                __resid[i] = std::nextafter(__resid[i], (T)INFTY);
+        }
+    }
+
+    /*! Encodes the m query points, which are numbered n, ..., n+m-1 then
+     *
+     *  @param Y m*d c_contiguous array (of elements convertible to T)
+     *  @param m number of query points
+     */
+    template<class S>
+    void set_queries(const S* Y, ssize_t m) {
+        Q.resize((n+m)*d);
+        resid.resize(n+m);
+        encode(Y, n, n+m);
+    }
+
+    /*! Returns a lower bound for the squared Euclidean distance
+     *  between the i-th and the j-th point
+     */
+    inline T lower_bound(ssize_t i, ssize_t j) const {
+        T dist = scale*(T)sqrt((T)__sqdist_u8(Q.data()+i*d, Q.data()+j*d, d));
+        dist = dist*margin-resid[i]-resid[j];
+        if (dist <= 0.0) return 0.0;
+        return dist*dist*margin;
+    }
+};
+
+
+#endif
@@ -0,0 +1,136 @@
+/*  Space-Filling Curve (Morton) Orderings of Point Sets
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_reorder_h
+#define __c_reorder_h
+
+#include "c_common.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! Comparer for Cmorton_order(); ties are resolved by the indices
+ *  (the permutation is stable)
+ */
+struct __morton_comparer {
+    const uint64_t* code;
+    __morton_comparer(const uint64_t* code) { this->code = code; }
+    bool operator()(ssize_t i, ssize_t j) const {
+        return code[i] < code[j] || (code[i] == code[j] && i < j);
+    }
+};
+
+
+/*! Determines the ordering of the points along the Z-order
+ *  (Morton, Lebesgue) space-filling curve.
+ *
+ *  Points close to each other in the ordering tend to be close
+ *  in space, too. Hence, if the rows of X are permuted accordingly,
+ *  algorithms that access the points in the order of their indices
+ *  (e.g., Cmst_from_complete()) may benefit from a better data locality
+ *  (fewer cache and TLB misses), especially when X does not fit in
+ *  the CPU caches.
+ *
+ *  Each coordinate is quantised to b bits so that the d*b interleaved
+ *  bits fit in a 64-bit code; in spaces of dimensionality d > 64,
+ *  only the 64 dimensions of the largest spreads are taken into account.
+ *
+ *  Run time: O(n*min(d,64)+n log n).
+ *
+ *  @param X n*d c_contiguous array
+ *  @param n number of points
+ *  @param d dimensionality
+ *  @param perm [out] array of length n; X[perm[0],:], X[perm[1],:], ...
+ *     is the ordered point sequence
+ */
+template <class T>
+void Cmorton_order(const T* X, ssize_t n, ssize_t d, ssize_t* perm)
+{
+    if (n <= 0) return;
+    if (d <= 0) throw std::domain_error("d <= 0");
+
+    std::vector<T> mins(X, X+d);
+    std::vector<T> maxs(X, X+d);
+    for (ssize_t i=1; i<n; ++i) {
+        for (ssize_t u=0; u<d; ++u) {
+            if (X[i*d+u] < mins[u]) mins[u] = X[i*d+u];
+            else if (X[i*d+u] > maxs[u]) maxs[u] = X[i*d+u];
+        }
+    }
+
+    // the dimensions to take into account
+    std::vector<ssize_t> dims(d);
+    for (ssize_t u=0; u<d; ++u) dims[u] = u;
+    ssize_t d_used = std::min(d, (ssize_t)64);
+    if (d_used < d) {
+        std::nth_element(dims.begin(), dims.begin()+d_used, dims.end(),
+            [&](ssize_t u, ssize_t v) {
+                return maxs[u]-mins[u] > maxs[v]-mins[v];
+            });
+        std::sort(dims.begin(), dims.begin()+d_used);
+    }
+    ssize_t b = 64/d_used;  // bits per dimension
+    double q_max = (double)((((uint64_t)1) << b) - 1);
+
+    std::vector<uint64_t> code(n);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (ssize_t i=0; i<n; ++i) {
+        uint64_t q[64];
+        for (ssize_t j=0; j<d_used; ++j) {
+            ssize_t u = dims[j];
+            double range = (double)maxs[u]-(double)mins[u];
+            q[j] = (range > 0.0)?(uint64_t)(((double)X[i*d+u]-(double)mins[u])/range*q_max):0;
+        }
+
+        uint64_t c = 0;
+        for (ssize_t bit=b-1; bit>=0; --bit) {
+            for (ssize_t j=0; j<d_used; ++j)
+                c = (c << 1) | ((q[j] >> bit) & 1);
+        }
+        code[i] = c;
+    }
+
+    for (ssize_t i=0; i<n; ++i) perm[i] = i;
+    std::sort(perm, perm+n, __morton_comparer(code.data()));
+}
+
+
+#endif
@@ -0,0 +1,391 @@
+/*  Distances Between Points Given by Sparse (CSR) Matrices
+ *
+ *  Copyright (C) 2018-2020 Marek Gagolewski (https://www.gagolewski.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its
+ *  contributors may be used to endorse or promote products derived from this
+ *  software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ *  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ *  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __c_sparse_h
+#define __c_sparse_h
+
+#include "c_common.h"
+#include "c_distance.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+
+/*! A sparse matrix in the compressed sparse row (CSR) format,
+ *  e.g., scipy.sparse.csr_matrix with sorted indices:
+ *  the nonzero elements in the i-th row are data[indptr[i]:indptr[i+1]]
+ *  and their column indices are indices[indptr[i]:indptr[i+1]]
+ *  (in increasing order).
+ *
+ *  A row can be scattered to a dense working vector so that the
+ *  dot products with other rows take O(number of nonzeros in the latter)
+ *  time, see scatter().
+ *
+ *  The rows of another CSR matrix (query points) can be appended
+ *  (without copying), see set_queries().
+ */
+template<class T>
+struct CCsrMatrix {
+    const T* data;
+    const ssize_t* indices;
+    const ssize_t* indptr;
+    ssize_t n;
+    ssize_t d;
+    const T* qdata;  // query points, see set_queries()
+    const ssize_t* qindices;
+    const ssize_t* qindptr;
+    ssize_t m;
+    std::vector<T> dense;
+    ssize_t dense_row;
+
+    /*!
+     * @param data nonzero elements
+     * @param indices column indices of the elements in data
+     * @param indptr array of length n+1
+     * @param n number of rows (points)
+     * @param d number of columns (dimensionality)
+     */
+    CCsrMatrix(const T* data, const ssize_t* indices, const ssize_t* indptr,
+            ssize_t n, ssize_t d)
+        : data(data), indices(indices), indptr(indptr), n(n), d(d),
+          qdata(NULL), qindices(NULL), qindptr(NULL), m(0), dense_row(-1)
+    { }
+
+    CCsrMatrix() : CCsrMatrix(NULL, NULL, NULL, 0, 0) { }
+
+    /*! Sets the query points, which are numbered n, ..., n+m-1 then;
+     *  the arguments are like in the constructor
+     */
+    void set_queries(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t m)
+    {
+        if (dense_row >= n) dense_row = -2;  // to be cleared in full
+        qdata = data;
+        qindices = indices;
+        qindptr = indptr;
+        this->m = m;
+    }
+
+    /*! Sets x and ix to the nonzero elements of the i-th row
+     *  and their column indices; returns their number
+     */
+    inline ssize_t row(ssize_t i, const T*& x, const ssize_t*& ix) const {
+        if (i < n) {
+            x  = data+indptr[i];
+            ix = indices+indptr[i];
+            return indptr[i+1]-indptr[i];
+        }
+        i -= n;
+        x  = qdata+qindptr[i];
+        ix = qindices+qindptr[i];
+        return qindptr[i+1]-qindptr[i];
+    }
+
+    /*! Stores the i-th row in dense (a d-ary vector);
+     *  only the elements set for the previously scattered row
+     *  are zeroed first.
+     */
+    void scatter(ssize_t i) {
+        if (dense_row == i) return;
+        const T* x;
+        const ssize_t* ix;
+        if ((ssize_t)dense.size() != d || dense_row == -2) dense.assign(d, 0.0);
+        else if (dense_row >= 0) {
+            ssize_t l = row(dense_row, x, ix);
+            for (ssize_t k=0; k<l; ++k) dense[ix[k]] = 0.0;
+        }
+        ssize_t l = row(i, x, ix);
+        for (ssize_t k=0; k<l; ++k) dense[ix[k]] = x[k];
+        dense_row = i;
+    }
+
+    /*! Returns <x, y>, where x is the scattered row and y is the j-th one */
+    inline T dot_scattered(ssize_t j) const {
+        const T* y;
+        const ssize_t* iy;
+        ssize_t l = row(j, y, iy);
+        T dot = 0.0;
+        for (ssize_t k=0; k<l; ++k)
+            dot += dense[iy[k]]*y[k];
+        return dot;
+    }
+
+    /*! Returns sum(f(x[u], y[u])) over the union of the nonzero
+     *  elements in the i-th and the j-th row, computed by merging
+     *  the (sorted) column indices
+     */
+    template<class F>
+    inline T merge(ssize_t i, ssize_t j, F f) const {
+        const T* x;
+        const T* y;
+        const ssize_t* ix;
+        const ssize_t* iy;
+        ssize_t ei = row(i, x, ix), ej = row(j, y, iy);
+        ssize_t ki = 0, kj = 0;
+        T res = 0.0;
+        while (ki < ei && kj < ej) {
+            if (ix[ki] == iy[kj])
+                res += f(x[ki++], y[kj++]);
+            else if (ix[ki] < iy[kj])
+                res += f(x[ki++], (T)0.0);
+            else
+                res += f((T)0.0, y[kj++]);
+        }
+        for (; ki < ei; ++ki) res += f(x[ki], (T)0.0);
+        for (; kj < ej; ++kj) res += f((T)0.0, y[kj]);
+        return res;
+    }
+
+    /*! Returns sum(f(x[u])) over the nonzero elements of the i-th row */
+    template<class F>
+    inline T reduce(ssize_t i, F f) const {
+        const T* x;
+        const ssize_t* ix;
+        ssize_t l = row(i, x, ix);
+        T res = 0.0;
+        for (ssize_t k=0; k<l; ++k)
+            res += f(x[k]);
+        return res;
+    }
+};
+
+
+
+/*! (internal) A base class for the distances between the rows
+ *  of a CSR matrix.
+ *
+ *  operator()(i, M, k) scatters the i-th row (see CCsrMatrix::scatter())
+ *  and calls DERIVED::from_scattered(i, M[j]) for each j (in parallel).
+ *
+ *  Upon set_queries_csr(), DERIVED::compute_norms(n, n+m) is called
+ *  to determine the auxiliary data on the query points.
+ */
+template<class T, class DERIVED>
+struct __CDistanceSparse : public CDistance<T> {
+    CCsrMatrix<T> X;
+    ssize_t n;
+    std::vector<T> buf;
+
+    __CDistanceSparse(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d)
+        : X(data, indices, indptr, n, d), n(n), buf(n)
+    { }
+
+    /*! See CDistance::set_queries_csr() */
+    virtual void set_queries_csr(const T* data, const ssize_t* indices,
+        const ssize_t* indptr, ssize_t m)
+    {
+        X.set_queries(data, indices, indptr, m);
+        static_cast<DERIVED*>(this)->compute_norms(n, n+m);
+    }
+
+    virtual const T* operator()(ssize_t i, const ssize_t* M, ssize_t k) {
+        T* __buf = buf.data();
+        X.scatter(i);
+        const DERIVED* self = static_cast<const DERIVED*>(this);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (ssize_t j=0; j<k; ++j) {
+            ssize_t w = M[j];
+            // GENIECLUST_ASSERT(w>=0 && w < n)
+            __buf[w] = self->from_scattered(i, w);
+        }
+        return __buf;
+    }
+};
+
+
+
+/*! The Euclidean distances between the rows of a CSR matrix.
+ *
+ *  The squared norms of the rows are precomputed; the squared distances
+ *  are determined via ||x||^2+||y||^2-2<x,y>, unless this might suffer
+ *  from catastrophic cancellation, see CDistanceEuclidean::sqdist_from_dot().
+ */
+template<class T>
+struct CDistanceSparseEuclidean
+        : public __CDistanceSparse< T, CDistanceSparseEuclidean<T> > {
+    bool squared;
+    std::vector<T> sqnorm;
+
+    /*! See CCsrMatrix; squared==true gives the squared Euclidean distance */
+    CDistanceSparseEuclidean(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d, bool squared=false)
+        : __CDistanceSparse< T, CDistanceSparseEuclidean<T> >(data, indices, indptr, n, d),
+          squared(squared)
+    {
+        compute_norms(0, n);
+    }
+
+    CDistanceSparseEuclidean()
+        : CDistanceSparseEuclidean(NULL, NULL, NULL, 0, 0) { }
+
+    /*! Computes the squared norms of the from-th, ..., (to-1)-th row */
+    void compute_norms(ssize_t from, ssize_t to) {
+        sqnorm.resize(to);
+        for (ssize_t i=from; i<to; ++i)
+            sqnorm[i] = this->X.reduce(i, [](T x) { return x*x; });
+    }
+
+    /*! Returns the squared distance between the i-th and the j-th point */
+    inline T sqdist(ssize_t i, ssize_t j) const {
+        return this->X.merge(i, j, [](T x, T y) { return (x-y)*(x-y); });
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        if (squared) return sqdist(i, j);
+        else return sqrt(sqdist(i, j));
+    }
+
+    /*! Returns the distance between the scattered i-th
+     *  and the j-th point */
+    inline T from_scattered(ssize_t i, ssize_t j) const {
+        T norms = sqnorm[i]+sqnorm[j];
+        T dist = norms-2.0*this->X.dot_scattered(j);
+        if (dist <= norms*(T)GENIECLUST_EUCLIDEAN_DOT_RECOMPUTE)
+            dist = sqdist(i, j);
+        if (squared) return dist;
+        else return sqrt(dist);
+    }
+};
+
+
+
+/*! The cosine distances between the rows of a CSR matrix,
+ *  see CDistanceCosine.
+ */
+template<class T>
+struct CDistanceSparseCosine
+        : public __CDistanceSparse< T, CDistanceSparseCosine<T> > {
+    std::vector<T> norm;
+
+    /*! See CCsrMatrix */
+    CDistanceSparseCosine(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d)
+        : __CDistanceSparse< T, CDistanceSparseCosine<T> >(data, indices, indptr, n, d)
+    {
+        compute_norms(0, n);
+    }
+
+    CDistanceSparseCosine()
+        : CDistanceSparseCosine(NULL, NULL, NULL, 0, 0) { }
+
+    /*! Computes the norms of the from-th, ..., (to-1)-th row */
+    void compute_norms(ssize_t from, ssize_t to) {
+        norm.resize(to);
+        for (ssize_t i=from; i<to; ++i)
+            norm[i] = sqrt(this->X.reduce(i, [](T x) { return x*x; }));
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        T dist = -this->X.merge(i, j, [](T x, T y) { return x*y; });
+        dist /= norm[i];
+        dist /= norm[j];
+        dist += 1.0;
+        return dist;
+    }
+
+    /*! Returns the distance between the scattered i-th
+     *  and the j-th point */
+    inline T from_scattered(ssize_t i, ssize_t j) const {
+        T dist = -this->X.dot_scattered(j);
+        dist /= norm[i];
+        dist /= norm[j];
+        dist += 1.0;
+        return dist;
+    }
+};
+
+
+
+/*! The Manhattan distances between the rows of a CSR matrix.
+ *
+ *  With the i-th row scattered, the distance to the j-th point is
+ *  ||x||_1 + sum(|x[u]-y[u]|-|x[u]|) over the nonzero y[u]'s.
+ */
+template<class T>
+struct CDistanceSparseManhattan
+        : public __CDistanceSparse< T, CDistanceSparseManhattan<T> > {
+    std::vector<T> norm1;
+
+    /*! See CCsrMatrix */
+    CDistanceSparseManhattan(const T* data, const ssize_t* indices,
+            const ssize_t* indptr, ssize_t n, ssize_t d)
+        : __CDistanceSparse< T, CDistanceSparseManhattan<T> >(data, indices, indptr, n, d)
+    {
+        compute_norms(0, n);
+    }
+
+    CDistanceSparseManhattan()
+        : CDistanceSparseManhattan(NULL, NULL, NULL, 0, 0) { }
+
+    /*! Computes the L1 norms of the from-th, ..., (to-1)-th row */
+    void compute_norms(ssize_t from, ssize_t to) {
+        norm1.resize(to);
+        for (ssize_t i=from; i<to; ++i)
+            norm1[i] = this->X.reduce(i, [](T x) { return (T)fabs(x); });
+    }
+
+    /*! Returns the distance between the i-th and the j-th point */
+    inline T pairwise(ssize_t i, ssize_t j) const {
+        return this->X.merge(i, j, [](T x, T y) { return (T)fabs(x-y); });
+    }
+
+    /*! Returns the distance between the scattered i-th
+     *  and the j-th point */
+    inline T from_scattered(ssize_t i, ssize_t j) const {
+        const CCsrMatrix<T>& X = this->X;
+        const T* y;
+        const ssize_t* iy;
+        ssize_t l = X.row(j, y, iy);
+        T dist = 0.0;
+        for (ssize_t k=0; k<l; ++k) {
+            T x = X.dense[iy[k]];
+            dist += fabs(x-y[k])-fabs(x);
+        }
+        dist += norm1[i];
+        if (dist < 0.0) dist = 0.0;  // rounding errors
+        return dist;
+    }
+};
+
+
+#endif